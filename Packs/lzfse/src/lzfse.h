@@ -123,6 +123,201 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSI
 	 *  behavior differs from that of lzfse_encode_buffer.                        */
 	LZFSE_API size_t lzfse_decode_buffer(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, void *__restrict scratch_buffer);
 
+	/*! @abstract Compress a buffer using LZFSE, with a checksum of the source.
+	 *
+	 *  Same as lzfse_encode_buffer( ), but the stream starts with a checksum
+	 *  block (XXH32 of the source, 8 bytes). lzfse_decode_buffer( ) checksums
+	 *  the output of each block as soon as it is decoded, and fails (returns
+	 *  zero) if the checksum of the complete output does not match. Such
+	 *  streams can't be decoded by LZFSE implementations ignoring this block. */
+	LZFSE_API size_t lzfse_encode_buffer_with_checksum(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, void *__restrict scratch_buffer);
+
+	/*! @abstract Reusable encoder context, for compressing many buffers.
+	 *
+	 *  lzfse_encode_buffer( ) sets up its whole workspace (a 512 KB match
+	 *  history table) on every call. A context keeps it between calls, and
+	 *  only invalidates what the previous buffers left in it, which is much
+	 *  cheaper for small and medium buffers. The output is the same as
+	 *  lzfse_encode_buffer( ). A context must not be used by two threads at
+	 *  the same time.                                                          */
+	typedef struct lzfse_encoder_context lzfse_encoder_context;
+
+	/*! @abstract Allocate an encoder context with malloc( ).
+	 *  @return The context, or NULL if allocation failed.                      */
+	LZFSE_API lzfse_encoder_context *lzfse_encoder_context_create(void);
+
+	/*! @abstract Forget the buffers previously encoded with ctx. This is cheap,
+	 *  and lzfse_encode_buffer_with_context( ) already does it on each call. */
+	LZFSE_API void lzfse_encoder_context_reset(lzfse_encoder_context *ctx);
+
+	/*! @abstract Release an encoder context.                                 */
+	LZFSE_API void lzfse_encoder_context_destroy(lzfse_encoder_context *ctx);
+
+	/*! @abstract Compress a buffer using LZFSE, with the workspace of ctx.
+	 *  Parameters and return value are the same as lzfse_encode_buffer( ).  */
+	LZFSE_API size_t lzfse_encode_buffer_with_context(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, lzfse_encoder_context *ctx);
+
+	/*! @abstract Reusable decoder context, for decompressing many buffers
+	 *  without allocating, nor clearing, a workspace on each call.           */
+	typedef struct lzfse_decoder_context lzfse_decoder_context;
+
+	/*! @abstract Allocate a decoder context with malloc( ).
+	 *  @return The context, or NULL if allocation failed.                      */
+	LZFSE_API lzfse_decoder_context *lzfse_decoder_context_create(void);
+
+	/*! @abstract Forget the buffer previously decoded with ctx. This is cheap,
+	 *  and lzfse_decode_buffer_with_context( ) already does it on each call. */
+	LZFSE_API void lzfse_decoder_context_reset(lzfse_decoder_context *ctx);
+
+	/*! @abstract Release a decoder context.                                  */
+	LZFSE_API void lzfse_decoder_context_destroy(lzfse_decoder_context *ctx);
+
+	/*! @abstract Decompress a buffer using LZFSE, with the workspace of ctx.
+	 *  Parameters and return value are the same as lzfse_decode_buffer( ).  */
+	LZFSE_API size_t lzfse_decode_buffer_with_context(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, lzfse_decoder_context *ctx);
+
+	/*! @abstract Streaming decoder, for streams too large to be held in memory.
+	 *
+	 *  Input and output are passed in pieces of any size. The decoder keeps
+	 *  a 1 MB output window (the last 256 KB are history matches may
+	 *  reference) and a copy of the current compressed block (64 KB, grown
+	 *  up to 4 MB if a block needs it), allocated with malloc( ).            */
+	typedef struct lzfse_decode_stream lzfse_decode_stream;
+
+	/*! @abstract Allocate a streaming decoder, ready to decode a stream.
+	 *  @return The decoder, or NULL if allocation failed.                      */
+	LZFSE_API lzfse_decode_stream *lzfse_decode_stream_create(void);
+
+	/*! @abstract Get the decoder ready to decode a new stream, keeping its
+	 *  buffers.                                                              */
+	LZFSE_API void lzfse_decode_stream_reset(lzfse_decode_stream *s);
+
+	/*! @abstract Release a streaming decoder.                                */
+	LZFSE_API void lzfse_decode_stream_destroy(lzfse_decode_stream *s);
+
+	/*! @abstract Decode as much as possible of the stream.
+	 *
+	 *  @param src_buffer, src_size
+	 *  Next input bytes, advanced past the bytes consumed (copied).
+	 *
+	 *  @param dst_buffer, dst_size
+	 *  Space for the next output bytes, advanced past the bytes written.
+	 *
+	 *  @return
+	 *  1 once the end of the stream is decoded and all its output written
+	 *  (input past it is ignored, and may be partly consumed; see
+	 *  lzfse_decode_stream_unused( )). 0 if more input
+	 *  is needed (*src_size is 0), or more output space (*dst_size is 0). -1 if
+	 *  the stream is corrupted, or the decoder ran out of memory.            */
+	LZFSE_API int lzfse_decode_stream_process(lzfse_decode_stream *s, const uint8_t **src_buffer, size_t *src_size, uint8_t **dst_buffer, size_t *dst_size);
+
+	/*! @abstract Number of input bytes past the end of the stream that
+	 *  lzfse_decode_stream_process( ) consumed before it returned 1. A caller
+	 *  that expects nothing after the stream checks this is 0.               */
+	LZFSE_API size_t lzfse_decode_stream_unused(const lzfse_decode_stream *s);
+
+	/*! @abstract Compress a buffer using LZFSE and a preset dictionary.
+	 *
+	 *  Matches may reference the end of the dictionary as if it immediately
+	 *  preceded the source, which helps small payloads sharing content with
+	 *  the dictionary. The output can only be decompressed with
+	 *  lzfse_decode_buffer_with_dict( ) and the same dictionary.
+	 *
+	 *  @param dict_buffer
+	 *  Pointer to the first byte of the dictionary, see lzfse_train_dict( ).
+	 *  Only its last 256 KB are used (64 KB for inputs compressed with LZVN).
+	 *
+	 *  @param dict_size
+	 *  Size of the dictionary in bytes.
+	 *
+	 *  Other parameters and return value are the same as lzfse_encode_buffer( ).
+	 *  A working copy of the dictionary and source is allocated with malloc( ). */
+	LZFSE_API size_t lzfse_encode_buffer_with_dict(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, const uint8_t *__restrict dict_buffer, size_t dict_size, void *__restrict scratch_buffer);
+
+	/*! @abstract Decompress a buffer compressed with
+	 *  lzfse_encode_buffer_with_dict( ), using the same dictionary.
+	 *
+	 *  Other parameters and return value are the same as lzfse_decode_buffer( ).
+	 *  A working copy of the dictionary and output is allocated with malloc( ). */
+	LZFSE_API size_t lzfse_decode_buffer_with_dict(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, const uint8_t *__restrict dict_buffer, size_t dict_size, void *__restrict scratch_buffer);
+
+	/*! @abstract Build a preset dictionary from sample payloads.
+	 *
+	 *  Selects the segments of the samples made of byte sequences found in the
+	 *  largest number of samples, most useful segments last (closest to the
+	 *  data, hence cheapest to reference).
+	 *
+	 *  @param dict_buffer
+	 *  Pointer to the first byte of the dictionary buffer.
+	 *
+	 *  @param dict_capacity
+	 *  Maximum size of the dictionary in bytes; there is no point exceeding
+	 *  256 KB.
+	 *
+	 *  @param samples_buffer
+	 *  Concatenated samples.
+	 *
+	 *  @param sample_sizes
+	 *  Size in bytes of each sample in samples_buffer.
+	 *
+	 *  @param n_samples
+	 *  Number of samples.
+	 *
+	 *  @return
+	 *  The size of the dictionary written to dict_buffer, or zero if nothing
+	 *  worth keeping was found, or an error occurs.                            */
+	LZFSE_API size_t lzfse_train_dict(uint8_t *__restrict dict_buffer, size_t dict_capacity, const uint8_t *__restrict samples_buffer, const size_t *__restrict sample_sizes, size_t n_samples);
+
+	/*! @abstract Default decoded size of a seekable stream chunk (1 MB).      */
+	#define LZFSE_SEEKABLE_DEFAULT_CHUNK_SIZE ((size_t)1 << 20)
+
+	/*! @abstract Get an upper bound of the seekable encoding of src_size bytes
+	 *  split in chunks of chunk_size bytes.                                     */
+	LZFSE_API size_t lzfse_seekable_encode_bound(size_t src_size, size_t chunk_size);
+
+	/*! @abstract Compress a buffer into a seekable LZFSE stream.
+	 *
+	 *  The source is split in chunks of chunk_size decoded bytes, each chunk is
+	 *  compressed independently, and an index of chunk offsets is appended
+	 *  after the end-of-stream marker. The result is a valid LZFSE stream:
+	 *  lzfse_decode_buffer( ) decodes it entirely and ignores the index.
+	 *
+	 *  @param chunk_size
+	 *  Decoded size of each chunk, in ]0, 2GB[. Smaller chunks give finer
+	 *  random access at the cost of compression ratio. 0 selects
+	 *  LZFSE_SEEKABLE_DEFAULT_CHUNK_SIZE.
+	 *
+	 *  @param scratch_buffer
+	 *  Same as lzfse_encode_buffer( ); reused for every chunk.
+	 *
+	 *  @return
+	 *  The number of bytes written to the destination buffer, or zero if the
+	 *  output does not fit in dst_size bytes, or an error occurs. A buffer of
+	 *  lzfse_seekable_encode_bound( ) bytes is always large enough.            */
+	LZFSE_API size_t lzfse_seekable_encode_buffer(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, size_t chunk_size, void *__restrict scratch_buffer);
+
+	/*! @abstract Get the decoded size of a seekable LZFSE stream.
+	 *
+	 *  @return
+	 *  0 and sets *raw_size if src_buffer ends with a valid seekable index,
+	 *  -1 otherwise (plain LZFSE stream, or corrupted index).                  */
+	LZFSE_API int lzfse_seekable_raw_size(const uint8_t *src_buffer, size_t src_size, uint64_t *raw_size);
+
+	/*! @abstract Decompress a range of a seekable LZFSE stream.
+	 *
+	 *  Only the chunks covering [offset, offset + dst_size[ are decoded; the
+	 *  range is clamped to the decoded size of the stream.
+	 *
+	 *  @param scratch_buffer
+	 *  Same as lzfse_decode_buffer( ). If offset is not on a chunk boundary,
+	 *  one chunk-sized buffer is additionally allocated with malloc( ).
+	 *
+	 *  @return
+	 *  The number of bytes written to the destination buffer, which is less
+	 *  than dst_size only if the range reaches the end of the stream. Zero is
+	 *  returned if the stream has no seekable index, or an error occurs.      */
+	LZFSE_API size_t lzfse_seekable_decode_range(uint8_t *__restrict dst_buffer, size_t dst_size, const uint8_t *__restrict src_buffer, size_t src_size, uint64_t offset, void *__restrict scratch_buffer);
+
 	#ifdef __cplusplus
 		}
 	#endif
@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2015-2016, Apple Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:  
+
+1.  Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+    in the documentation and/or other materials provided with the distribution.
+
+3.  Neither the name of the copyright holder(s) nor the names of any contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// LZFSE stream checksum (XXH32)
+
+#include "lzfse_internal.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define LZFSE_CHECKSUM_NEON 1
+#elif defined(__SSE4_1__)
+#  include <smmintrin.h>
+#  define LZFSE_CHECKSUM_SSE41 1
+#  define LZFSE_TARGET_SSE41
+#elif (defined(__x86_64__) || defined(__i386__)) &&                           \
+    (defined(__clang__) || (__GNUC__ >= 5))
+//  Baseline x86 build: compile the SSE4.1 kernel for that target only, and
+//  pick it at run time when the CPU has it.
+#  include <smmintrin.h>
+#  define LZFSE_CHECKSUM_SSE41 1
+#  define LZFSE_CHECKSUM_DISPATCH 1
+#  define LZFSE_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME32_4 0x27D4EB2FU
+#define XXH_PRIME32_5 0x165667B1U
+
+static inline uint32_t rotl32(uint32_t x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+//  The stripe kernels consume \p n_stripes 16-byte stripes at \p p into the
+//  four lane accumulators \p v. This is the hot loop: each lane is
+//  independent, so the four of them are processed as one 128-bit vector when
+//  available.
+
+#if LZFSE_CHECKSUM_NEON
+static void lzfse_checksum_stripes_neon(uint32_t v[4], const uint8_t *p,
+                                        size_t n_stripes) {
+  uint32x4_t acc = vld1q_u32(v);
+  const uint32x4_t prime1 = vdupq_n_u32(XXH_PRIME32_1);
+  const uint32x4_t prime2 = vdupq_n_u32(XXH_PRIME32_2);
+  for (size_t i = 0; i < n_stripes; i++, p += 16) {
+    uint32x4_t x = vreinterpretq_u32_u8(vld1q_u8(p));
+    acc = vmlaq_u32(acc, x, prime2);
+    acc = vorrq_u32(vshlq_n_u32(acc, 13), vshrq_n_u32(acc, 19));
+    acc = vmulq_u32(acc, prime1);
+  }
+  vst1q_u32(v, acc);
+}
+#endif
+
+#if LZFSE_CHECKSUM_SSE41
+LZFSE_TARGET_SSE41
+static void lzfse_checksum_stripes_sse41(uint32_t v[4], const uint8_t *p,
+                                         size_t n_stripes) {
+  __m128i acc = _mm_loadu_si128((const __m128i *)v);
+  const __m128i prime1 = _mm_set1_epi32((int)XXH_PRIME32_1);
+  const __m128i prime2 = _mm_set1_epi32((int)XXH_PRIME32_2);
+  for (size_t i = 0; i < n_stripes; i++, p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    acc = _mm_add_epi32(acc, _mm_mullo_epi32(x, prime2));
+    acc = _mm_or_si128(_mm_slli_epi32(acc, 13), _mm_srli_epi32(acc, 19));
+    acc = _mm_mullo_epi32(acc, prime1);
+  }
+  _mm_storeu_si128((__m128i *)v, acc);
+}
+#endif
+
+#if !LZFSE_CHECKSUM_NEON && (!LZFSE_CHECKSUM_SSE41 || LZFSE_CHECKSUM_DISPATCH)
+static void lzfse_checksum_stripes_scalar(uint32_t v[4], const uint8_t *p,
+                                          size_t n_stripes) {
+  uint32_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+  for (size_t i = 0; i < n_stripes; i++, p += 16) {
+    v0 = rotl32(v0 + load4(p + 0) * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+    v1 = rotl32(v1 + load4(p + 4) * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+    v2 = rotl32(v2 + load4(p + 8) * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+    v3 = rotl32(v3 + load4(p + 12) * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+  }
+  v[0] = v0;
+  v[1] = v1;
+  v[2] = v2;
+  v[3] = v3;
+}
+#endif
+
+/*! @abstract Consume \p n_stripes 16-byte stripes with the best kernel for
+ *  this build and CPU. The CPU check is a load of data libgcc fills in at
+ *  startup, so it is made on each call rather than cached here. */
+static void lzfse_checksum_stripes(uint32_t v[4], const uint8_t *p,
+                                   size_t n_stripes) {
+#if LZFSE_CHECKSUM_NEON
+  lzfse_checksum_stripes_neon(v, p, n_stripes);
+#elif LZFSE_CHECKSUM_DISPATCH
+  if (__builtin_cpu_supports("sse4.1"))
+    lzfse_checksum_stripes_sse41(v, p, n_stripes);
+  else
+    lzfse_checksum_stripes_scalar(v, p, n_stripes);
+#elif LZFSE_CHECKSUM_SSE41
+  lzfse_checksum_stripes_sse41(v, p, n_stripes);
+#else
+  lzfse_checksum_stripes_scalar(v, p, n_stripes);
+#endif
+}
+
+void lzfse_checksum_init(lzfse_checksum_state *s) {
+  memset(s, 0x00, sizeof(*s));
+  s->v[0] = XXH_PRIME32_1 + XXH_PRIME32_2;
+  s->v[1] = XXH_PRIME32_2;
+  s->v[2] = 0;
+  s->v[3] = 0 - XXH_PRIME32_1;
+}
+
+void lzfse_checksum_update(lzfse_checksum_state *s, const uint8_t *p,
+                           size_t n) {
+  s->total_len += (uint32_t)n;
+  s->large_len |= (n >= 16) | (s->total_len >= 16);
+
+  // Complete the pending stripe first
+  if (s->mem_size + n < 16) {
+    memcpy((uint8_t *)s->mem + s->mem_size, p, n);
+    s->mem_size += (uint32_t)n;
+    return;
+  }
+  if (s->mem_size > 0) {
+    size_t k = 16 - s->mem_size;
+    memcpy((uint8_t *)s->mem + s->mem_size, p, k);
+    lzfse_checksum_stripes(s->v, (const uint8_t *)s->mem, 1);
+    p += k;
+    n -= k;
+    s->mem_size = 0;
+  }
+
+  lzfse_checksum_stripes(s->v, p, n / 16);
+  p += n & ~(size_t)15;
+  n &= 15;
+
+  memcpy(s->mem, p, n);
+  s->mem_size = (uint32_t)n;
+}
+
+uint32_t lzfse_checksum_final(const lzfse_checksum_state *s) {
+  uint32_t h;
+  if (s->large_len)
+    h = rotl32(s->v[0], 1) + rotl32(s->v[1], 7) + rotl32(s->v[2], 12) +
+        rotl32(s->v[3], 18);
+  else
+    h = XXH_PRIME32_5; // seed 0
+  h += s->total_len;
+
+  const uint8_t *p = (const uint8_t *)s->mem;
+  uint32_t n = s->mem_size;
+  for (; n >= 4; n -= 4, p += 4)
+    h = rotl32(h + load4(p) * XXH_PRIME32_3, 17) * XXH_PRIME32_4;
+  for (; n > 0; n--, p++)
+    h = rotl32(h + (*p) * XXH_PRIME32_5, 11) * XXH_PRIME32_1;
+
+  h ^= h >> 15;
+  h *= XXH_PRIME32_2;
+  h ^= h >> 13;
+  h *= XXH_PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+uint32_t lzfse_checksum(const uint8_t *p, size_t n) {
+  lzfse_checksum_state s;
+  lzfse_checksum_init(&s);
+  lzfse_checksum_update(&s, p, n);
+  return lzfse_checksum_final(&s);
+}
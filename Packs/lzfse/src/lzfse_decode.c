@@ -30,7 +30,7 @@ size_t lzfse_decode_buffer_with_scratch(uint8_t *__restrict dst_buffer,
                          size_t dst_size, const uint8_t *__restrict src_buffer,
                          size_t src_size, void *__restrict scratch_buffer) {
   lzfse_decoder_state *s = (lzfse_decoder_state *)scratch_buffer;
-  memset(s, 0x00, sizeof(*s));
+  lzfse_decode_reset(s);
 
   // Initialize state
   s->src = src_buffer;
@@ -70,3 +70,204 @@ size_t lzfse_decode_buffer(uint8_t *__restrict dst_buffer, size_t dst_size,
     free(scratch_buffer);
   return ret;
 } 
+
+size_t lzfse_decode_buffer_with_dict(uint8_t *__restrict dst_buffer,
+                                     size_t dst_size,
+                                     const uint8_t *__restrict src_buffer,
+                                     size_t src_size,
+                                     const uint8_t *__restrict dict_buffer,
+                                     size_t dict_size,
+                                     void *__restrict scratch_buffer) {
+  int has_malloc = 0;
+  size_t ret = 0;
+
+  // Same window as the encoder: the end of the dictionary, immediately
+  // followed by the output, so matches can reach into the dictionary
+  if (dict_size > LZFSE_ENCODE_MAX_D_VALUE) {
+    dict_buffer += dict_size - LZFSE_ENCODE_MAX_D_VALUE;
+    dict_size = LZFSE_ENCODE_MAX_D_VALUE;
+  }
+  uint8_t *window = malloc(dict_size + dst_size + 1);
+  if (window == NULL)
+    return 0;
+  memcpy(window, dict_buffer, dict_size);
+
+  // Deal with the possible NULL pointer
+  if (scratch_buffer == NULL) {
+    // +1 in case scratch size could be zero
+    scratch_buffer = malloc(lzfse_decode_scratch_size() + 1);
+    has_malloc = 1;
+  }
+  if (scratch_buffer == NULL)
+    goto done;
+
+  lzfse_decoder_state *s = (lzfse_decoder_state *)scratch_buffer;
+  lzfse_decode_reset(s);
+  s->src = src_buffer;
+  s->src_begin = src_buffer;
+  s->src_end = s->src + src_size;
+  s->dst = window + dict_size;
+  s->dst_begin = window;
+  s->dst_end = window + dict_size + dst_size;
+
+  // Decode, with the same return convention as lzfse_decode_buffer
+  int status = lzfse_decode(s);
+  if (status == LZFSE_STATUS_DST_FULL)
+    ret = dst_size;
+  else if (status == LZFSE_STATUS_OK)
+    ret = (size_t)(s->dst - (window + dict_size));
+  memcpy(dst_buffer, window + dict_size, ret);
+
+done:
+  if (has_malloc)
+    free(scratch_buffer);
+  free(window);
+  return ret;
+}
+
+lzfse_decoder_context *lzfse_decoder_context_create(void) {
+  return malloc(sizeof(lzfse_decoder_context));
+}
+
+void lzfse_decoder_context_reset(lzfse_decoder_context *ctx) {
+  lzfse_decode_reset(&ctx->state);
+}
+
+void lzfse_decoder_context_destroy(lzfse_decoder_context *ctx) { free(ctx); }
+
+size_t lzfse_decode_buffer_with_context(uint8_t *__restrict dst_buffer,
+                                        size_t dst_size,
+                                        const uint8_t *__restrict src_buffer,
+                                        size_t src_size,
+                                        lzfse_decoder_context *ctx) {
+  return lzfse_decode_buffer_with_scratch(dst_buffer, dst_size, src_buffer,
+                                          src_size, &ctx->state);
+}
+
+lzfse_decode_stream *lzfse_decode_stream_create(void) {
+  lzfse_decode_stream *s = malloc(sizeof(lzfse_decode_stream));
+  if (s == NULL)
+    return NULL;
+  s->in_capacity = LZFSE_DECODE_STREAM_MIN_INPUT_SIZE;
+  s->in_buffer = malloc(s->in_capacity);
+  s->out_buffer = malloc(LZFSE_DECODE_STREAM_WINDOW_SIZE);
+  if (s->in_buffer == NULL || s->out_buffer == NULL) {
+    lzfse_decode_stream_destroy(s);
+    return NULL;
+  }
+  lzfse_decode_stream_reset(s);
+  return s;
+}
+
+void lzfse_decode_stream_reset(lzfse_decode_stream *s) {
+  lzfse_decoder_state *ds = &s->state;
+  lzfse_decode_reset(ds);
+  ds->src = s->in_buffer;
+  ds->src_begin = s->in_buffer;
+  ds->src_end = s->in_buffer;
+  ds->dst = s->out_buffer;
+  ds->dst_begin = s->out_buffer;
+  ds->dst_end = s->out_buffer + LZFSE_DECODE_STREAM_WINDOW_SIZE;
+  s->in_size = 0;
+  s->out_next = s->out_buffer;
+  s->status = 0;
+}
+
+void lzfse_decode_stream_destroy(lzfse_decode_stream *s) {
+  if (s == NULL)
+    return;
+  free(s->in_buffer);
+  free(s->out_buffer);
+  free(s);
+}
+
+int lzfse_decode_stream_process(lzfse_decode_stream *s,
+                                const uint8_t **src_buffer, size_t *src_size,
+                                uint8_t **dst_buffer, size_t *dst_size) {
+  lzfse_decoder_state *ds = &s->state;
+  int status = LZFSE_STATUS_OK;
+
+  while (1) {
+    if (s->status < 0)
+      return -1;
+
+    // Return decoded bytes first
+    size_t n = (size_t)(ds->dst - s->out_next);
+    if (n > *dst_size)
+      n = *dst_size;
+    memcpy(*dst_buffer, s->out_next, n);
+    s->out_next += n;
+    *dst_buffer += n;
+    *dst_size -= n;
+    if (s->out_next < ds->dst)
+      return 0; // DST full
+    if (s->status > 0)
+      return 1; // done
+    if (status == LZFSE_STATUS_SRC_EMPTY && *src_size == 0)
+      return 0; // need more SRC data
+
+    // Move the input not consumed yet to the start of the buffer, and fill
+    // the rest with new input
+    size_t used = (size_t)(ds->src - s->in_buffer);
+    s->in_size -= used;
+    memmove(s->in_buffer, ds->src, s->in_size);
+    n = s->in_capacity - s->in_size;
+    if (n == 0 && status == LZFSE_STATUS_SRC_EMPTY) {
+      // The block doesn't fit, grow the buffer
+      uint8_t *in_buffer = NULL;
+      if (s->in_capacity < LZFSE_DECODE_STREAM_MAX_INPUT_SIZE)
+        in_buffer = realloc(s->in_buffer, 2 * s->in_capacity);
+      if (in_buffer == NULL) {
+        s->status = -1;
+        continue;
+      }
+      s->in_buffer = in_buffer;
+      s->in_capacity *= 2;
+      n = s->in_capacity - s->in_size;
+    }
+    if (n > *src_size)
+      n = *src_size;
+    memcpy(s->in_buffer + s->in_size, *src_buffer, n);
+    *src_buffer += n;
+    *src_size -= n;
+    s->in_size += n;
+    // SRC_BEGIN moves with the data, so a misplaced checksum block is not
+    // rejected as such here, but it won't match the data anyway
+    ds->src = s->in_buffer;
+    ds->src_begin = s->in_buffer;
+    ds->src_end = s->in_buffer + s->in_size;
+
+    // Once all the window is returned, slide it, keeping the history
+    // matches may reference
+    if (status == LZFSE_STATUS_DST_FULL) {
+      size_t keep = (size_t)(ds->dst - s->out_buffer);
+      if (keep > LZFSE_DECODE_STREAM_HISTORY_SIZE)
+        keep = LZFSE_DECODE_STREAM_HISTORY_SIZE;
+      if (ds->dst == s->out_buffer + keep) {
+        s->status = -1; // no progress possible
+        continue;
+      }
+      if (ds->has_checksum) {
+        lzfse_checksum_update(&ds->checksum_state, ds->checksum_dst,
+                              (size_t)(ds->dst - ds->checksum_dst));
+        ds->checksum_dst = s->out_buffer + keep;
+      }
+      memmove(s->out_buffer, ds->dst - keep, keep);
+      ds->dst = s->out_buffer + keep;
+      s->out_next = ds->dst;
+    }
+
+    status = lzfse_decode(ds);
+    if (status == LZFSE_STATUS_OK)
+      s->status = 1;
+    else if (status == LZFSE_STATUS_ERROR)
+      s->status = -1;
+  }
+}
+
+size_t lzfse_decode_stream_unused(const lzfse_decode_stream *s) {
+  if (s->status <= 0)
+    return 0;
+  // The decoder stopped after the end of stream block
+  return s->in_size - (size_t)(s->state.src - s->in_buffer);
+}
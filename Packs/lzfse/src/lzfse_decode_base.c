@@ -329,22 +329,56 @@ static int lzfse_decode_lmd(lzfse_decoder_state *s) {
   return LZFSE_STATUS_OK;
 }
 
+void lzfse_decode_reset(lzfse_decoder_state *s) {
+  // Block states are entirely set up when their header is read, only the
+  // stream state needs to be cleared
+  s->end_of_stream = 0;
+  s->block_magic = LZFSE_NO_BLOCK_MAGIC;
+  s->has_checksum = 0;
+}
+
 int lzfse_decode(lzfse_decoder_state *s) {
   while (1) {
     // Are we inside a block?
     switch (s->block_magic) {
     case LZFSE_NO_BLOCK_MAGIC: {
+      // Between blocks: checksum the output of the previous block while it
+      // is still in cache
+      if (s->has_checksum) {
+        lzfse_checksum_update(&s->checksum_state, s->checksum_dst,
+                              (size_t)(s->dst - s->checksum_dst));
+        s->checksum_dst = s->dst;
+      }
+
       // We need at least 4 bytes of magic number to identify next block
       if (s->src + 4 > s->src_end)
         return LZFSE_STATUS_SRC_EMPTY; // SRC truncated
       uint32_t magic = load4(s->src);
 
       if (magic == LZFSE_ENDOFSTREAM_BLOCK_MAGIC) {
+        if (s->has_checksum &&
+            lzfse_checksum_final(&s->checksum_state) != s->checksum)
+          return LZFSE_STATUS_ERROR; // corrupted data
         s->src += 4;
         s->end_of_stream = 1;
         return LZFSE_STATUS_OK; // done
       }
 
+      if (magic == LZFSE_CHECKSUM_BLOCK_MAGIC) {
+        // Only valid as the first block
+        if (s->has_checksum || s->src != s->src_begin)
+          return LZFSE_STATUS_ERROR;
+        if (s->src + sizeof(lzfse_checksum_block_header) > s->src_end)
+          return LZFSE_STATUS_SRC_EMPTY; // SRC truncated
+        s->checksum =
+            load4(s->src + offsetof(lzfse_checksum_block_header, checksum));
+        s->has_checksum = 1;
+        s->checksum_dst = s->dst;
+        lzfse_checksum_init(&s->checksum_state);
+        s->src += sizeof(lzfse_checksum_block_header);
+        break;
+      }
+
       if (magic == LZFSE_UNCOMPRESSED_BLOCK_MAGIC) {
         if (s->src + sizeof(uncompressed_block_header) > s->src_end)
           return LZFSE_STATUS_SRC_EMPTY; // SRC truncated
@@ -615,8 +649,12 @@ int lzfse_decode(lzfse_decoder_state *s) {
           dstate.end_of_stream)
         return LZFSE_STATUS_ERROR;
 
-      // Here, block is not done and state is valid, so we need more space in dst.
-      return LZFSE_STATUS_DST_FULL;
+      // Here, block is not done and state is valid, so we need more space in
+      // dst, or the rest of the payload if src doesn't hold all of it.
+      if (s->dst == dstate.dst_end ||
+          bs->n_payload_bytes <= (size_t)(s->src_end - s->src))
+        return LZFSE_STATUS_DST_FULL;
+      return LZFSE_STATUS_SRC_EMPTY;
     }
 
     default:
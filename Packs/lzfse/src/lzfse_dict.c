@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2015-2016, Apple Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:  
+
+1.  Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+    in the documentation and/or other materials provided with the distribution.
+
+3.  Neither the name of the copyright holder(s) nor the names of any contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// LZFSE preset dictionary training
+
+#include "lzfse.h"
+#include "lzfse_internal.h"
+
+//  The trainer scores fixed-size segments of the samples by the number of
+//  samples containing each of their DMER_SIZE-byte sequences, and keeps the
+//  best segment of each of dict_capacity/SEGMENT_SIZE regions ("epochs") of
+//  the samples. Sequences of a selected segment no longer score, so later
+//  picks bring new content.
+#define LZFSE_DICT_DMER_SIZE 8
+#define LZFSE_DICT_SEGMENT_SIZE 64
+#define LZFSE_DICT_HASH_BITS 20
+#define LZFSE_DICT_HASH_VALUES (1 << LZFSE_DICT_HASH_BITS)
+
+/*! @abstract Selected segment. */
+typedef struct {
+  size_t pos;
+  uint64_t score;
+} lzfse_dict_segment;
+
+/*! @abstract Get hash in range [0, LZFSE_DICT_HASH_VALUES-1] from 8 bytes at P. */
+static inline uint32_t lzfse_dict_hash(const uint8_t *p) {
+  return (uint32_t)((load8(p) * 0x9E3779B185EBCA87ULL) >>
+                    (64 - LZFSE_DICT_HASH_BITS));
+}
+
+static int lzfse_dict_segment_cmp(const void *a, const void *b) {
+  const lzfse_dict_segment *x = a, *y = b;
+  if (x->score != y->score)
+    return (x->score < y->score) ? -1 : 1;
+  return (x->pos < y->pos) ? -1 : (x->pos > y->pos);
+}
+
+size_t lzfse_train_dict(uint8_t *__restrict dict_buffer, size_t dict_capacity,
+                        const uint8_t *__restrict samples_buffer,
+                        const size_t *__restrict sample_sizes,
+                        size_t n_samples) {
+  const size_t seg = LZFSE_DICT_SEGMENT_SIZE;
+  const size_t dmers_per_seg = seg - LZFSE_DICT_DMER_SIZE + 1;
+  size_t total = 0;
+  for (size_t i = 0; i < n_samples; i++)
+    total += sample_sizes[i];
+  if (n_samples < 2 || total < seg || dict_capacity < seg)
+    return 0; // nothing shared to learn
+
+  size_t n_dmers = total - LZFSE_DICT_DMER_SIZE + 1;
+  size_t n_epochs = dict_capacity / seg;
+  size_t epoch_size = total / n_epochs;
+  if (epoch_size < seg) {
+    epoch_size = seg;
+    n_epochs = total / seg;
+  }
+
+  // Hash of the sequence at each position; sequences crossing the end of a
+  // sample get the extra hash value LZFSE_DICT_HASH_VALUES, which never scores.
+  uint32_t *hashes = malloc(n_dmers * sizeof(uint32_t));
+  uint32_t *freq = calloc(LZFSE_DICT_HASH_VALUES + 1, sizeof(uint32_t));
+  uint32_t *last = malloc((LZFSE_DICT_HASH_VALUES + 1) * sizeof(uint32_t));
+  uint16_t *active = calloc(LZFSE_DICT_HASH_VALUES + 1, sizeof(uint16_t));
+  lzfse_dict_segment *picks = malloc(n_epochs * sizeof(lzfse_dict_segment));
+  size_t n_picks = 0, ret = 0;
+  if (!hashes || !freq || !last || !active || !picks)
+    goto done;
+  memset(last, 0xff, (LZFSE_DICT_HASH_VALUES + 1) * sizeof(uint32_t));
+
+  // Count, for each sequence, the number of samples containing it
+  size_t start = 0;
+  for (size_t i = 0; i < n_samples; i++) {
+    size_t end = start + sample_sizes[i];
+    for (size_t p = start; p < end && p < n_dmers; p++) {
+      if (p + LZFSE_DICT_DMER_SIZE > end) {
+        hashes[p] = LZFSE_DICT_HASH_VALUES;
+        continue;
+      }
+      uint32_t h = lzfse_dict_hash(samples_buffer + p);
+      hashes[p] = h;
+      if (last[h] != (uint32_t)i) {
+        last[h] = (uint32_t)i;
+        freq[h]++;
+      }
+    }
+    start = end;
+  }
+  // A sequence found in a single sample is not worth a dictionary entry
+  for (size_t h = 0; h < LZFSE_DICT_HASH_VALUES; h++)
+    freq[h] = (freq[h] > 1) ? freq[h] - 1 : 0;
+
+  for (size_t epoch = 0; epoch < n_epochs; epoch++) {
+    size_t b = epoch * epoch_size;
+    size_t e = (epoch + 1 == n_epochs) ? total : b + epoch_size;
+    size_t e_dmers = e - LZFSE_DICT_DMER_SIZE + 1; // dmers fully in epoch
+
+    // Slide a segment-sized window over the epoch, counting each distinct
+    // sequence once per window
+    uint64_t score = 0, best_score = 0;
+    size_t best_pos = 0, lo = b;
+    for (size_t hi = b; hi < e_dmers; hi++) {
+      uint32_t h = hashes[hi];
+      if (active[h]++ == 0)
+        score += freq[h];
+      if (hi - lo + 1 > dmers_per_seg) {
+        h = hashes[lo++];
+        if (--active[h] == 0)
+          score -= freq[h];
+      }
+      if (hi - lo + 1 == dmers_per_seg && score > best_score) {
+        best_score = score;
+        best_pos = lo;
+      }
+    }
+    for (; lo < e_dmers; lo++)
+      active[hashes[lo]]--;
+
+    if (best_score == 0)
+      continue;
+    picks[n_picks].pos = best_pos;
+    picks[n_picks].score = best_score;
+    n_picks++;
+    for (size_t p = best_pos; p < best_pos + dmers_per_seg; p++)
+      freq[hashes[p]] = 0;
+  }
+
+  // Most valuable segments at the end of the dictionary, where matches have
+  // the shortest distances
+  qsort(picks, n_picks, sizeof(lzfse_dict_segment), lzfse_dict_segment_cmp);
+  for (size_t i = 0; i < n_picks; i++) {
+    memcpy(dict_buffer + ret, samples_buffer + picks[i].pos, seg);
+    ret += seg;
+  }
+
+done:
+  free(hashes);
+  free(freq);
+  free(last);
+  free(active);
+  free(picks);
+  return ret;
+}
@@ -33,7 +33,32 @@ size_t lzfse_encode_scratch_size() {
 size_t lzfse_encode_buffer_with_scratch(uint8_t *__restrict dst_buffer, 
                        size_t dst_size, const uint8_t *__restrict src_buffer,
                        size_t src_size, void *__restrict scratch_buffer) {
+  return lzfse_encode_buffer_with_prefix(dst_buffer, dst_size, src_buffer,
+                                         src_size, 0, scratch_buffer);
+}
+
+size_t lzfse_encode_buffer_with_prefix(uint8_t *__restrict dst_buffer,
+                                       size_t dst_size,
+                                       const uint8_t *__restrict src_buffer,
+                                       size_t src_size, size_t prefix_size,
+                                       void *__restrict scratch_buffer) {
+  return lzfse_encode_buffer_with_base(dst_buffer, dst_size, src_buffer,
+                                       src_size, prefix_size, scratch_buffer,
+                                       NULL);
+}
+
+size_t lzfse_encode_buffer_with_base(uint8_t *__restrict dst_buffer,
+                                     size_t dst_size,
+                                     const uint8_t *__restrict src_buffer,
+                                     size_t src_size, size_t prefix_size,
+                                     void *__restrict scratch_buffer,
+                                     lzfse_offset *base) {
   const size_t original_size = src_size;
+  lzfse_offset src_base = 0;
+
+  // Only the last LZFSE_ENCODE_MAX_D_VALUE bytes of history are reachable
+  if (prefix_size > LZFSE_ENCODE_MAX_D_VALUE)
+    prefix_size = LZFSE_ENCODE_MAX_D_VALUE;
 
   // If input is really really small, go directly to uncompressed buffer
   // (because LZVN will refuse to encode it, and we will report a failure)
@@ -47,9 +72,17 @@ size_t lzfse_encode_buffer_with_scratch(uint8_t *__restrict dst_buffer,
     if (dst_size <= extra_size)
       goto try_uncompressed; // DST is really too small, give up
 
-    size_t sz = lzvn_encode_buffer(
-        dst_buffer + sizeof(lzvn_compressed_block_header),
-        dst_size - extra_size, src_buffer, src_size, scratch_buffer);
+    // Output as large as the input is useless, we would store it instead:
+    // let LZVN stop as soon as it gets there.
+    size_t lzvn_dst_size = dst_size - extra_size;
+    // The LZVN work area overlaps the LZFSE history table
+    if (base != NULL)
+      *base = -1;
+    if (lzvn_dst_size > src_size)
+      lzvn_dst_size = src_size;
+    size_t sz = lzvn_encode_buffer_with_prefix(
+        dst_buffer + sizeof(lzvn_compressed_block_header), lzvn_dst_size,
+        src_buffer, src_size, prefix_size, scratch_buffer);
     if (sz == 0 || sz >= src_size)
       goto try_uncompressed; // failed, or no compression, fall back to
                              // uncompressed block
@@ -70,14 +103,32 @@ size_t lzfse_encode_buffer_with_scratch(uint8_t *__restrict dst_buffer,
   // Try encoding with LZFSE
   {
     lzfse_encoder_state *state = scratch_buffer;
-    memset(state, 0x00, sizeof *state);
-    if (lzfse_encode_init(state) != LZFSE_STATUS_OK)
+    //  The history table is reused as is if all its positions are out of
+    //  reach from BASE: this buffer then starts at BASE instead of 0.
+    if (base != NULL && *base >= 0 && src_size < 0xffffffffU &&
+        *base + (lzfse_offset)(prefix_size + src_size) <
+            INT32_MAX - LZFSE_ENCODE_MAX_D_VALUE) {
+      src_base = *base;
+      lzfse_encode_reset(state);
+    } else if (lzfse_encode_init(state) != LZFSE_STATUS_OK) {
       goto try_uncompressed;
+    }
+    //  Positions stored from now on are below the end of this buffer
+    if (base != NULL)
+      *base = (src_size < 0xffffffffU)
+                  ? src_base + (lzfse_offset)(prefix_size + src_size) +
+                        LZFSE_ENCODE_MAX_D_VALUE + 1
+                  : -1;
     state->dst = dst_buffer;
     state->dst_begin = dst_buffer;
     state->dst_end = &dst_buffer[dst_size];
-    state->src = src_buffer;
-    state->src_encode_i = 0;
+    //  History bytes are only inserted in the history table: encoding starts
+    //  with src_literal past them.
+    state->src = src_buffer - prefix_size - src_base;
+    state->src_begin = src_base;
+    state->history_key = (uint32_t)src_base * 0x9e3779b1U; // 0 without base
+    state->src_encode_i = src_base;
+    state->src_literal = src_base + (lzfse_offset)prefix_size;
 
     if (src_size >= 0xffffffffU) {
       //  lzfse only uses 32 bits for offsets internally, so if the input
@@ -87,9 +138,10 @@ size_t lzfse_encode_buffer_with_scratch(uint8_t *__restrict dst_buffer,
       //  it's necessary for correctness.
       //  The first chunk, we just process normally.
       const lzfse_offset encoder_block_size = 262144;
-      state->src_end = encoder_block_size;
+      state->src_end = (lzfse_offset)prefix_size + encoder_block_size;
       if (lzfse_encode_base(state) != LZFSE_STATUS_OK)
         goto try_uncompressed;
+      lzfse_encode_translate(state, (lzfse_offset)prefix_size);
       src_size -= encoder_block_size;
       while (src_size >= encoder_block_size) {
         //  All subsequent chunks require a translation to keep the offsets
@@ -109,7 +161,7 @@ size_t lzfse_encode_buffer_with_scratch(uint8_t *__restrict dst_buffer,
     //  If the source buffer is small enough to use 32-bit offsets, we simply
     //  encode the whole thing in a single chunk.
     else
-      state->src_end = (lzfse_offset)src_size;
+      state->src_end = src_base + (lzfse_offset)(prefix_size + src_size);
     //  This is either the trailing chunk (if the source file is huge), or
     //  the whole source file.
     if (lzfse_encode_base(state) != LZFSE_STATUS_OK)
@@ -161,3 +213,92 @@ size_t lzfse_encode_buffer(uint8_t *__restrict dst_buffer, size_t dst_size,
     free(scratch_buffer);
   return ret;
 } 
+
+size_t lzfse_encode_buffer_with_dict(uint8_t *__restrict dst_buffer,
+                                     size_t dst_size,
+                                     const uint8_t *__restrict src_buffer,
+                                     size_t src_size,
+                                     const uint8_t *__restrict dict_buffer,
+                                     size_t dict_size,
+                                     void *__restrict scratch_buffer) {
+  int has_malloc = 0;
+  size_t ret = 0;
+
+  // Matches can't reach further back than LZFSE_ENCODE_MAX_D_VALUE, keep the
+  // end of the dictionary only
+  if (dict_size > LZFSE_ENCODE_MAX_D_VALUE) {
+    dict_buffer += dict_size - LZFSE_ENCODE_MAX_D_VALUE;
+    dict_size = LZFSE_ENCODE_MAX_D_VALUE;
+  }
+
+  // The encoders need the dictionary and the source in a single buffer
+  uint8_t *window = malloc(dict_size + src_size + 1);
+  if (window == NULL)
+    return 0;
+  memcpy(window, dict_buffer, dict_size);
+  memcpy(window + dict_size, src_buffer, src_size);
+
+  // Deal with the possible NULL pointer
+  if (scratch_buffer == NULL) {
+    // +1 in case scratch size could be zero
+    scratch_buffer = malloc(lzfse_encode_scratch_size() + 1);
+    has_malloc = 1;
+  }
+  if (scratch_buffer != NULL)
+    ret = lzfse_encode_buffer_with_prefix(dst_buffer, dst_size,
+                                          window + dict_size, src_size,
+                                          dict_size, scratch_buffer);
+  if (has_malloc)
+    free(scratch_buffer);
+  free(window);
+  return ret;
+}
+
+size_t lzfse_encode_buffer_with_checksum(uint8_t *__restrict dst_buffer,
+                                         size_t dst_size,
+                                         const uint8_t *__restrict src_buffer,
+                                         size_t src_size,
+                                         void *__restrict scratch_buffer) {
+  // The checksum block comes first, so the decoder knows it must checksum
+  // the data as it decodes it
+  lzfse_checksum_block_header header = {
+      .magic = LZFSE_CHECKSUM_BLOCK_MAGIC,
+      .checksum = lzfse_checksum(src_buffer, src_size)};
+  if (dst_size <= sizeof header)
+    return 0;
+  size_t sz = lzfse_encode_buffer(dst_buffer + sizeof header,
+                                  dst_size - sizeof header, src_buffer,
+                                  src_size, scratch_buffer);
+  if (sz == 0)
+    return 0;
+  memcpy(dst_buffer, &header, sizeof header);
+  return sz + sizeof header;
+}
+
+lzfse_encoder_context *lzfse_encoder_context_create(void) {
+  // The context ends with the scratch area, sized for either encoder
+  lzfse_encoder_context *ctx =
+      malloc(offsetof(lzfse_encoder_context, state) +
+             lzfse_encode_scratch_size());
+  if (ctx == NULL)
+    return NULL;
+  ctx->base = -1;
+  return ctx;
+}
+
+void lzfse_encoder_context_reset(lzfse_encoder_context *ctx) {
+  // The history table is kept: the next buffer is placed past the reach of
+  // the positions it holds
+  lzfse_encode_reset(&ctx->state);
+}
+
+void lzfse_encoder_context_destroy(lzfse_encoder_context *ctx) { free(ctx); }
+
+size_t lzfse_encode_buffer_with_context(uint8_t *__restrict dst_buffer,
+                                        size_t dst_size,
+                                        const uint8_t *__restrict src_buffer,
+                                        size_t src_size,
+                                        lzfse_encoder_context *ctx) {
+  return lzfse_encode_buffer_with_base(dst_buffer, dst_size, src_buffer,
+                                       src_size, 0, &ctx->state, &ctx->base);
+}
@@ -582,13 +582,10 @@ static int lzfse_backend_end_of_stream(lzfse_encoder_state *s) {
 /*! @abstract Initialize state:
  * @code
  * - hash table with all invalid pos, and value 0.
- * - pending match to NO_MATCH.
- * - src_literal to 0.
- * - d_prev to 0.
+ * - everything lzfse_encode_reset initializes.
  @endcode
  * @return LZFSE_STATUS_OK */
 int lzfse_encode_init(lzfse_encoder_state *s) {
-  const lzfse_match NO_MATCH = {0};
   lzfse_history_set line;
   for (int i = 0; i < LZFSE_ENCODE_HASH_WIDTH; i++) {
     line.pos[i] = -4 * LZFSE_ENCODE_MAX_D_VALUE; // invalid pos
@@ -597,8 +594,27 @@ int lzfse_encode_init(lzfse_encoder_state *s) {
   // Fill table
   for (int i = 0; i < LZFSE_ENCODE_HASH_VALUES; i++)
     s->history_table[i] = line;
+
+  return lzfse_encode_reset(s);
+}
+
+/*! @abstract Reset state for a new source buffer, keeping the hash table:
+ * @code
+ * - pending match to NO_MATCH.
+ * - src_begin, history_key, src_literal to 0.
+ * - no matches and literals.
+ @endcode
+ * The caller must start the new buffer far enough past the positions in the
+ * hash table for them to be out of reach, see lzfse_encode_buffer_with_base.
+ * @return LZFSE_STATUS_OK */
+int lzfse_encode_reset(lzfse_encoder_state *s) {
+  const lzfse_match NO_MATCH = {0};
   s->pending = NO_MATCH;
+  s->src_begin = 0;
+  s->history_key = 0;
   s->src_literal = 0;
+  s->n_matches = 0;
+  s->n_literals = 0;
 
   return LZFSE_STATUS_OK; // OK
 }
@@ -619,6 +635,7 @@ int lzfse_encode_translate(lzfse_encoder_state *s, lzfse_offset delta) {
   s->src_encode_i -= delta;
   s->src_encode_end -= delta;
   s->src_literal -= delta;
+  s->src_begin = (s->src_begin > delta) ? s->src_begin - delta : 0;
 
   // Pending match
   s->pending.pos -= delta;
@@ -654,10 +671,12 @@ int lzfse_encode_base(lzfse_encoder_state *s) {
   for (; s->src_encode_i < s->src_encode_end; s->src_encode_i++) {
     lzfse_offset pos = s->src_encode_i; // pos >= 0
 
-    // Load 4 byte value and get hash line
+    // Load 4 byte value and get hash line. Values are stored keyed, so most
+    // entries left by previous buffers fail the comparisons below.
     uint32_t x = load4(s->src + pos);
     hashLine = history_table + hashX(x);
     lzfse_history_set h = *hashLine;
+    x ^= s->history_key;
 
     // Prepare next hash line (component 0 is the most recent) to prepare new
     // entries (stored later)
@@ -746,7 +765,7 @@ int lzfse_encode_base(lzfse_encoder_state *s) {
 
     // Expand backwards (since this is expensive, we do this for the best match
     // only)
-    while (incoming.pos > s->src_literal && incoming.ref > 0 &&
+    while (incoming.pos > s->src_literal && incoming.ref > s->src_begin &&
            s->src[incoming.ref - 1] == s->src[incoming.pos - 1]) {
       incoming.pos--;
       incoming.ref--;
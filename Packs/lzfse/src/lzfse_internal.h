@@ -180,6 +180,12 @@ typedef struct {
   uint8_t *dst_begin;
   //  Pointer to one byte past the end of the destination buffer.
   uint8_t *dst_end;
+  //  Offset of the first byte of the source buffer. Positions below it in
+  //  history_table belong to previously encoded buffers, and are out of reach.
+  lzfse_offset src_begin;
+  //  Key XORed with the values stored in history_table. Changing it with
+  //  src_begin makes the entries of previous buffers very unlikely to match.
+  uint32_t history_key;
   //  Pending match; will be emitted unless a better match is found.
   lzfse_match pending;
   //  The number of matches written so far. Note that there is no problem in
@@ -203,6 +209,17 @@ typedef struct {
   lzfse_history_set history_table[LZFSE_ENCODE_HASH_VALUES];
 } lzfse_encoder_state;
 
+/*! @abstract Encoder context, see lzfse_encoder_context_create. */
+struct lzfse_encoder_context {
+  //  Offset at which the next source buffer starts, out of reach of all the
+  //  positions in state.history_table, or -1 if the table must be
+  //  initialized first.
+  lzfse_offset base;
+  //  Encoder state, or LZVN work area. Must be last: it is allocated with
+  //  lzfse_encode_scratch_size() bytes.
+  lzfse_encoder_state state;
+};
+
 /*! @abstract Decoder state object for lzfse compressed blocks. */
 typedef struct {
   //  Number of matches remaining in the block.
@@ -245,6 +262,16 @@ typedef struct {
   uint32_t d_prev;
 } lzvn_compressed_block_decoder_state;
 
+/*! @abstract Running XXH32 checksum. Data is consumed by 16-byte stripes,
+ *  one 32-bit lane per accumulator; a partial stripe waits in \p mem. */
+typedef struct {
+  uint32_t v[4];
+  uint32_t mem[4];
+  uint32_t mem_size;
+  uint32_t total_len;
+  int large_len;
+} lzfse_checksum_state;
+
 /*! @abstract Decoder state object. */
 typedef struct {
   //  Pointer to next byte to read from source buffer (this is advanced as we
@@ -269,8 +296,50 @@ typedef struct {
   lzfse_compressed_block_decoder_state compressed_lzfse_block_state;
   lzvn_compressed_block_decoder_state compressed_lzvn_block_state;
   uncompressed_block_decoder_state uncompressed_block_state;
+  //  1 if the stream started with a checksum block, 0 otherwise. Decoded
+  //  data is then added to checksum_state after each block, while it is
+  //  still in cache, and verified at the end of the stream.
+  int has_checksum;
+  //  Expected checksum, from the checksum block.
+  uint32_t checksum;
+  //  Next byte of the destination buffer to add to checksum_state.
+  uint8_t *checksum_dst;
+  lzfse_checksum_state checksum_state;
 } lzfse_decoder_state;
 
+/*! @abstract Decoder context, see lzfse_decoder_context_create. */
+struct lzfse_decoder_context {
+  lzfse_decoder_state state;
+};
+
+//  Decoded bytes kept by the streaming decoder for matches to reference.
+#define LZFSE_DECODE_STREAM_HISTORY_SIZE ((size_t)LZFSE_ENCODE_MAX_D_VALUE)
+
+//  Size of the streaming decoder output window, history included.
+#define LZFSE_DECODE_STREAM_WINDOW_SIZE ((size_t)1 << 20)
+
+//  Initial and maximum size of the streaming decoder input buffer. The
+//  decoder needs whole LZFSE compressed blocks, whose payload is a few
+//  hundred KB at most: a larger one is corrupt.
+#define LZFSE_DECODE_STREAM_MIN_INPUT_SIZE ((size_t)1 << 16)
+#define LZFSE_DECODE_STREAM_MAX_INPUT_SIZE ((size_t)1 << 22)
+
+/*! @abstract Streaming decoder, see lzfse_decode_stream_create. */
+struct lzfse_decode_stream {
+  //  Decoder state; its SRC is in_buffer, its DST is out_buffer.
+  lzfse_decoder_state state;
+  //  Input not consumed by the decoder yet, at the start of in_buffer.
+  uint8_t *in_buffer;
+  size_t in_size;
+  size_t in_capacity;
+  //  Decoded output, LZFSE_DECODE_STREAM_WINDOW_SIZE bytes. The bytes in
+  //  [out_next, state.dst[ are not returned to the caller yet.
+  uint8_t *out_buffer;
+  uint8_t *out_next;
+  //  1 once the end-of-stream block is decoded, -1 after an error, 0 otherwise.
+  int status;
+};
+
 // MARK: - Block header objects
 
 #define LZFSE_NO_BLOCK_MAGIC             0x00000000 // 0    (invalid)
@@ -279,6 +348,7 @@ typedef struct {
 #define LZFSE_COMPRESSEDV1_BLOCK_MAGIC   0x31787662 // bvx1 (lzfse compressed, uncompressed tables)
 #define LZFSE_COMPRESSEDV2_BLOCK_MAGIC   0x32787662 // bvx2 (lzfse compressed, compressed tables)
 #define LZFSE_COMPRESSEDLZVN_BLOCK_MAGIC 0x6e787662 // bvxn (lzvn compressed)
+#define LZFSE_CHECKSUM_BLOCK_MAGIC       0x63787662 // bvxc (checksum of decoded stream)
 
 /*! @abstract Uncompressed block header in encoder stream. */
 typedef struct {
@@ -373,6 +443,15 @@ typedef struct {
 } __attribute__((__packed__, __aligned__(1)))
 lzfse_compressed_block_header_v2;
 
+/*! @abstract Checksum block, optional. When present, this is the first block
+ *  of the stream. */
+typedef struct {
+  //  Magic number, always LZFSE_CHECKSUM_BLOCK_MAGIC.
+  uint32_t magic;
+  //  XXH32 (seed 0) of the entire decoded stream.
+  uint32_t checksum;
+} lzfse_checksum_block_header;
+
 /*! @abstract LZVN compressed block header. */
 typedef struct {
   //  Magic number, always LZFSE_COMPRESSEDLZVN_BLOCK_MAGIC.
@@ -383,14 +462,76 @@ typedef struct {
   uint32_t n_payload_bytes;
 } lzvn_compressed_block_header;
 
+// MARK: - Seekable stream index
+
+//  A seekable stream is a regular LZFSE stream made of independently encoded
+//  chunks (no match crosses a chunk boundary), terminated by the usual
+//  end-of-stream block, and followed by an index. The decoder stops at the
+//  end-of-stream block, so the index is invisible to lzfse_decode_buffer.
+//
+//  The index is an array of n_chunks + 1 lzfse_seekable_index_entry objects
+//  (the last one marks the offsets of the end-of-stream block), followed by
+//  an lzfse_seekable_footer, which is always the last object in the buffer.
+#define LZFSE_SEEKABLE_INDEX_MAGIC 0x73787662 // bvxs (seekable index)
+
+/*! @abstract Seekable index entry: where a chunk starts, in both streams. */
+typedef struct {
+  //  Offset of the first block of the chunk in the compressed stream.
+  uint64_t c_offset;
+  //  Offset of the first byte of the chunk in the decoded stream.
+  uint64_t r_offset;
+} lzfse_seekable_index_entry;
+
+/*! @abstract Seekable index footer, stored at the very end of the buffer. */
+typedef struct {
+  //  Number of decoded bytes in the whole stream.
+  uint64_t n_raw_bytes;
+  //  Number of chunks; the index holds n_chunks + 1 entries.
+  uint32_t n_chunks;
+  //  Decoded size of each chunk (the last one may be shorter).
+  uint32_t chunk_raw_size;
+  //  Total size of the index in bytes, entries and footer included.
+  uint32_t index_size;
+  //  Magic number, always LZFSE_SEEKABLE_INDEX_MAGIC.
+  uint32_t magic;
+} lzfse_seekable_footer;
+
 // MARK: - LZFSE encode/decode interfaces
 
 int lzfse_encode_init(lzfse_encoder_state *s);
+int lzfse_encode_reset(lzfse_encoder_state *s);
 int lzfse_encode_translate(lzfse_encoder_state *s, lzfse_offset delta);
 int lzfse_encode_base(lzfse_encoder_state *s);
 int lzfse_encode_finish(lzfse_encoder_state *s);
+void lzfse_decode_reset(lzfse_decoder_state *s);
 int lzfse_decode(lzfse_decoder_state *s);
 
+//  Buffer encoder with PREFIX_SIZE bytes of history preceding SRC that
+//  matches may reference. Used by the preset dictionary API.
+size_t lzfse_encode_buffer_with_prefix(uint8_t *__restrict dst_buffer,
+                                       size_t dst_size,
+                                       const uint8_t *__restrict src_buffer,
+                                       size_t src_size, size_t prefix_size,
+                                       void *__restrict scratch_buffer);
+
+//  Same as lzfse_encode_buffer_with_prefix. If BASE is not NULL, *BASE is
+//  the offset where encoding starts in the history table positions (-1
+//  meaning the table must be initialized), and is updated for the next call.
+size_t lzfse_encode_buffer_with_base(uint8_t *__restrict dst_buffer,
+                                     size_t dst_size,
+                                     const uint8_t *__restrict src_buffer,
+                                     size_t src_size, size_t prefix_size,
+                                     void *__restrict scratch_buffer,
+                                     lzfse_offset *base);
+
+// MARK: - Checksum interfaces
+
+void lzfse_checksum_init(lzfse_checksum_state *s);
+void lzfse_checksum_update(lzfse_checksum_state *s, const uint8_t *p,
+                           size_t n);
+uint32_t lzfse_checksum_final(const lzfse_checksum_state *s);
+uint32_t lzfse_checksum(const uint8_t *p, size_t n);
+
 // MARK: - LZVN encode/decode interfaces
 
 //  Minimum source buffer size for compression. Smaller buffers will not be
@@ -413,6 +554,13 @@ size_t lzvn_encode_buffer(void *__restrict dst, size_t dst_size,
 size_t lzvn_decode_buffer(void *__restrict dst, size_t dst_size,
                           const void *__restrict src, size_t src_size);
 
+//  Same as lzvn_encode_buffer, with PREFIX_SIZE bytes of history preceding
+//  SRC that matches may reference (at most LZVN_ENCODE_MAX_DISTANCE are used).
+size_t lzvn_encode_buffer_with_prefix(void *__restrict dst, size_t dst_size,
+                                      const void *__restrict src,
+                                      size_t src_size, size_t prefix_size,
+                                      void *__restrict work);
+
 /*! @abstract Signed offset in buffers, stored on either 32 or 64 bits. */
 #if defined(_M_AMD64) || defined(__x86_64__) || defined(__arm64__)
 typedef int64_t lzvn_offset;
@@ -40,6 +40,7 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSI
 
 #include "lzfse.h"
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -83,14 +84,58 @@ static double get_time() {
 #endif
 }
 
+// Load file PATH entirely in a new buffer, exit on failure
+static uint8_t *load_file(const char *path, size_t *size) {
+	struct stat st;
+#if defined(_WIN32)
+	int fd = open(path, O_RDONLY | O_BINARY);
+#else
+	int fd = open(path, O_RDONLY);
+#endif
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror(path);
+		exit(1);
+	}
+	if ((uintmax_t)st.st_size > SIZE_MAX) {
+		fprintf(stderr, "File is too large\n");
+		exit(1);
+	}
+	*size = (size_t)st.st_size;
+	uint8_t *buf = (uint8_t *)malloc(*size + 1);
+	if (buf == 0) {
+		perror("malloc");
+		exit(1);
+	}
+	for (size_t pos = 0; pos < *size;) {
+		ptrdiff_t r = read(fd, buf + pos, *size - pos);
+		if (r < 0) {
+			perror("read");
+			exit(1);
+		}
+		if (r == 0) {
+			*size = pos; // file shrunk
+			break;
+		}
+		pos += (size_t)r;
+	}
+	close(fd);
+	return buf;
+}
+
 //--------------------
 
-enum { LZFSE_ENCODE = 0, LZFSE_DECODE };
+enum { LZFSE_ENCODE = 0, LZFSE_DECODE, LZFSE_TRAIN };
 
 void usage(int argc, char **argv) {
 	fprintf(
 			stderr,
-			"Usage: %s -encode|-decode [-i input_file] [-o output_file] [-h] [-v]\n",
+			"Usage: %s -encode|-decode [-i input_file] [-o output_file] [-h] [-v]\n"
+			"       [-seekable] [-chunk size]    (encode: independent chunks + index)\n"
+			"       [-offset n] [-length n]      (decode: range of a seekable stream)\n"
+			"       [-dict dict_file]            (encode/decode with a preset dictionary)\n"
+			"       [-check]                     (encode: add a checksum, decode: fail on error)\n"
+			"       %s -train [-dict_size n] [-o dict_file] sample_file...\n",
+			argv[0],
 			argv[0]);
 }
 
@@ -111,6 +156,15 @@ int main(int argc, char **argv) {
 	const char *out_file = 0; // stdout
 	int op = -1;							// invalid op
 	int verbosity = 0;				// quiet
+	int seekable = 0;					// plain stream
+	int check = 0;						// no checksum
+	const char *chunk_arg = 0;	// default chunk size
+	const char *offset_arg = 0; // decode whole stream
+	const char *length_arg = 0; // up to the end
+	const char *dict_file = 0;	// no dictionary
+	const char *dict_size_arg = 0; // default dictionary size
+	const char **samples = (const char **)malloc(argc * sizeof(char *));
+	int n_samples = 0;
 
 	// Parse options
 	for (int i = 1; i < argc;) {
@@ -130,6 +184,18 @@ int main(int argc, char **argv) {
 			op = LZFSE_DECODE;
 			continue;
 		}
+		if (strcmp(a, "-train") == 0) {
+			op = LZFSE_TRAIN;
+			continue;
+		}
+		if (strcmp(a, "-check") == 0) {
+			check = 1;
+			continue;
+		}
+		if (strcmp(a, "-seekable") == 0) {
+			seekable = 1;
+			continue;
+		}
 
 		// one arg
 		const char **arg_var = 0;
@@ -137,6 +203,16 @@ int main(int argc, char **argv) {
 			arg_var = &in_file;
 		else if (strcmp(a, "-o") == 0 && out_file == 0)
 			arg_var = &out_file;
+		else if (strcmp(a, "-chunk") == 0 && chunk_arg == 0)
+			arg_var = &chunk_arg;
+		else if (strcmp(a, "-offset") == 0 && offset_arg == 0)
+			arg_var = &offset_arg;
+		else if (strcmp(a, "-length") == 0 && length_arg == 0)
+			arg_var = &length_arg;
+		else if (strcmp(a, "-dict") == 0 && dict_file == 0)
+			arg_var = &dict_file;
+		else if (strcmp(a, "-dict_size") == 0 && dict_size_arg == 0)
+			arg_var = &dict_size_arg;
 		if (arg_var != 0) {
 			// Flag is recognized. Check if there is an argument.
 			if (i == argc)
@@ -145,10 +221,100 @@ int main(int argc, char **argv) {
 			continue;
 		}
 
+		// sample files
+		if (a[0] != '-') {
+			samples[n_samples++] = a;
+			continue;
+		}
+
 		USAGE_MSG(argc, argv, "Error: invalid flag %s\n", a);
 	}
 	if (op < 0)
-		USAGE_MSG(argc, argv, "Error: -encode|-decode required\n");
+		USAGE_MSG(argc, argv, "Error: -encode|-decode|-train required\n");
+	if (n_samples > 0 && op != LZFSE_TRAIN)
+		USAGE_MSG(argc, argv, "Error: invalid arg %s\n", samples[0]);
+
+	if (op == LZFSE_TRAIN) {
+		if (n_samples == 0)
+			USAGE_MSG(argc, argv, "Error: -train requires sample files\n");
+		size_t dict_capacity = 64 << 10;
+		if (dict_size_arg != 0)
+			dict_capacity = (size_t)strtoull(dict_size_arg, 0, 0);
+
+		// Concatenate samples
+		size_t total = 0;
+		uint8_t *all = 0;
+		size_t *sizes = (size_t *)malloc(n_samples * sizeof(size_t));
+		if (sizes == 0) {
+			perror("malloc");
+			exit(1);
+		}
+		for (int k = 0; k < n_samples; k++) {
+			uint8_t *buf = load_file(samples[k], &sizes[k]);
+			all = lzfse_reallocf(all, total + sizes[k] + 1);
+			if (all == 0) {
+				perror("malloc");
+				exit(1);
+			}
+			memcpy(all + total, buf, sizes[k]);
+			total += sizes[k];
+			free(buf);
+		}
+
+		uint8_t *dict = (uint8_t *)malloc(dict_capacity + 1);
+		if (dict == 0) {
+			perror("malloc");
+			exit(1);
+		}
+		size_t dict_size = lzfse_train_dict(dict, dict_capacity, all, sizes, (size_t)n_samples);
+		if (dict_size == 0) {
+			fprintf(stderr, "No dictionary could be built from these samples\n");
+			exit(1);
+		}
+		if (verbosity > 0)
+			fprintf(stderr, "Dictionary: %zu B from %d samples, %zu B\n", dict_size, n_samples, total);
+
+		FILE *f = out_file ? fopen(out_file, "wb") : stdout;
+		if (f == 0 || fwrite(dict, 1, dict_size, f) != dict_size || fclose(f) != 0) {
+			perror(out_file ? out_file : "stdout");
+			exit(1);
+		}
+		free(dict);
+		free(sizes);
+		free(all);
+		free(samples);
+		return 0;
+	}
+	free(samples);
+
+	uint8_t *dict = 0;
+	size_t dict_size = 0;
+	if (dict_file != 0) {
+		if (seekable || offset_arg != 0 || length_arg != 0)
+			USAGE_MSG(argc, argv, "Error: -dict can't be used with seekable streams\n");
+		dict = load_file(dict_file, &dict_size);
+	}
+	if (check && op == LZFSE_ENCODE && (seekable || dict != 0))
+		USAGE_MSG(argc, argv, "Error: -check can't be used with -seekable or -dict\n");
+
+	size_t chunk_size = 0; // default
+	uint64_t range_offset = 0;
+	uint64_t range_length = UINT64_MAX;
+	int range = (offset_arg != 0 || length_arg != 0);
+	if (chunk_arg != 0) {
+		seekable = 1;
+		chunk_size = (size_t)strtoull(chunk_arg, 0, 0);
+		if (chunk_size == 0)
+			USAGE_MSG(argc, argv, "Error: invalid chunk size %s\n", chunk_arg);
+	}
+	if (offset_arg != 0)
+		range_offset = strtoull(offset_arg, 0, 0);
+	if (length_arg != 0)
+		range_length = strtoull(length_arg, 0, 0);
+	if (seekable && op != LZFSE_ENCODE)
+		USAGE_MSG(argc, argv, "Error: -seekable requires -encode\n");
+	if (range && op != LZFSE_DECODE)
+		USAGE_MSG(argc, argv, "Error: -offset/-length require -decode\n");
 
 	// Info
 	if (verbosity > 0) {
@@ -182,7 +348,7 @@ int main(int argc, char **argv) {
 			perror(in_file);
 			exit(1);
 		}
-		if (st.st_size > SIZE_MAX) {
+		if ((uintmax_t)st.st_size > SIZE_MAX) {
 			fprintf(stderr, "File is too large\n");
 			exit(1);
 		}
@@ -244,15 +410,41 @@ int main(int argc, char **argv) {
 	//	and that decode grows by no more than 4x.	These are reasonable common-
 	//	case guidelines, but are not formally guaranteed to be satisfied.
 	size_t out_allocated = (op == LZFSE_ENCODE) ? in_size : (4 * in_size);
+	if (seekable)
+		out_allocated = lzfse_seekable_encode_bound(in_size, chunk_size);
+	if (range) {
+		// The index tells the exact size of the range
+		uint64_t raw_size;
+		if (lzfse_seekable_raw_size(in, in_size, &raw_size) != 0) {
+			fprintf(stderr, "Input is not a seekable LZFSE stream\n");
+			exit(1);
+		}
+		if (range_offset > raw_size)
+			range_offset = raw_size;
+		if (range_length > raw_size - range_offset)
+			range_length = raw_size - range_offset;
+		out_allocated = (size_t)range_length;
+	}
 	size_t out_size = 0;
-	size_t aux_allocated = (op == LZFSE_ENCODE) ? lzfse_encode_scratch_size()
-																							: lzfse_decode_scratch_size();
+	// Plain buffers go through a context, whose workspace is set up once for
+	// all the retries below; other modes take a scratch buffer.
+	int use_context = !(range || seekable || dict != 0 || (check && op == LZFSE_ENCODE));
+	lzfse_encoder_context *encoder = 0;
+	lzfse_decoder_context *decoder = 0;
+	size_t aux_allocated = 0;
+	if (use_context && op == LZFSE_ENCODE)
+		encoder = lzfse_encoder_context_create();
+	else if (use_context)
+		decoder = lzfse_decoder_context_create();
+	else
+		aux_allocated = (op == LZFSE_ENCODE) ? lzfse_encode_scratch_size()
+																				 : lzfse_decode_scratch_size();
 	void *aux = aux_allocated ? malloc(aux_allocated) : 0;
-	if (aux_allocated != 0 && aux == 0) {
+	if ((aux_allocated != 0 && aux == 0) || (use_context && encoder == 0 && decoder == 0)) {
 		perror("malloc");
 		exit(1);
 	}
-	uint8_t *out = (uint8_t *)malloc(out_allocated);
+	uint8_t *out = (uint8_t *)malloc(out_allocated + 1); // +1 for empty range
 	if (out == 0) {
 		perror("malloc");
 		exit(1);
@@ -260,10 +452,32 @@ int main(int argc, char **argv) {
 
 	double c0 = get_time();
 	while (1) {
-		if (op == LZFSE_ENCODE)
-			out_size = lzfse_encode_buffer(out, out_allocated, in, in_size, aux);
+		if (range) {
+			out_size = lzfse_seekable_decode_range(out, out_allocated, in, in_size, range_offset, aux);
+			if (out_size != out_allocated) {
+				fprintf(stderr, "Failed to decode range\n");
+				exit(1);
+			}
+			break;
+		}
+		if (seekable)
+			out_size = lzfse_seekable_encode_buffer(out, out_allocated, in, in_size, chunk_size, aux);
+		else if (dict != 0 && op == LZFSE_ENCODE)
+			out_size = lzfse_encode_buffer_with_dict(out, out_allocated, in, in_size, dict, dict_size, aux);
+		else if (dict != 0)
+			out_size = lzfse_decode_buffer_with_dict(out, out_allocated, in, in_size, dict, dict_size, aux);
+		else if (check && op == LZFSE_ENCODE)
+			out_size = lzfse_encode_buffer_with_checksum(out, out_allocated, in, in_size, aux);
+		else if (op == LZFSE_ENCODE)
+			out_size = lzfse_encode_buffer_with_context(out, out_allocated, in, in_size, encoder);
 		else
-			out_size = lzfse_decode_buffer(out, out_allocated, in, in_size, aux);
+			out_size = lzfse_decode_buffer_with_context(out, out_allocated, in, in_size, decoder);
+
+		// The decoder returns 0 on errors, including checksum mismatches
+		if (check && op == LZFSE_DECODE && out_size == 0 && in_size > 0) {
+			fprintf(stderr, "Decoding failed: corrupted data\n");
+			exit(1);
+		}
 
 		// If output buffer was too small, grow and retry.
 		if (out_size == 0 || (op == LZFSE_DECODE && out_size == out_allocated)) {
@@ -335,5 +549,10 @@ int main(int argc, char **argv) {
 	free(in);
 	free(out);
 	free(aux);
+	if (encoder)
+		lzfse_encoder_context_destroy(encoder);
+	if (decoder)
+		lzfse_decoder_context_destroy(decoder);
+	free(dict);
 	return 0; // OK
 }
@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2015-2016, Apple Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:  
+
+1.  Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2.  Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+    in the documentation and/or other materials provided with the distribution.
+
+3.  Neither the name of the copyright holder(s) nor the names of any contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// LZFSE seekable stream API
+
+#include "lzfse.h"
+#include "lzfse_internal.h"
+
+//  Encoded size overhead of one chunk: uncompressed block header, plus the
+//  end-of-stream marker lzfse_encode_buffer needs room for.
+#define LZFSE_SEEKABLE_CHUNK_EXTRA (sizeof(uncompressed_block_header) + 4)
+
+static size_t lzfse_seekable_n_chunks(size_t src_size, size_t chunk_size) {
+  return (src_size + chunk_size - 1) / chunk_size;
+}
+
+size_t lzfse_seekable_encode_bound(size_t src_size, size_t chunk_size) {
+  if (chunk_size == 0)
+    chunk_size = LZFSE_SEEKABLE_DEFAULT_CHUNK_SIZE;
+  size_t n_chunks = lzfse_seekable_n_chunks(src_size, chunk_size);
+  return src_size + n_chunks * LZFSE_SEEKABLE_CHUNK_EXTRA + 4 +
+         (n_chunks + 1) * sizeof(lzfse_seekable_index_entry) +
+         sizeof(lzfse_seekable_footer);
+}
+
+size_t lzfse_seekable_encode_buffer(uint8_t *__restrict dst_buffer,
+                                    size_t dst_size,
+                                    const uint8_t *__restrict src_buffer,
+                                    size_t src_size, size_t chunk_size,
+                                    void *__restrict scratch_buffer) {
+  if (chunk_size == 0)
+    chunk_size = LZFSE_SEEKABLE_DEFAULT_CHUNK_SIZE;
+  if (chunk_size >= INT32_MAX)
+    return 0; // chunks must be encodable as a single LZFSE buffer
+
+  size_t n_chunks = lzfse_seekable_n_chunks(src_size, chunk_size);
+  if (n_chunks >= UINT32_MAX)
+    return 0;
+  size_t index_size = (n_chunks + 1) * sizeof(lzfse_seekable_index_entry) +
+                      sizeof(lzfse_seekable_footer);
+
+  // The index is built aside, because the size of the chunks before it is
+  // only known after encoding them.
+  lzfse_seekable_index_entry *index =
+      malloc((n_chunks + 1) * sizeof(lzfse_seekable_index_entry));
+  if (index == NULL)
+    return 0;
+
+  int has_malloc = 0;
+  size_t ret = 0;
+  if (scratch_buffer == NULL) {
+    // +1 in case scratch size could be zero
+    scratch_buffer = malloc(lzfse_encode_scratch_size() + 1);
+    has_malloc = 1;
+  }
+  if (scratch_buffer == NULL)
+    goto done;
+
+  uint8_t *dst = dst_buffer;
+  uint8_t *dst_end = dst_buffer + dst_size;
+  for (size_t i = 0; i < n_chunks; i++) {
+    size_t r_offset = i * chunk_size;
+    size_t n = src_size - r_offset;
+    if (n > chunk_size)
+      n = chunk_size;
+    index[i].c_offset = (uint64_t)(dst - dst_buffer);
+    index[i].r_offset = (uint64_t)r_offset;
+
+    // Each chunk is a complete stream; drop its end-of-stream marker so the
+    // next chunk's blocks follow directly. Offering the chunk no more than
+    // its uncompressed size makes the encoder fall back to an uncompressed
+    // block instead of expanding into the space of the chunks after it.
+    size_t avail = (size_t)(dst_end - dst);
+    if (avail > n + LZFSE_SEEKABLE_CHUNK_EXTRA)
+      avail = n + LZFSE_SEEKABLE_CHUNK_EXTRA;
+    size_t sz = lzfse_encode_buffer(dst, avail, src_buffer + r_offset, n,
+                                    scratch_buffer);
+    if (sz < 4)
+      goto done;
+    dst += sz - 4;
+  }
+  index[n_chunks].c_offset = (uint64_t)(dst - dst_buffer);
+  index[n_chunks].r_offset = (uint64_t)src_size;
+
+  if ((size_t)(dst_end - dst) < 4 + index_size)
+    goto done; // DST full
+  store4(dst, LZFSE_ENDOFSTREAM_BLOCK_MAGIC);
+  dst += 4;
+  memcpy(dst, index, (n_chunks + 1) * sizeof(lzfse_seekable_index_entry));
+  dst += (n_chunks + 1) * sizeof(lzfse_seekable_index_entry);
+
+  lzfse_seekable_footer footer = {.n_raw_bytes = (uint64_t)src_size,
+                                  .n_chunks = (uint32_t)n_chunks,
+                                  .chunk_raw_size = (uint32_t)chunk_size,
+                                  .index_size = (uint32_t)index_size,
+                                  .magic = LZFSE_SEEKABLE_INDEX_MAGIC};
+  memcpy(dst, &footer, sizeof footer);
+  dst += sizeof footer;
+  ret = (size_t)(dst - dst_buffer);
+
+done:
+  if (has_malloc)
+    free(scratch_buffer);
+  free(index);
+  return ret;
+}
+
+/*! @abstract Locate and check the seekable index at the end of \p src_buffer.
+ *  @return 0 and fills \p footer and \p entries if the index is valid, -1
+ *  otherwise. Entries are not aligned; read them with memcpy. */
+static int lzfse_seekable_parse(const uint8_t *src_buffer, size_t src_size,
+                                lzfse_seekable_footer *footer,
+                                const uint8_t **entries) {
+  if (src_size < sizeof *footer)
+    return -1;
+  memcpy(footer, src_buffer + src_size - sizeof *footer, sizeof *footer);
+  if (footer->magic != LZFSE_SEEKABLE_INDEX_MAGIC || footer->chunk_raw_size == 0)
+    return -1;
+  uint64_t index_size = ((uint64_t)footer->n_chunks + 1) *
+                            sizeof(lzfse_seekable_index_entry) +
+                        sizeof(lzfse_seekable_footer);
+  if (footer->index_size != index_size || index_size + 4 > src_size)
+    return -1;
+  *entries = src_buffer + src_size - index_size;
+
+  // The last entry must point to the end-of-stream marker just before the
+  // index, and cover the whole stream.
+  lzfse_seekable_index_entry last;
+  memcpy(&last, *entries + (size_t)footer->n_chunks * sizeof last, sizeof last);
+  if (last.c_offset != src_size - index_size - 4 ||
+      last.r_offset != footer->n_raw_bytes ||
+      load4(src_buffer + last.c_offset) != LZFSE_ENDOFSTREAM_BLOCK_MAGIC)
+    return -1;
+  return 0;
+}
+
+int lzfse_seekable_raw_size(const uint8_t *src_buffer, size_t src_size,
+                            uint64_t *raw_size) {
+  lzfse_seekable_footer footer;
+  const uint8_t *entries;
+  if (lzfse_seekable_parse(src_buffer, src_size, &footer, &entries) != 0)
+    return -1;
+  *raw_size = footer.n_raw_bytes;
+  return 0;
+}
+
+/*! @abstract Decode the first \p dst_size bytes of a chunk of \p n_raw_bytes
+ *  decoded bytes stored in [src, src + src_size[.
+ *  @return 0 if the requested bytes were decoded, -1 on error. */
+static int lzfse_seekable_decode_chunk(lzfse_decoder_state *s, uint8_t *dst,
+                                       size_t dst_size, const uint8_t *src,
+                                       size_t src_size, size_t n_raw_bytes) {
+  lzfse_decode_reset(s);
+  s->src = src;
+  s->src_begin = src;
+  s->src_end = src + src_size;
+  s->dst = dst;
+  s->dst_begin = dst;
+  s->dst_end = dst + dst_size;
+
+  // A chunk has no end-of-stream marker: running out of SRC between two
+  // blocks is the expected outcome when decoding the whole chunk.
+  int status = lzfse_decode(s);
+  if (status == LZFSE_STATUS_SRC_EMPTY &&
+      s->block_magic == LZFSE_NO_BLOCK_MAGIC && s->src == s->src_end &&
+      (size_t)(s->dst - dst) == n_raw_bytes)
+    return 0;
+  if (status == LZFSE_STATUS_DST_FULL && dst_size < n_raw_bytes)
+    return 0;
+  return -1;
+}
+
+size_t lzfse_seekable_decode_range(uint8_t *__restrict dst_buffer,
+                                   size_t dst_size,
+                                   const uint8_t *__restrict src_buffer,
+                                   size_t src_size, uint64_t offset,
+                                   void *__restrict scratch_buffer) {
+  lzfse_seekable_footer footer;
+  const uint8_t *entries;
+  if (lzfse_seekable_parse(src_buffer, src_size, &footer, &entries) != 0)
+    return 0;
+  if (offset >= footer.n_raw_bytes)
+    return 0;
+  if (dst_size > footer.n_raw_bytes - offset)
+    dst_size = (size_t)(footer.n_raw_bytes - offset);
+
+  // Find the chunk containing OFFSET: the last entry with r_offset <= OFFSET.
+  uint32_t lo = 0, hi = footer.n_chunks; // entry[lo].r_offset <= OFFSET
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    lzfse_seekable_index_entry e;
+    memcpy(&e, entries + (size_t)mid * sizeof e, sizeof e);
+    if (e.r_offset <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  int has_malloc = 0;
+  uint8_t *chunk_buffer = NULL;
+  size_t ret = 0;
+  if (scratch_buffer == NULL) {
+    // +1 in case scratch size could be zero
+    scratch_buffer = malloc(lzfse_decode_scratch_size() + 1);
+    has_malloc = 1;
+  }
+  if (scratch_buffer == NULL)
+    return 0;
+
+  size_t written = 0;
+  for (uint32_t i = lo; i < footer.n_chunks && written < dst_size; i++) {
+    lzfse_seekable_index_entry e0, e1;
+    memcpy(&e0, entries + (size_t)i * sizeof e0, sizeof e0);
+    memcpy(&e1, entries + (size_t)(i + 1) * sizeof e1, sizeof e1);
+    if (e1.c_offset < e0.c_offset || e1.c_offset > src_size ||
+        e1.r_offset < e0.r_offset ||
+        e1.r_offset - e0.r_offset > footer.chunk_raw_size ||
+        e0.r_offset > offset + written)
+      goto done; // corrupted index
+    const uint8_t *src = src_buffer + e0.c_offset;
+    size_t src_chunk_size = (size_t)(e1.c_offset - e0.c_offset);
+    size_t n_raw_bytes = (size_t)(e1.r_offset - e0.r_offset);
+    size_t skip = (size_t)(offset + written - e0.r_offset);
+    size_t n = n_raw_bytes - skip;
+    if (n > dst_size - written)
+      n = dst_size - written;
+
+    if (skip == 0) {
+      // Decode in place, stopping as soon as the range is complete
+      if (lzfse_seekable_decode_chunk(scratch_buffer, dst_buffer + written, n,
+                                      src, src_chunk_size, n_raw_bytes) != 0)
+        goto done;
+    } else {
+      // Matches may reference anything since the start of the chunk, so the
+      // skipped prefix is decoded aside
+      if (chunk_buffer == NULL)
+        chunk_buffer = malloc(footer.chunk_raw_size);
+      if (chunk_buffer == NULL)
+        goto done;
+      if (lzfse_seekable_decode_chunk(scratch_buffer, chunk_buffer, skip + n,
+                                      src, src_chunk_size, n_raw_bytes) != 0)
+        goto done;
+      memcpy(dst_buffer + written, chunk_buffer + skip, n);
+    }
+    written += n;
+  }
+  if (written == dst_size)
+    ret = written;
+
+done:
+  free(chunk_buffer);
+  if (has_malloc)
+    free(scratch_buffer);
+  return ret;
+}
@@ -191,11 +191,11 @@ static inline lzvn_offset offset_from_s32(int32_t x) { return (lzvn_offset)x; }
 // ===============================================================
 // Hash and Matching
 
-/*! @abstract Get hash in range \c [0,LZVN_ENCODE_HASH_VALUES-1] from 3 bytes in i. */
-static inline uint32_t hash3i(uint32_t i) {
+/*! @abstract Get hash in range \c [0,mask] from 3 bytes in i. */
+static inline uint32_t hash3i(uint32_t i, uint32_t mask) {
   i &= 0xffffff; // truncate to 24-bit input (slightly increases compression ratio)
   uint32_t h = (i * (1 + (1 << 6) + (1 << 12))) >> 12;
-  return h & (LZVN_ENCODE_HASH_VALUES - 1);
+  return h & mask;
 }
 
 /*! @abstract Return the number [0, 4] of zero bytes in \p x, starting from the
@@ -376,10 +376,26 @@ static inline void lzvn_init_table(lzvn_encoder_state *state) {
     e.indices[i] = offset_to_s32(index);
     e.values[i] = value;
   }
-  for (int u = 0; u < LZVN_ENCODE_HASH_VALUES; u++)
+  for (uint32_t u = 0; u <= state->table_mask; u++)
     state->table[u] = e; // fill entire table
 }
 
+/*! @abstract Insert all positions of the history preceding the source
+ * (\c [src_begin,0[) in the encoder table of \p state, so matches can
+ * reference it. */
+static inline void lzvn_prime_table(lzvn_encoder_state *state) {
+  for (lzvn_offset i = state->src_begin; i < 0; i++) {
+    uint32_t vi = load4(state->src + i);
+    lzvn_encode_entry_type *e = state->table + hash3i(vi, state->table_mask);
+    for (int k = 3; k > 0; k--) {
+      e->indices[k] = e->indices[k - 1];
+      e->values[k] = e->values[k - 1];
+    }
+    e->indices[0] = offset_to_s32(i);
+    e->values[0] = vi;
+  }
+}
+
 void lzvn_encode(lzvn_encoder_state *state) {
   const lzvn_match_info NO_MATCH = {0};
 
@@ -388,7 +404,10 @@ void lzvn_encode(lzvn_encoder_state *state) {
     uint32_t vi = load4(state->src + state->src_current);
 
     // Compute new hash H at position I, and push value into position table
-    int h = hash3i(vi); // index of first entry
+    int h = hash3i(vi, state->table_mask); // index of first entry
+
+    // Extra positions to skip after this one, while no match is found
+    lzvn_offset skip = 0;
 
     // Read table entries for H
     lzvn_encode_entry_type e = state->table[h];
@@ -487,9 +506,19 @@ void lzvn_encode(lzvn_encoder_state *state) {
           EMIT_MATCH(state->pending);
           state->pending = NO_MATCH;
         } else {
+          // Give up on incompressible input: the caller falls back to
+          // storing it, there is no point encoding the rest
+          if (state->bail_size != 0 && state->src_literal >= state->bail_size &&
+              state->dst - state->dst_begin >= state->src_literal)
+            return;
           EMIT_LITERAL(271); // emit long literal (271 is the longest literal size we allow)
         }
       }
+      // Literals only so far: look for matches less often the longer this
+      // lasts. Skipped positions are not inserted in the table.
+      if (state->pending.M == 0)
+        skip = (state->src_current - state->src_literal) >>
+               LZVN_ENCODE_SKIP_SHIFT;
       goto after_emit;
     }
 
@@ -522,6 +551,7 @@ void lzvn_encode(lzvn_encoder_state *state) {
     // We commit state changes only after we tried to emit instructions, so we
     // can restart in the same state in case dst was full and we quit the loop.
     state->table[h] = updated_e;
+    state->src_current += skip;
 
   } // i loop
 
@@ -535,7 +565,8 @@ size_t lzvn_encode_scratch_size(void) { return LZVN_ENCODE_WORK_SIZE; }
 
 static size_t lzvn_encode_partial(void *__restrict dst, size_t dst_size,
                                   const void *__restrict src, size_t src_size,
-                                  size_t *src_used, void *__restrict work) {
+                                  size_t prefix_size, size_t *src_used,
+                                  void *__restrict work) {
   // Min size checks to avoid accessing memory outside buffers.
   if (dst_size < LZVN_ENCODE_MIN_DST_SIZE) {
     *src_used = 0;
@@ -550,8 +581,12 @@ static size_t lzvn_encode_partial(void *__restrict dst, size_t dst_size,
   lzvn_encoder_state state;
   memset(&state, 0, sizeof(state));
 
+  // Only the last LZVN_ENCODE_MAX_DISTANCE bytes of history are reachable
+  if (prefix_size > LZVN_ENCODE_MAX_DISTANCE)
+    prefix_size = LZVN_ENCODE_MAX_DISTANCE;
+
   state.src = src;
-  state.src_begin = 0;
+  state.src_begin = -(lzvn_offset)prefix_size;
   state.src_end = (lzvn_offset)src_size;
   state.src_literal = 0;
   state.src_current = 0;
@@ -560,11 +595,25 @@ static size_t lzvn_encode_partial(void *__restrict dst, size_t dst_size,
   state.dst_end = (unsigned char *)dst + dst_size - 8; // reserve 8 bytes for end-of-stream
   state.table = work;
 
+  // Size the hash table to the data: initializing all of it dominates the
+  // encoding time of small sources
+  int hash_bits = LZVN_ENCODE_MIN_HASH_BITS;
+  while (hash_bits < LZVN_ENCODE_HASH_BITS &&
+         ((size_t)1 << hash_bits) < src_size + prefix_size)
+    hash_bits++;
+  state.table_mask = (1U << hash_bits) - 1;
+
+  // Input that does not compress in its first half is stored by the caller
+  state.bail_size = (lzvn_offset)(src_size / 2);
+  if (state.bail_size < (lzvn_offset)LZVN_ENCODE_MIN_BAIL_SIZE)
+    state.bail_size = (lzvn_offset)LZVN_ENCODE_MIN_BAIL_SIZE;
+
   // Do not encode if the input buffer is too small. We'll emit a literal instead.
   if (src_size >= LZVN_ENCODE_MIN_SRC_SIZE) {
 
     state.src_current_end = (lzvn_offset)src_size - LZVN_ENCODE_MIN_MARGIN;
     lzvn_init_table(&state);
+    lzvn_prime_table(&state);
     lzvn_encode(&state);
 
   }
@@ -584,9 +633,16 @@ static size_t lzvn_encode_partial(void *__restrict dst, size_t dst_size,
 size_t lzvn_encode_buffer(void *__restrict dst, size_t dst_size,
                           const void *__restrict src, size_t src_size,
                           void *__restrict work) {
+  return lzvn_encode_buffer_with_prefix(dst, dst_size, src, src_size, 0, work);
+}
+
+size_t lzvn_encode_buffer_with_prefix(void *__restrict dst, size_t dst_size,
+                                      const void *__restrict src,
+                                      size_t src_size, size_t prefix_size,
+                                      void *__restrict work) {
   size_t src_used = 0;
-  size_t dst_used =
-      lzvn_encode_partial(dst, dst_size, src, src_size, &src_used, work);
+  size_t dst_used = lzvn_encode_partial(dst, dst_size, src, src_size,
+                                        prefix_size, &src_used, work);
   if (src_used != src_size)
     return 0;      // could not encode entire input stream = fail
   return dst_used; // return encoded size
@@ -35,6 +35,8 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSI
   4 // stored offsets stack for each hash value, MUST be 4
 #define LZVN_ENCODE_HASH_VALUES                                                \
   (1 << LZVN_ENCODE_HASH_BITS) // number of entries in hash table
+#define LZVN_ENCODE_MIN_HASH_BITS                                              \
+  8 // smallest hash table used for small sources, in [8, HASH_BITS]
 #define LZVN_ENCODE_MAX_DISTANCE                                               \
   0xffff // max match distance we can represent with LZVN encoding, MUST be
          // 0xFFFF
@@ -44,6 +46,12 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSI
 #define LZVN_ENCODE_MAX_LITERAL_BACKLOG                                        \
   400 // if the number of pending literals exceeds this size, emit a long
       // literal, MUST be >= 271
+#define LZVN_ENCODE_SKIP_SHIFT                                                 \
+  5 // while no match is found, advance by 1 + (pending literals >> SHIFT)
+    // positions at a time
+#define LZVN_ENCODE_MIN_BAIL_SIZE                                              \
+  1024 // give up if the output is not smaller than the input after this many
+       // bytes of literals only
 
 /*! @abstract Type of table entry. */
 typedef struct {
@@ -103,8 +111,14 @@ typedef struct {
 
   // Hash table used to find matches. Stores LZVN_ENCODE_OFFSETS_PER_HASH 32-bit
   // signed indices in the source buffer, and the corresponding 4-byte values.
-  // The number of entries in the table is LZVN_ENCODE_HASH_VALUES.
+  // The table has table_mask + 1 entries, at most LZVN_ENCODE_HASH_VALUES:
+  // small sources only initialize and use the beginning of the work buffer.
   lzvn_encode_entry_type *table;
+  uint32_t table_mask;
+
+  // Source size after which we stop if the output is not smaller than the
+  // input; 0 to always encode the entire source.
+  lzvn_offset bail_size;
 
 } lzvn_encoder_state;
 
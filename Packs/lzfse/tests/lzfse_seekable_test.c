@@ -0,0 +1,83 @@
+// LZFSE seekable stream round trip test
+//
+// Encodes random (incompressible) and repetitive data into buffers of exactly
+// lzfse_seekable_encode_bound( ) bytes, then decodes ranges back. Returns 0
+// on success, 1 on the first mismatch.
+
+#include "lzfse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t rng_state = 0x2545f491;
+
+static uint32_t rng_next(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static int check(const char *name, const uint8_t *src, size_t src_size, size_t chunk_size) {
+	size_t bound = lzfse_seekable_encode_bound(src_size, chunk_size);
+	uint8_t *enc = malloc(bound);
+	uint8_t *dec = malloc(src_size + 1);
+	int ret = 1;
+	if (enc == NULL || dec == NULL) {
+		fprintf(stderr, "%s: out of memory\n", name);
+		goto done;
+	}
+
+	size_t enc_size = lzfse_seekable_encode_buffer(enc, bound, src, src_size, chunk_size, NULL);
+	if (enc_size == 0) {
+		fprintf(stderr, "%s: encoding into %zu bytes failed\n", name, bound);
+		goto done;
+	}
+
+	uint64_t raw_size;
+	if (lzfse_seekable_raw_size(enc, enc_size, &raw_size) != 0 || raw_size != src_size) {
+		fprintf(stderr, "%s: bad raw size\n", name);
+		goto done;
+	}
+
+	// Whole stream, then ranges starting on, just before, and inside chunks
+	const size_t offsets[] = { 0, chunk_size - 1, chunk_size, chunk_size + 7, src_size - 1 };
+	for (size_t i = 0; i < sizeof offsets / sizeof offsets[0]; i++) {
+		size_t offset = offsets[i];
+		if (offset >= src_size)
+			continue;
+		size_t want = src_size - offset;
+		size_t got = lzfse_seekable_decode_range(dec, want, enc, enc_size, offset, NULL);
+		if (got != want || memcmp(dec, src + offset, want) != 0) {
+			fprintf(stderr, "%s: range at %zu decoded %zu of %zu bytes\n", name, offset, got, want);
+			goto done;
+		}
+	}
+	ret = 0;
+
+done:
+	free(enc);
+	free(dec);
+	return ret;
+}
+
+int main(void) {
+	static uint8_t buf[13370];
+	int ret = 0;
+
+	for (size_t i = 0; i < sizeof buf; i++)
+		buf[i] = (uint8_t)rng_next();
+	ret |= check("random", buf, sizeof buf, 4096);
+	ret |= check("random, one chunk", buf, sizeof buf, 0);
+
+	for (size_t i = 0; i < sizeof buf; i++)
+		buf[i] = (uint8_t)"seekable"[i % 8];
+	ret |= check("repetitive", buf, sizeof buf, 4096);
+
+	// Compressible chunks followed by an incompressible one
+	for (size_t i = 3 * 4096; i < sizeof buf; i++)
+		buf[i] = (uint8_t)rng_next();
+	ret |= check("mixed", buf, sizeof buf, 4096);
+
+	return ret;
+}
@@ -0,0 +1,523 @@
+/*
+  Copyright (c) 1990-2009 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2009-Jan-02 or later
+  (the contents of which are also included in unzip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/*---------------------------------------------------------------------------
+
+  api.c
+
+  This module supplies an UnZip engine for use directly from C/C++
+  programs.  It is compiled into the unzip library (DLL must be defined,
+  which implies REENTRANT), where every call runs on its own globals
+  structure; nothing is written to disk and nothing is printed unless the
+  caller supplies a message function.
+
+  The handle-based functions keep the name of an archive and the options
+  to use with it, so that a program can list the archive and then pull
+  members into memory or through a callback one at a time:
+
+      UzpArchive *ar = UzpOpenArchive("foo.zip", NULL, NULL);
+      UzpBuffer buf;
+
+      if (ar != NULL && UzpReadEntry(ar, "dir/file.txt", &buf) == PK_OK) {
+          ... buf.strptr[0 .. buf.strlength-1] ...
+          UzpFreeMemBuffer(&buf);
+      }
+      UzpCloseArchive(ar);
+
+  A handle may be used by one thread at a time.  On Unix (REENTRANT_THREADS,
+  see unzpriv.h), different handles (also for the same archive) may be used
+  concurrently; tests/api_threads_test.c checks that.  Member names are
+  filespecs like on the command line, so wildcard characters in them
+  need to be escaped.
+
+  Contains:  UzpUnzipToMemory()
+             UzpFreeMemBuffer()
+             UzpOpenArchive()
+             UzpCloseArchive()
+             UzpListArchive()
+             UzpReadEntry()
+             UzpStreamEntry()
+             api_globals()
+             api_nopasswd()           (CRYPT only)
+             unzipToMemory()
+             setFileNotFound()
+             redirect_outfile()
+             writeToMemory()
+             close_redirect()
+             fill_cdir_rec()
+
+  ---------------------------------------------------------------------------*/
+
+
+#define __API_C         /* identifies this source module */
+#define UNZIP_INTERNAL
+#include "unzip.h"
+
+#ifndef DLL
+   error:  api.c is only used in the DLL (library) build of UnZip
+#endif
+
+struct _UzpArchive {            /* what UzpOpenArchive() returns */
+    char *zipfn;                /* name of the archive */
+    UzpOpts opts;               /* options for every call on it */
+    UzpCB cb;                   /* user functions (NULL if none) */
+};
+
+static Uz_Globs *api_globals OF((UzpArchive *archive));
+#if CRYPT
+   static int UZ_EXP api_nopasswd OF((zvoid *pG, int *rcnt, char *pwbuf,
+                                      int size, ZCONST char *zfn,
+                                      ZCONST char *efn));
+#endif
+
+
+
+
+/*******************************/
+/* Function UzpUnzipToMemory() */
+/*******************************/
+
+int UZ_EXP UzpUnzipToMemory(char *zip, char *file, UzpOpts *optflgs,
+    UzpCB *UsrFuncts, UzpBuffer *retstr)
+{
+    UzpArchive ar;
+    int r;
+
+    memzero(&ar, sizeof(ar));
+    ar.zipfn = zip;
+    if (optflgs != (UzpOpts *)NULL)
+        ar.opts = *optflgs;
+    if (UsrFuncts != (UzpCB *)NULL)
+        ar.cb = *UsrFuncts;
+    r = UzpReadEntry(&ar, file, retstr);
+    return (r <= PK_WARN);      /* TRUE if the member was extracted */
+
+} /* end function UzpUnzipToMemory() */
+
+
+
+
+/*******************************/
+/* Function UzpFreeMemBuffer() */
+/*******************************/
+
+void UZ_EXP UzpFreeMemBuffer(UzpBuffer *retstr)
+{
+    if (retstr != (UzpBuffer *)NULL && retstr->strptr != (char *)NULL) {
+        free(retstr->strptr);
+        retstr->strptr = (char *)NULL;
+        retstr->strlength = 0;
+    }
+}
+
+
+
+
+/*****************************/
+/* Function UzpOpenArchive() */
+/*****************************/
+
+UzpArchive * UZ_EXP UzpOpenArchive(ZCONST char *zip, UzpOpts *optflgs,
+    UzpCB *UsrFuncts)
+{
+    /*
+     * Only checks that the archive can be opened for reading; it is read
+     * (and its central directory located) again by every later call, which
+     * keeps calls on different handles independent of each other.  Returns
+     * NULL if the archive cannot be opened or memory is short.
+     */
+    UzpArchive *ar;
+    z_stat st;
+
+    if (zip == (ZCONST char *)NULL || SSTAT(zip, &st) != 0 ||
+        S_ISDIR(st.st_mode) || access(zip, 4) != 0)
+        return (UzpArchive *)NULL;
+    if ((ar = (UzpArchive *)malloc(sizeof(UzpArchive))) == NULL)
+        return (UzpArchive *)NULL;
+    memzero(ar, sizeof(UzpArchive));
+    if ((ar->zipfn = (char *)malloc(strlen(zip) + 1)) == (char *)NULL) {
+        free(ar);
+        return (UzpArchive *)NULL;
+    }
+    strcpy(ar->zipfn, zip);
+    if (optflgs != (UzpOpts *)NULL)
+        ar->opts = *optflgs;
+    if (UsrFuncts != (UzpCB *)NULL)
+        ar->cb = *UsrFuncts;
+    return ar;
+
+} /* end function UzpOpenArchive() */
+
+
+
+
+/******************************/
+/* Function UzpCloseArchive() */
+/******************************/
+
+void UZ_EXP UzpCloseArchive(UzpArchive *archive)
+{
+    if (archive != (UzpArchive *)NULL) {
+        free(archive->zipfn);
+        free(archive);
+    }
+}
+
+
+
+
+/*****************************/
+/* Function UzpListArchive() */
+/*****************************/
+
+int UZ_EXP UzpListArchive(UzpArchive *archive, cbList(callBack))
+{
+    /*
+     * Call callBack() with the name and the central directory record of
+     * every member, in archive order.  A nonzero return value from
+     * callBack() ends the listing.  Returns a PK error code.
+     */
+    int r;
+    Uz_Globs *pG = api_globals(archive);
+
+    if (pG == (Uz_Globs *)NULL)
+        return PK_MEM;
+    uO.vflag = 1;
+    uO.tflag = uO.cflag = uO.zipinfo_mode = FALSE;
+    G.processExternally = callBack;
+    G.process_all_files = TRUE;
+    G.extract_flag = FALSE;
+    r = process_zipfiles(__G);
+    DESTROYGLOBALS();
+    return r;
+
+} /* end function UzpListArchive() */
+
+
+
+
+/***************************/
+/* Function UzpReadEntry() */
+/***************************/
+
+int UZ_EXP UzpReadEntry(UzpArchive *archive, ZCONST char *file,
+    UzpBuffer *retstr)
+{
+    /*
+     * Extract the member named file into a malloc'd buffer, which the
+     * caller releases with UzpFreeMemBuffer().  Returns a PK error code;
+     * the buffer is only set (and needs to be freed) for PK_OK and PK_WARN.
+     */
+    int r;
+    Uz_Globs *pG = api_globals(archive);
+
+    retstr->strptr = (char *)NULL;
+    retstr->strlength = 0;
+    if (pG == (Uz_Globs *)NULL)
+        return PK_MEM;
+    G.redirect_data = 1;
+    r = unzipToMemory(__G__ archive->zipfn, (char *)file, retstr);
+    if (r > PK_WARN || G.filenotfound) {
+        UzpFreeMemBuffer(retstr);
+        if (r <= PK_WARN)
+            r = PK_FIND;
+    }
+    G.redirect_buffer = (uch *)NULL;    /* now owned by the caller */
+    DESTROYGLOBALS();
+    return r;
+
+} /* end function UzpReadEntry() */
+
+
+
+
+/*****************************/
+/* Function UzpStreamEntry() */
+/*****************************/
+
+int UZ_EXP UzpStreamEntry(UzpArchive *archive, ZCONST char *file,
+    UzpStreamFn *callBack, zvoid *arg)
+{
+    /*
+     * Hand the data of the member named file to callBack(arg, buf, size)
+     * in window-sized pieces, as it is decompressed.  If file matches more
+     * than one member, they are passed in turn.  A nonzero return value
+     * from callBack() stops the extraction, which then returns PK_DISK
+     * (as on a full disk); otherwise, the result is a PK error code.
+     */
+    int r;
+    Uz_Globs *pG = api_globals(archive);
+
+    if (pG == (Uz_Globs *)NULL)
+        return PK_MEM;
+    G.redirect_data = 1;
+    G.redirect_fn = callBack;
+    G.redirect_arg = arg;
+    r = unzipToMemory(__G__ archive->zipfn, (char *)file, (UzpBuffer *)NULL);
+    if (r <= PK_WARN && G.filenotfound)
+        r = PK_FIND;
+    DESTROYGLOBALS();
+    return r;
+
+} /* end function UzpStreamEntry() */
+
+
+
+
+/**************************/
+/* Function api_globals() */
+/**************************/
+
+static Uz_Globs *api_globals(archive)  /* fresh globals for one API call */
+    UzpArchive *archive;
+{
+    CONSTRUCTGLOBALS();
+
+    if (pG == (Uz_Globs *)NULL)
+        return (Uz_Globs *)NULL;
+    uO = archive->opts;
+    uO.qflag = 2;
+    G.wildzipfn = archive->zipfn;
+    G.message = (archive->cb.msgfn != NULL ? archive->cb.msgfn :
+                 UzpMessageNull);
+    if (archive->cb.inputfn != NULL)
+        G.input = archive->cb.inputfn;
+    G.mpause = archive->cb.pausefn;     /* no "more" pausing by default */
+#if CRYPT
+    G.decr_passwd = (archive->cb.passwdfn != NULL ? archive->cb.passwdfn :
+                     api_nopasswd);
+#endif
+    G.statreportcb = archive->cb.statrepfn;
+    return pG;
+
+} /* end function api_globals() */
+
+
+
+
+#if CRYPT
+
+/***************************/
+/* Function api_nopasswd() */
+/***************************/
+
+static int UZ_EXP api_nopasswd(pG, rcnt, pwbuf, size, zfn, efn)
+    zvoid *pG;
+    int *rcnt;
+    char *pwbuf;
+    int size;
+    ZCONST char *zfn;
+    ZCONST char *efn;
+{
+    /* never prompt:  only the password in the options (uO.pwdarg) is
+     * tried on encrypted members */
+    return IZ_PW_CANCELALL;
+}
+
+#endif /* CRYPT */
+
+
+
+
+/****************************/
+/* Function unzipToMemory() */
+/****************************/
+
+int unzipToMemory(__G__ zip, file, retstr)  /* return PK-type error code */
+    __GDEF
+    char *zip;
+    char *file;
+    UzpBuffer *retstr;
+{
+    int r;
+    char *incname[2];
+
+    G.process_all_files = FALSE;
+    G.extract_flag = TRUE;
+    uO.qflag = 2;
+    G.wildzipfn = zip;
+
+    G.pfnames = incname;
+    incname[0] = file;
+    incname[1] = NULL;
+    G.filespecs = 1;
+
+    r = process_zipfiles(__G);
+    if (retstr) {
+        retstr->strptr = (char *)G.redirect_buffer;
+        retstr->strlength = G.redirect_size;
+    }
+    return r;
+
+} /* end function unzipToMemory() */
+
+
+
+
+/******************************/
+/* Function setFileNotFound() */
+/******************************/
+
+void setFileNotFound(__G)
+    __GDEF
+{
+    G.filenotfound++;
+}
+
+
+
+
+/*******************************/
+/* Function redirect_outfile() */
+/*******************************/
+
+int redirect_outfile(__G)       /* return TRUE if output can be taken */
+    __GDEF
+{
+    if (G.redirect_fn != NULL) {
+        /* streaming:  the decompressors use their own window and every
+         * flush() goes to the callback (see writeToMemory()) */
+#ifndef NO_SLIDE_REDIR
+        G.redirect_slide = FALSE;
+#endif
+        return TRUE;
+    }
+
+    /* only one member per buffer */
+    if (G.redirect_size != 0 || G.redirect_buffer != NULL)
+        return FALSE;
+
+#ifndef NO_SLIDE_REDIR
+    /* with the buffer as the window, decompression writes straight into
+     * it (binary data only; text conversion needs the usual window) */
+    G.redirect_slide = !G.pInfo->textmode;
+#endif
+#if (lenEOL != 1)
+    if (G.pInfo->textmode) {
+        G.redirect_size = (ulg)(G.lrec.ucsize * lenEOL);
+        if (G.redirect_size < G.lrec.ucsize)
+            G.redirect_size = (ulg)((G.lrec.ucsize > (ulg)-2L) ?
+                                    G.lrec.ucsize : -2L);
+    } else
+#endif
+    {
+        G.redirect_size = (ulg)G.lrec.ucsize;
+    }
+    if ((zusz_t)G.redirect_size != G.lrec.ucsize ||
+        (ulg)(extent)G.redirect_size != G.redirect_size) {
+        G.redirect_size = 0;    /* does not fit into memory */
+        return FALSE;
+    }
+
+    G.redirect_buffer = (uch *)malloc((extent)G.redirect_size + 1);
+    if (G.redirect_buffer == (uch *)NULL) {
+        G.redirect_size = 0;
+        return FALSE;
+    }
+    G.redirect_pointer = G.redirect_buffer;
+    return TRUE;
+
+} /* end function redirect_outfile() */
+
+
+
+
+/****************************/
+/* Function writeToMemory() */
+/****************************/
+
+int writeToMemory(__GPRO__ ZCONST uch *rawbuf, extent size)
+{
+    int errflg = FALSE;
+
+    if (G.redirect_fn != NULL) {
+        if ((*G.redirect_fn)(G.redirect_arg, rawbuf, (ulg)size) != 0) {
+            G.disk_full = 2;    /* caller wants no more data:  stop */
+            errflg = TRUE;
+        }
+        return errflg;
+    }
+
+    if ((uch *)rawbuf != G.redirect_pointer) {
+        extent redir_avail = (G.redirect_buffer + G.redirect_size) -
+                             G.redirect_pointer;
+
+        /* Check for output buffer overflow */
+        if (size > redir_avail) {
+           /* limit transfer data to available space, set error return flag */
+           size = redir_avail;
+           errflg = TRUE;
+        }
+        memcpy(G.redirect_pointer, rawbuf, size);
+    }
+    G.redirect_pointer += size;
+    return errflg;
+
+} /* end function writeToMemory() */
+
+
+
+
+/*****************************/
+/* Function close_redirect() */
+/*****************************/
+
+int close_redirect(__G)
+    __GDEF
+{
+    if (G.redirect_fn != NULL)
+        return 0;               /* streaming:  nothing buffered */
+
+    if (G.pInfo->textmode) {
+        *G.redirect_pointer = '\0';
+        G.redirect_size = (ulg)(G.redirect_pointer - G.redirect_buffer);
+        if ((G.redirect_buffer =
+             realloc(G.redirect_buffer, G.redirect_size + 1)) == NULL) {
+            G.redirect_size = 0;
+            return EOF;
+        }
+    }
+    return 0;
+
+} /* end function close_redirect() */
+
+
+
+
+/****************************/
+/* Function fill_cdir_rec() */
+/****************************/
+
+void fill_cdir_rec(__G__ crec)  /* public copy of the current G.crec */
+    __GDEF
+    Uzp_cdir_Rec *crec;
+{
+    crec->version_made_by[0] = G.crec.version_made_by[0];
+    crec->version_made_by[1] = G.crec.version_made_by[1];
+    crec->version_needed_to_extract[0] = G.crec.version_needed_to_extract[0];
+    crec->version_needed_to_extract[1] = G.crec.version_needed_to_extract[1];
+    crec->general_purpose_bit_flag = G.crec.general_purpose_bit_flag;
+    crec->compression_method = G.crec.compression_method;
+    crec->last_mod_dos_datetime = G.crec.last_mod_dos_datetime;
+    crec->crc32 = G.crec.crc32;
+    crec->csize.lo32 = (ulg)(G.crec.csize & 0xffffffffL);
+    crec->csize.hi32 = (ulg)((G.crec.csize >> 16) >> 16);
+    crec->ucsize.lo32 = (ulg)(G.crec.ucsize & 0xffffffffL);
+    crec->ucsize.hi32 = (ulg)((G.crec.ucsize >> 16) >> 16);
+    crec->filename_length = G.crec.filename_length;
+    crec->extra_field_length = G.crec.extra_field_length;
+    crec->file_comment_length = G.crec.file_comment_length;
+    crec->disk_number_start = (ush)G.crec.disk_number_start;
+    crec->internal_file_attributes = G.crec.internal_file_attributes;
+    crec->external_file_attributes = G.crec.external_file_attributes;
+    crec->relative_offset_local_header.lo32 =
+      (ulg)(G.crec.relative_offset_local_header & 0xffffffffL);
+    crec->relative_offset_local_header.hi32 =
+      (ulg)((G.crec.relative_offset_local_header >> 16) >> 16);
+
+} /* end function fill_cdir_rec() */
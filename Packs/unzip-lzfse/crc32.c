@@ -47,6 +47,32 @@
 #  define CRC_TBLS  1
 #endif
 
+/* Without one of the word-at-a-time options above, crc32() runs a "slice-
+   by-16" table kernel, or a hardware kernel chosen at runtime:  carry-less
+   multiply folding (PCLMULQDQ) on x86-64, or the ARMv8 CRC32 instructions
+   when the compiler targets them.  NO_CRC_SLICE16 keeps the classic byte-
+   wise loop, NO_CRC_HWACCEL keeps the table kernel.
+ */
+#if (!defined(USE_ZLIB) && !defined(CRC_TABLE_ONLY) && !defined(ASM_CRC))
+#  if (!defined(IZ_CRC_BE_OPTIMIZ) && !defined(IZ_CRC_LE_OPTIMIZ))
+#    if (!defined(NO_CRC_SLICE16) && !defined(SMALL_MEM) && !defined(MED_MEM))
+#      define IZ_CRCOPTIM_SLICE16
+#    endif
+#  endif
+#endif
+#if (defined(IZ_CRCOPTIM_SLICE16) && !defined(NO_CRC_HWACCEL))
+#  if (defined(__x86_64__) && (defined(__clang__) || (__GNUC__ >= 5)))
+#    define IZ_CRC_PCLMUL
+#    include <cpuid.h>
+#    include <smmintrin.h>        /* SSE4.1 */
+#    include <wmmintrin.h>        /* PCLMULQDQ */
+#  endif
+#  if (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32))
+#    define IZ_CRC_ARMV8
+#    include <arm_acle.h>
+#  endif
+#endif
+
 
 /*
   Generate tables for a byte-wise 32-bit CRC calculation on the polynomial:
@@ -109,6 +135,9 @@ local void make_crc_table OF((void));
    local int crc_table_empty = 1;
 #  define CRC_TABLE_IS_EMPTY    (crc_table_empty != 0)
 #  define MARK_CRCTAB_FILLED    crc_table_empty = 0
+#  ifdef REENTRANT_THREADS
+   local pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+#  endif
 #endif /* ?DYNALLOC_CRCTAB */
 
 
@@ -620,9 +649,13 @@ ZCONST ulg near *get_crc_table OF((void))
 #endif
 {
 #ifdef DYNAMIC_CRC_TABLE
+#ifdef REENTRANT_THREADS
+  pthread_once(&crc_table_once, make_crc_table);
+#else
   if (CRC_TABLE_IS_EMPTY)
     make_crc_table();
 #endif
+#endif
 #ifdef USE_ZLIB
   return (ZCONST uLongf *)crc_table;
 #else
@@ -676,6 +709,242 @@ void free_crc_table()
 #endif /* (IZ_CRC_BE_OPTIMIZ || IZ_CRC_LE_OPTIMIZ) */
 
 
+#ifdef IZ_CRCOPTIM_SLICE16
+
+typedef z_uint4 (*crc_kernel_t) OF((z_uint4 c, ZCONST uch *buf, extent len));
+
+/* crc_slice_tab[0] is the byte-wise table, crc_slice_tab[k] advances a byte
+   value through k more zero bytes */
+local z_uint4 crc_slice_tab[16][256];
+local crc_kernel_t crc_kernel = NULL;   /* chosen on first use */
+#ifdef REENTRANT_THREADS
+local pthread_once_t crc_kernel_once = PTHREAD_ONCE_INIT;
+#endif
+
+local void make_crc_slice_tab OF((void));
+local z_uint4 crc32_slice16 OF((z_uint4 c, ZCONST uch *buf, extent len));
+local void crc_select_kernel OF((void));
+
+local void make_crc_slice_tab()
+{
+  z_uint4 c;
+  int n, k;
+
+  for (n = 0; n < 256; n++) {
+    c = (z_uint4)n;
+    for (k = 8; k; k--)
+      c = c & 1 ? 0xedb88320L ^ (c >> 1) : c >> 1;
+    crc_slice_tab[0][n] = c;
+  }
+  for (n = 0; n < 256; n++) {
+    c = crc_slice_tab[0][n];
+    for (k = 1; k < 16; k++) {
+      c = crc_slice_tab[0][c & 0xff] ^ (c >> 8);
+      crc_slice_tab[k][n] = c;
+    }
+  }
+}
+
+/* Table kernel:  sixteen independent lookups per 16 bytes of input.  The
+   bytes are combined explicitly, so this works for either byte order. */
+local z_uint4 crc32_slice16(c, buf, len)
+  z_uint4 c;                    /* inverted crc register */
+  ZCONST uch *buf;
+  extent len;
+{
+  z_uint4 w;
+
+  while (len >= 16) {
+    w = c ^ ((z_uint4)buf[0] | ((z_uint4)buf[1] << 8) |
+             ((z_uint4)buf[2] << 16) | ((z_uint4)buf[3] << 24));
+    c = crc_slice_tab[15][w & 0xff] ^ crc_slice_tab[14][(w >> 8) & 0xff] ^
+        crc_slice_tab[13][(w >> 16) & 0xff] ^ crc_slice_tab[12][w >> 24] ^
+        crc_slice_tab[11][buf[4]] ^ crc_slice_tab[10][buf[5]] ^
+        crc_slice_tab[9][buf[6]] ^ crc_slice_tab[8][buf[7]] ^
+        crc_slice_tab[7][buf[8]] ^ crc_slice_tab[6][buf[9]] ^
+        crc_slice_tab[5][buf[10]] ^ crc_slice_tab[4][buf[11]] ^
+        crc_slice_tab[3][buf[12]] ^ crc_slice_tab[2][buf[13]] ^
+        crc_slice_tab[1][buf[14]] ^ crc_slice_tab[0][buf[15]];
+    buf += 16;
+    len -= 16;
+  }
+  while (len--)
+    c = crc_slice_tab[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+  return c;
+}
+
+#ifdef IZ_CRC_PCLMUL
+local z_uint4 crc32_pclmul OF((z_uint4 c, ZCONST uch *buf, extent len));
+
+/* Folding kernel after Gopal et al., "Fast CRC Computation for Generic
+   Polynomials Using PCLMULQDQ Instruction" (Intel, 2009):  four 128-bit
+   lanes are folded forward 64 bytes at a time, then into one lane, then
+   Barrett-reduced to 32 bits.  The constants are the bit-reflected
+   x^n mod P values from the paper.  Inputs shorter than 64 bytes and the
+   tail of less than 16 bytes go through the table kernel. */
+__attribute__((target("pclmul,sse4.1")))
+local z_uint4 crc32_pclmul(c, buf, len)
+  z_uint4 c;                    /* inverted crc register */
+  ZCONST uch *buf;
+  extent len;
+{
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+  extent tail;
+
+  if (len < 64)
+    return crc32_slice16(c, buf, len);
+  tail = len & 15;
+  len -= tail;
+
+  x1 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x00));
+  x2 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x10));
+  x3 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x20));
+  x4 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+  x0 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);      /* k2:k1 */
+  buf += 64;
+  len -= 64;
+
+  /* fold 4 x 128 bits per 64 bytes of input */
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x00));
+    y6 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x10));
+    y7 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x20));
+    y8 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    buf += 64;
+    len -= 64;
+  }
+
+  /* fold the four lanes into one */
+  x0 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);      /* k4:k3 */
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* fold the remaining 16-byte blocks */
+  while (len >= 16) {
+    x2 = _mm_loadu_si128((ZCONST __m128i *)buf);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /* 128 -> 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+  x0 = _mm_set_epi64x(0LL, 0x0163cd6124LL);                 /* k5 */
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);      /* u:P' */
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  c = (z_uint4)_mm_extract_epi32(x1, 1);
+
+  return tail ? crc32_slice16(c, buf, tail) : c;
+}
+#endif /* IZ_CRC_PCLMUL */
+
+#ifdef IZ_CRC_ARMV8
+local z_uint4 crc32_armv8 OF((z_uint4 c, ZCONST uch *buf, extent len));
+
+/* The ARMv8 CRC32X/CRC32B instructions implement exactly this (reflected,
+   non-inverting) update, eight bytes at a time. */
+local z_uint4 crc32_armv8(c, buf, len)
+  z_uint4 c;                    /* inverted crc register */
+  ZCONST uch *buf;
+  extent len;
+{
+  while (len && ((size_t)buf & 7)) {
+    c = __crc32b(c, *buf++);
+    len--;
+  }
+  while (len >= 32) {
+    c = __crc32d(c, *(ZCONST unsigned long long *)(buf + 0));
+    c = __crc32d(c, *(ZCONST unsigned long long *)(buf + 8));
+    c = __crc32d(c, *(ZCONST unsigned long long *)(buf + 16));
+    c = __crc32d(c, *(ZCONST unsigned long long *)(buf + 24));
+    buf += 32;
+    len -= 32;
+  }
+  while (len >= 8) {
+    c = __crc32d(c, *(ZCONST unsigned long long *)buf);
+    buf += 8;
+    len -= 8;
+  }
+  while (len--)
+    c = __crc32b(c, *buf++);
+  return c;
+}
+#endif /* IZ_CRC_ARMV8 */
+
+/* Build the tables and pick the fastest kernel the CPU supports.  A
+   hardware kernel is only used if it agrees with the table kernel on a
+   test pattern covering all of its code paths. */
+local void crc_select_kernel()
+{
+  crc_kernel_t best = crc32_slice16;
+#if (defined(IZ_CRC_PCLMUL) || defined(IZ_CRC_ARMV8))
+  uch pat[256+15];
+  int i;
+#endif
+#ifdef IZ_CRC_PCLMUL
+  unsigned int eax, ebx, ecx, edx;
+#endif
+
+  make_crc_slice_tab();
+#if (defined(IZ_CRC_PCLMUL) || defined(IZ_CRC_ARMV8))
+  for (i = 0; i < (int)sizeof(pat); i++)
+    pat[i] = (uch)(i * 167 + 13);
+#endif
+#ifdef IZ_CRC_ARMV8
+  best = crc32_armv8;
+#endif
+#ifdef IZ_CRC_PCLMUL
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+      (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1))
+    best = crc32_pclmul;
+#endif
+#if (defined(IZ_CRC_PCLMUL) || defined(IZ_CRC_ARMV8))
+  if (best != crc32_slice16 &&
+      (*best)(0xffffffffL, pat+1, sizeof(pat)-1) !=
+      crc32_slice16(0xffffffffL, pat+1, sizeof(pat)-1))
+    best = crc32_slice16;
+#endif
+  crc_kernel = best;
+}
+
+#endif /* IZ_CRCOPTIM_SLICE16 */
+
+
 /* ========================================================================= */
 ulg crc32(crc, buf, len)
     ulg crc;                    /* crc shift register */
@@ -686,10 +955,22 @@ ulg crc32(crc, buf, len)
    Return the current crc in either case. */
 {
   register z_uint4 c;
+#ifndef IZ_CRCOPTIM_SLICE16
   register ZCONST ulg near *crc_32_tab;
+#endif
 
   if (buf == NULL) return 0L;
 
+#ifdef IZ_CRCOPTIM_SLICE16
+#ifdef REENTRANT_THREADS
+  pthread_once(&crc_kernel_once, crc_select_kernel);
+#else
+  if (crc_kernel == NULL)
+    crc_select_kernel();
+#endif
+  c = (*crc_kernel)((z_uint4)crc ^ 0xffffffffL, buf, len);
+  return (ulg)c ^ 0xffffffffL;
+#else /* !IZ_CRCOPTIM_SLICE16 */
   crc_32_tab = get_crc_table();
 
   c = (REV_BE((z_uint4)crc) ^ 0xffffffffL);
@@ -725,8 +1006,96 @@ ulg crc32(crc, buf, len)
   } while (--len);
 
   return REV_BE(c) ^ 0xffffffffL;   /* (instead of ~c for 64-bit machines) */
+#endif /* ?IZ_CRCOPTIM_SLICE16 */
 }
 #endif /* !ASM_CRC */
 #endif /* !CRC_TABLE_ONLY */
 #endif /* !USE_ZLIB */
+
+
+
+#if (defined(TEST_CRC32) && defined(IZ_CRCOPTIM_SLICE16))
+
+/* Self-test and microbenchmark of the crc32() kernels:
+ *   cc -DUNIX -DTEST_CRC32 -O2 crc32.c -o crc32test && ./crc32test [MB]
+ */
+#include <time.h>
+#ifdef main
+#  undef main
+#endif
+
+local z_uint4 crc32_bitwise(c, buf, len)
+  z_uint4 c;
+  ZCONST uch *buf;
+  extent len;
+{
+  int k;
+
+  while (len--) {
+    c ^= *buf++;
+    for (k = 8; k; k--)
+      c = c & 1 ? 0xedb88320L ^ (c >> 1) : c >> 1;
+  }
+  return c;
+}
+
+int main(argc, argv)
+  int argc;
+  char **argv;
+{
+  static struct { ZCONST char *name; crc_kernel_t fn; } kernels[] = {
+    {"slice16", crc32_slice16},
+#ifdef IZ_CRC_PCLMUL
+    {"pclmul", crc32_pclmul},
+#endif
+#ifdef IZ_CRC_ARMV8
+    {"armv8", crc32_armv8},
+#endif
+    {NULL, NULL}
+  };
+  uch *buf;
+  extent size = 1L << 16, len, off;
+  long mb = (argc > 1 ? atol(argv[1]) : 256L);
+  int i, errors = 0;
+  ulg crc;
+  clock_t t;
+
+  if ((buf = (uch *)malloc(size + 16)) == NULL)
+    return 1;
+  for (len = 0; len < size + 16; len++)
+    buf[len] = (uch)(rand() >> 7);
+
+  crc = crc32(0L, (ZCONST uch *)"123456789", 9);
+  printf("crc32(\"123456789\") = %08lx %s\n", crc,
+         crc == 0xcbf43926L ? "ok" : "FAILED");
+  if (crc != 0xcbf43926L)
+    errors++;
+
+  for (i = 0; kernels[i].name != NULL; i++) {
+    int bad = 0;
+
+    if (kernels[i].fn == crc32_slice16 && crc_kernel == NULL)
+      crc_select_kernel();
+    for (off = 0; off < 16; off++)
+      for (len = 0; len < 1100; len += (len < 300 ? 1 : 37))
+        if ((*kernels[i].fn)(0x12345678L ^ (z_uint4)len, buf + off, len) !=
+            crc32_bitwise(0x12345678L ^ (z_uint4)len, buf + off, len))
+          bad++;
+    printf("%-8s %s", kernels[i].name, bad ? "FAILED" : "ok");
+    errors += bad;
+
+    t = clock();
+    crc = 0xffffffffL;
+    for (len = 0; len < (extent)mb * 16; len++)
+      crc = (*kernels[i].fn)((z_uint4)crc, buf, size);
+    t = clock() - t;
+    printf("  %8.0f MB/s  (%08lx)%s\n",
+           t ? (double)mb * CLOCKS_PER_SEC / t : 0.0, crc,
+           kernels[i].fn == crc_kernel ? "  [selected]" : "");
+  }
+  free(buf);
+  return errors ? 1 : 0;
+}
+
+#endif /* TEST_CRC32 && IZ_CRCOPTIM_SLICE16 */
 #endif /* !USE_ZLIB || USE_OWN_CRCTAB */
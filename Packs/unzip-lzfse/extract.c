@@ -19,6 +19,11 @@
              find_compr_idx()
              extract_or_test_entrylist()
              extract_or_test_member()
+             par_extract_member()     (PARALLEL_EXTRACT only)
+             par_wait()               (PARALLEL_EXTRACT only)
+             timed_member()           (TEST_REPORT only)
+             test_report()            (TEST_REPORT only)
+             test_report_free()       (TEST_REPORT only)
              TestExtraField()
              test_compr_eb()
              memextract()
@@ -45,6 +50,13 @@
 #endif
 #include "crc32.h"
 #include "crypt.h"
+#ifdef PARALLEL_EXTRACT
+#  include <sys/wait.h>
+#endif
+#ifdef TEST_REPORT
+#  include <sys/time.h>
+#  include <sys/resource.h>
+#endif
 
 #define GRRDUMP(buf,len) { \
     int i, j; \
@@ -97,6 +109,57 @@ static int extract_or_test_entrylist OF((__GPRO__ unsigned numchunk,
                 int error_in_archive));
 #endif
 static int extract_or_test_member OF((__GPRO));
+#ifdef PARALLEL_EXTRACT
+   static int par_extract_member OF((__GPRO));
+   static void par_relay_output OF((FILE *captured, FILE *to));
+   static int par_wait OF((__GPRO__ int all));
+#endif
+#ifdef TEST_REPORT
+   static ulg tstat_new OF((__GPRO));
+   static double cpu_seconds OF((int who));
+   static double wall_seconds OF((void));
+   static int timed_member OF((__GPRO));
+   static void test_report OF((__GPRO__ double elapsed));
+#  define EXTRACT_OR_TEST_MEMBER(x)  timed_member(x)
+#else
+#  define EXTRACT_OR_TEST_MEMBER(x)  extract_or_test_member(x)
+#endif
+#ifdef CDIR_INDEX
+   typedef struct cdirent {     /* one entry of the central directory index */
+       zoff_t cdoff;            /* file offset of its central header */
+       ZCONST uch *name;        /* its name within the directory image */
+       unsigned len;            /* length of the name (up to a NUL) */
+       int flags;               /* CDX_OPAQUE, CDX_SELECTED */
+       ulg next;                /* next entry in the same hash chain */
+   } cdirent;
+
+#  define CDX_NONE        ((ulg)-1L)   /* end of hash chain */
+#  define CDX_OPAQUE      1     /* do_string() may alter name: always read */
+#  define CDX_SELECTED    2     /* entry may match an include filespec */
+#  define CDX_MIN_ENTRIES 256   /* smaller directories are scanned as before */
+#  define CDX_HASH_SPECS  16    /* hash the names for this many plain specs */
+#  define CDX_SORT_SPECS  64    /* sort them for this many wildcard specs */
+#  ifdef VMSWILD
+#    define CDX_WILDCHARS "%*(\\#"
+#  else
+#    define CDX_WILDCHARS "?*[\\"
+#  endif
+
+   static extent cdx_prefixlen OF((ZCONST char *spec));
+   static int spec_match OF((__GPRO__ ZCONST char *spec, int literal));
+   static ulg cdx_hash OF((ZCONST uch *name, unsigned len, int ic));
+   static int cdx_prefixcmp OF((ZCONST cdirent *e, ZCONST uch *key,
+                                unsigned keylen, int ic));
+   static int Cdecl cdx_namecomp OF((ZCONST zvoid *a, ZCONST zvoid *b));
+   static int Cdecl cdx_namecomp_ic OF((ZCONST zvoid *a, ZCONST zvoid *b));
+   static int cdx_spec_hit OF((__GPRO__ ZCONST cdirent *e, ZCONST char *spec,
+                               unsigned plen));
+   static zoff_t *cdir_index_select OF((__GPRO__ ulg *pnsel));
+#  define MATCH_SPEC(spec, n) \
+     spec_match(__G__ (spec), spec_lit != (char *)NULL && spec_lit[n])
+#else
+#  define MATCH_SPEC(spec, n)  match(G.filename, (spec), uO.C_flag WISEP)
+#endif
 #ifndef SFX
    static int TestExtraField OF((__GPRO__ uch *ef, unsigned ef_len));
    static int test_compr_eb OF((__GPRO__ uch *eb, unsigned eb_size,
@@ -262,6 +325,14 @@ static ZCONST char Far ZeroFilesTested[] =
      "   skipping: %-22s  encrypted (not supported)\n";
 #endif
 
+#ifdef TEST_REPORT
+   static ZCONST char Far TestTimingHdr[] =
+     "\n  cpu time      length  name (-tt)\n  --------  ----------  ----\n";
+   static ZCONST char Far TestTimingLine[] = "%10.3f  %10s  %s\n";
+   static ZCONST char Far TestThroughput[] =
+     "%lu member%s, %s bytes tested in %.3f s:  %.1f MB/s (%.3f s cpu)\n";
+#endif
+
 static ZCONST char Far NoErrInCompData[] =
   "No errors detected in compressed data of %s.\n";
 static ZCONST char Far NoErrInTestedFiles[] =
@@ -356,6 +427,14 @@ int extract_or_test_files(__G)    /* return PK-type error code */
     unsigned num_dirs=0;
     direntry *dirlist=(direntry *)NULL, **sorted_dirlist=(direntry **)NULL;
 #endif
+#ifdef CDIR_INDEX
+    char *spec_lit=NULL;
+    zoff_t *cdsel=NULL;
+    ulg ncdsel=0L, nextsel=0L;
+#endif
+#ifdef TEST_REPORT
+    double test_start=0.0;
+#endif
 
     /*
      * First, two general initializations are applied. These have been moved
@@ -381,6 +460,11 @@ int extract_or_test_files(__G)    /* return PK-type error code */
     }
 #endif /* !SFX || SFX_EXDIR */
 
+#ifdef TEST_REPORT
+    if (uO.tflag > 1)
+        test_start = wall_seconds();
+#endif
+
 /*---------------------------------------------------------------------------
     The basic idea of this function is as follows.  Since the central di-
     rectory lies at the end of the zipfile and the member files lie at the
@@ -418,6 +502,21 @@ int extract_or_test_files(__G)    /* return PK-type error code */
         (xn_matched=(int *)malloc(G.xfilespecs*sizeof(int))) != (int *)NULL)
         for (i = 0;  i < G.xfilespecs;  ++i)
             xn_matched[i] = FALSE;
+#ifdef CDIR_INDEX
+    /* note which filespecs can be compared without the wildcard matcher */
+    if (G.filespecs + G.xfilespecs > 0  &&
+        (spec_lit=(char *)malloc(G.filespecs + G.xfilespecs)) != (char *)NULL)
+    {
+        for (i = 0;  i < G.filespecs;  ++i)
+            spec_lit[i] = (G.pfnames[i][cdx_prefixlen(G.pfnames[i])] == '\0');
+        for (i = 0;  i < G.xfilespecs;  ++i)
+            spec_lit[G.filespecs + i] =
+              (G.pxnames[i][cdx_prefixlen(G.pxnames[i])] == '\0');
+    }
+    /* with include filespecs, visit only the entries that can match */
+    if (!G.process_all_files && G.filespecs > 0)
+        cdsel = cdir_index_select(__G__ &ncdsel);
+#endif
 
 /*---------------------------------------------------------------------------
     Begin main loop over blocks of member files.  We know the entire central
@@ -448,6 +547,22 @@ int extract_or_test_files(__G)    /* return PK-type error code */
         while ((j < DIR_BLKSIZ)) {
             G.pInfo = &G.info[j];
 
+#ifdef CDIR_INDEX
+            if (cdsel != (zoff_t *)NULL) {
+                /* go straight to the next preselected entry */
+                if (nextsel == ncdsel) {
+                    reached_end = TRUE;
+                    break;
+                }
+                if ((error = seek_zipf(__G__ cdsel[nextsel++] - G.extra_bytes))
+                    != PK_OK)
+                {
+                    error_in_archive = error;
+                    reached_end = TRUE;
+                    break;
+                }
+            }
+#endif
             if (readbuf(__G__ G.sig, 4) == 0) {
                 error_in_archive = PK_EOF;
                 reached_end = TRUE;     /* ...so no more left to do */
@@ -550,7 +665,7 @@ int extract_or_test_files(__G)    /* return PK-type error code */
                 else {  /* check if this entry matches an `include' argument */
                     do_this_file = FALSE;
                     for (i = 0; i < G.filespecs; i++)
-                        if (match(G.filename, G.pfnames[i], uO.C_flag WISEP)) {
+                        if (MATCH_SPEC(G.pfnames[i], i)) {
                             do_this_file = TRUE;  /* ^-- ignore case or not? */
                             if (fn_matched)
                                 fn_matched[i] = TRUE;
@@ -559,7 +674,7 @@ int extract_or_test_files(__G)    /* return PK-type error code */
                 }
                 if (do_this_file) {  /* check if this is an excluded file */
                     for (i = 0; i < G.xfilespecs; i++)
-                        if (match(G.filename, G.pxnames[i], uO.C_flag WISEP)) {
+                        if (MATCH_SPEC(G.pxnames[i], G.filespecs + i)) {
                             do_this_file = FALSE; /* ^-- ignore case or not? */
                             if (xn_matched)
                                 xn_matched[i] = TRUE;
@@ -612,14 +727,8 @@ int extract_or_test_files(__G)    /* return PK-type error code */
          * the next batch of files.
          */
 
-#ifdef USE_STRM_INPUT
-        zfseeko(G.zipfd, cd_bufstart, SEEK_SET);
-        G.cur_zipfile_bufstart = zftello(G.zipfd);
-#else /* !USE_STRM_INPUT */
-        G.cur_zipfile_bufstart =
-          zlseek(G.zipfd, cd_bufstart, SEEK_SET);
-#endif /* ?USE_STRM_INPUT */
-        read(G.zipfd, (char *)G.inbuf, INBUFSIZ);  /* been here before... */
+        G.cur_zipfile_bufstart = cd_bufstart;
+        read_zipf(__G__ cd_bufstart, INBUFSIZ);   /* been here before... */
         G.inptr = cd_inptr;
         G.incnt = cd_incnt;
         ++blknum;
@@ -634,6 +743,15 @@ int extract_or_test_files(__G)    /* return PK-type error code */
 
     } /* end while-loop (blocks of files in central directory) */
 
+#ifdef PARALLEL_EXTRACT
+    /* collect the -w workers still running before anything depends on
+     * their output (deferred symlinks, directory attributes, summary) */
+    if (G.parworkers != (parworker *)NULL) {
+        if ((error = par_wait(__G__ TRUE)) > error_in_archive)
+            error_in_archive = error;
+    }
+#endif
+
 /*---------------------------------------------------------------------------
     Process the list of deferred symlink extractions and finish up
     the symbolic links.
@@ -740,6 +858,12 @@ int extract_or_test_files(__G)    /* return PK-type error code */
                   LoadFarString(ExclFilenameNotMatched), G.pxnames[i]));
         free((zvoid *)xn_matched);
     }
+#ifdef CDIR_INDEX
+    if (spec_lit)
+        free((zvoid *)spec_lit);
+    if (cdsel)
+        free((zvoid *)cdsel);
+#endif
 
 /*---------------------------------------------------------------------------
     Now, all locally allocated memory has been released.  When the central
@@ -790,6 +914,10 @@ int extract_or_test_files(__G)    /* return PK-type error code */
                   , num_bad_pwd, (num_bad_pwd==1L)? "":"s"));
 #endif /* CRYPT */
         }
+#ifdef TEST_REPORT
+        if (uO.tflag > 1)
+            test_report(__G__ wall_seconds() - test_start);
+#endif
     }
 
     /* give warning if files not tested or extracted (first condition can still
@@ -820,6 +948,408 @@ int extract_or_test_files(__G)    /* return PK-type error code */
 
 
 
+#ifdef CDIR_INDEX
+
+/******************************/
+/*  Function cdx_prefixlen()  */
+/******************************/
+
+static extent cdx_prefixlen(spec)   /* length of the plain ASCII head */
+    ZCONST char *spec;
+{
+    ZCONST char *p;
+
+    /* a spec that is all plain ASCII compares like strcmp() in match() */
+    for (p = spec;  *p && !(*p & 0x80) && !strchr(CDX_WILDCHARS, *p);  ++p)
+        ;
+    return (extent)(p - spec);
+
+} /* end function cdx_prefixlen() */
+
+
+
+
+
+/***************************/
+/*  Function spec_match()  */
+/***************************/
+
+static int spec_match(__G__ spec, literal)   /* return TRUE if matched */
+    __GDEF
+    ZCONST char *spec;
+    int literal;
+{
+    ZCONST char *s;
+
+    if (!literal)
+        return match(G.filename, spec, uO.C_flag WISEP);
+    if (!uO.C_flag)
+        return (strcmp(G.filename, spec) == 0);
+    for (s = G.filename;  ToLower((uch)*s) == ToLower((uch)*spec);  ++s, ++spec)
+        if (*s == '\0')
+            return TRUE;
+    return FALSE;
+
+} /* end function spec_match() */
+
+
+
+
+
+/*************************/
+/*  Function cdx_hash()  */
+/*************************/
+
+static ulg cdx_hash(name, len, ic)
+    ZCONST uch *name;
+    unsigned len;
+    int ic;
+{
+    ulg h = 2166136261L;        /* FNV-1a */
+
+    while (len--) {
+        h = (h ^ (ulg)(uch)(ic ? ToLower(*name) : *name)) * 16777619L;
+        ++name;
+    }
+    return h;
+
+} /* end function cdx_hash() */
+
+
+
+
+
+/******************************/
+/*  Function cdx_prefixcmp()  */
+/******************************/
+
+static int cdx_prefixcmp(e, key, keylen, ic)
+    ZCONST cdirent *e;
+    ZCONST uch *key;
+    unsigned keylen;
+    int ic;
+/* Compare the first keylen characters of the entry name with key, like
+ * strncmp() (names shorter than key sort before it).  */
+{
+    unsigned i;
+    int d;
+
+    for (i = 0;  i < keylen;  ++i) {
+        if (i == e->len)
+            return -1;
+        d = ic ? (int)(uch)ToLower(e->name[i]) - (int)(uch)ToLower(key[i])
+               : (int)e->name[i] - (int)key[i];
+        if (d)
+            return d;
+    }
+    return 0;
+
+} /* end function cdx_prefixcmp() */
+
+
+
+
+
+/*****************************/
+/*  Function cdx_namecomp()  */
+/*****************************/
+
+static int Cdecl cdx_namecomp(a, b)     /* qsort() order of entry names */
+    ZCONST zvoid *a, *b;
+{
+    ZCONST cdirent *ea = *(ZCONST cdirent **)a;
+    ZCONST cdirent *eb = *(ZCONST cdirent **)b;
+    int d = memcmp(ea->name, eb->name, MIN(ea->len, eb->len));
+
+    return d ? d : (ea->len > eb->len) - (ea->len < eb->len);
+
+} /* end function cdx_namecomp() */
+
+
+
+
+
+/********************************/
+/*  Function cdx_namecomp_ic()  */
+/********************************/
+
+static int Cdecl cdx_namecomp_ic(a, b)  /* same, ignoring case (-C) */
+    ZCONST zvoid *a, *b;
+{
+    ZCONST cdirent *ea = *(ZCONST cdirent **)a;
+    ZCONST cdirent *eb = *(ZCONST cdirent **)b;
+    int d = cdx_prefixcmp(ea, eb->name, eb->len, TRUE);
+
+    return d ? d : (ea->len > eb->len);
+
+} /* end function cdx_namecomp_ic() */
+
+
+
+
+
+/****************************/
+/*  Function cdx_spec_hit()  */
+/****************************/
+
+static int cdx_spec_hit(__G__ e, spec, plen)   /* TRUE if e matches spec */
+    __GDEF
+    ZCONST cdirent *e;
+    ZCONST char *spec;
+    unsigned plen;              /* cdx_prefixlen(spec) */
+{
+    char fn[FILNAMSIZ];
+
+    if (cdx_prefixcmp(e, (ZCONST uch *)spec, plen, uO.C_flag))
+        return FALSE;
+    if (spec[plen] == '\0')
+        return (e->len == plen);
+    memcpy(fn, e->name, e->len);
+    fn[e->len] = '\0';
+    return match(fn, spec, uO.C_flag WISEP);
+
+} /* end function cdx_spec_hit() */
+
+
+
+
+
+/**********************************/
+/*  Function cdir_index_select()  */
+/**********************************/
+
+static zoff_t *cdir_index_select(__G__ pnsel)
+    __GDEF
+    ulg *pnsel;
+/* Walk the whole central directory once, straight from the memory map (or
+ * from one big read), and return the file offsets, in directory order, of
+ * all entries that may match an include filespec, so the regular loop in
+ * extract_or_test_files() only visits those.  Entries whose names
+ * do_string() might still change are always returned.  A few filespecs
+ * are simply compared with each name (plain head first, match() only for
+ * wildcard specs); many plain filespecs are looked up in a hash table of
+ * the names, many wildcard specs in a sorted array of them.  NULL (not
+ * enough entries, a filespec starting with a wildcard, no memory, or a
+ * directory that does not look as expected) means "scan as usual".  The
+ * zipfile is left positioned at the start of the central directory.
+ */
+{
+    ZCONST uch *cd, *p;
+    uch *cdbuf=NULL;
+    cdirent e1, *ent=NULL, *e, **sorted=NULL;
+    ulg *bucket=NULL;
+    unsigned *plens=NULL;
+    zoff_t cdstart, *sel=NULL;
+    zusz_t cdlen, pos, reclen;
+    ulg nent=0L, nalloc, nbuckets=0L, nsorted=0L, nsel=0L, selalloc;
+    ulg h, m, lo, hi;
+    unsigned i, n, fnlen, eflen, cmlen, nlit=0, nwild=0;
+    int ic=uO.C_flag, indexed, ok=FALSE;
+
+    *pnsel = 0L;
+    nalloc = (ulg)G.ecrec.total_entries_central_dir;
+    if (nalloc < CDX_MIN_ENTRIES || uO.L_flag ||
+        (plens = (unsigned *)malloc(G.filespecs * sizeof(unsigned))) == NULL)
+        return (zoff_t *)NULL;
+    for (i = 0;  i < G.filespecs;  ++i) {
+        if ((plens[i] = (unsigned)cdx_prefixlen(G.pfnames[i])) == 0) {
+            free((zvoid *)plens);
+            return (zoff_t *)NULL;      /* nothing to narrow the search */
+        }
+        if (G.pfnames[i][plens[i]] == '\0')
+            ++nlit;
+        else
+            ++nwild;
+    }
+    indexed = (nlit >= CDX_HASH_SPECS || nwild >= CDX_SORT_SPECS);
+
+    /* get hold of the directory:  in place if mapped, else read it in */
+    cdstart = G.cur_zipfile_bufstart + (G.inptr - G.inbuf);
+#ifdef USE_MMAP_INPUT
+    if (G.zipmap != (uch *)NULL) {
+        cd = G.zipmap + cdstart;
+        cdlen = (zusz_t)(G.zipmap_size - cdstart);
+    } else
+#endif
+    {
+        cdlen = G.ecrec.size_central_directory + 4;
+        if ((zusz_t)(unsigned)cdlen != cdlen ||
+            (cdbuf = (uch *)malloc((extent)cdlen)) == (uch *)NULL)
+            goto cleanup;
+        cdlen = readbuf(__G__ (char *)cdbuf, (unsigned)cdlen);
+        cd = cdbuf;
+    }
+    selalloc = 64;
+    if (indexed ?
+        (ent = (cdirent *)malloc(nalloc * sizeof(cdirent))) == NULL :
+        (sel = (zoff_t *)malloc(selalloc * sizeof(zoff_t))) == NULL)
+        goto cleanup;
+
+    for (pos = 0;  pos + 4 + CREC_SIZE <= cdlen;  pos += reclen) {
+        p = cd + (extent)pos;
+        if (memcmp(p, central_hdr_sig, 4))
+            break;
+        fnlen = makeword(p + 4 + C_FILENAME_LENGTH);
+        eflen = makeword(p + 4 + C_EXTRA_FIELD_LENGTH);
+        cmlen = makeword(p + 4 + C_FILE_COMMENT_LENGTH);
+        reclen = 4 + CREC_SIZE + fnlen + eflen + cmlen;
+        if (pos + reclen > cdlen)
+            goto cleanup;       /* truncated:  leave it to the regular loop */
+
+        if (indexed && nent == nalloc) {   /* >64k entries without Zip64 */
+            cdirent *more = (cdirent *)realloc(ent, 2*nalloc*sizeof(cdirent));
+
+            if (more == NULL)
+                goto cleanup;
+            ent = more;
+            nalloc *= 2;
+        }
+        e = indexed ? &ent[nent] : &e1;
+        e->cdoff = cdstart + (zoff_t)pos;
+        e->name = p + 4 + CREC_SIZE;
+        e->flags = 0;
+        if (fnlen >= FILNAMSIZ ||
+            IS_VOLID(makelong(p + 4 + C_EXTERNAL_FILE_ATTRIBUTES)))
+            e->flags = CDX_OPAQUE;
+        for (n = 0;  n < fnlen && e->name[n];  ++n)
+            if (e->name[n] & 0x80)      /* codepage translated */
+                e->flags = CDX_OPAQUE;
+        e->len = n;
+#ifdef UNICODE_SUPPORT
+        p += 4 + CREC_SIZE + fnlen;
+        for (i = 0;  i + EB_HEADSIZE <= eflen;
+             i += EB_HEADSIZE + makeword(p + i + EB_LEN))
+            if (makeword(p + i) == EF_UNIPATH)
+                e->flags = CDX_OPAQUE;
+#endif
+        ++nent;
+        if (indexed)
+            continue;
+
+        /* few filespecs:  decide right away */
+        for (i = 0;  i < G.filespecs && !(e->flags & CDX_OPAQUE);  ++i)
+            if (cdx_spec_hit(__G__ e, G.pfnames[i], plens[i]))
+                break;
+        if (i < G.filespecs || (e->flags & CDX_OPAQUE)) {
+            if (nsel == selalloc) {
+                zoff_t *more = (zoff_t *)realloc(sel,
+                                                 2*selalloc*sizeof(zoff_t));
+
+                if (more == NULL)
+                    goto cleanup;
+                sel = more;
+                selalloc *= 2;
+            }
+            sel[nsel++] = e->cdoff;
+        }
+    }
+    /* the same completeness test as in extract_or_test_files() */
+    if (((zucn_t)nent & (G.ecrec.have_ecr64 ? MASK_ZUCN64 : MASK_ZUCN16))
+        != G.ecrec.total_entries_central_dir)
+        goto cleanup;
+
+    if (indexed) {
+        if (nlit >= CDX_HASH_SPECS) {
+            for (nbuckets = 1;  nbuckets < nent;  nbuckets <<= 1)
+                ;
+            if ((bucket = (ulg *)malloc(nbuckets * sizeof(ulg))) == NULL)
+                goto cleanup;
+            for (h = 0;  h < nbuckets;  ++h)
+                bucket[h] = CDX_NONE;
+            for (m = nent;  m-- > 0;  ) {   /* chains in directory order */
+                h = cdx_hash(ent[m].name, ent[m].len, ic) & (nbuckets - 1);
+                ent[m].next = bucket[h];
+                bucket[h] = m;
+            }
+        }
+        if (nwild >= CDX_SORT_SPECS) {
+            if ((sorted = (cdirent **)malloc(nent * sizeof(cdirent *)))
+                == NULL)
+                goto cleanup;
+            for (m = 0;  m < nent;  ++m)
+                if (!(ent[m].flags & CDX_OPAQUE))
+                    sorted[nsorted++] = &ent[m];
+            qsort((char *)sorted, nsorted, sizeof(cdirent *),
+                  ic ? cdx_namecomp_ic : cdx_namecomp);
+        }
+
+        for (m = 0;  m < nent;  ++m)
+            if (ent[m].flags & CDX_OPAQUE)
+                ent[m].flags |= CDX_SELECTED;
+        for (i = 0;  i < G.filespecs;  ++i) {
+            ZCONST uch *key = (ZCONST uch *)G.pfnames[i];
+
+            if (key[plens[i]] == '\0' && bucket != NULL) {
+                /* plain name:  hash lookup */
+                for (m = bucket[cdx_hash(key, plens[i], ic) & (nbuckets-1)];
+                     m != CDX_NONE;  m = ent[m].next)
+                    if (!(ent[m].flags & CDX_OPAQUE) &&
+                        cdx_spec_hit(__G__ &ent[m], G.pfnames[i], plens[i]))
+                        ent[m].flags |= CDX_SELECTED;
+                continue;
+            }
+            lo = 0;
+            hi = nent;
+            if (key[plens[i]] != '\0' && sorted != NULL) {
+                /* wildcard:  binary search for the names with its head */
+                for (hi = nsorted;  lo < hi;  ) {
+                    m = lo + (hi - lo) / 2;
+                    if (cdx_prefixcmp(sorted[m], key, plens[i], ic) < 0)
+                        lo = m + 1;
+                    else
+                        hi = m;
+                }
+                for (hi = lo;  hi < nsorted &&
+                     !cdx_prefixcmp(sorted[hi], key, plens[i], ic);  ++hi)
+                    ;
+            }
+            for (;  lo < hi;  ++lo) {
+                e = (key[plens[i]] != '\0' && sorted != NULL) ?
+                    sorted[lo] : &ent[lo];
+                if (!(e->flags & (CDX_OPAQUE | CDX_SELECTED)) &&
+                    cdx_spec_hit(__G__ e, G.pfnames[i], plens[i]))
+                    e->flags |= CDX_SELECTED;
+            }
+        }
+        for (m = 0;  m < nent;  ++m)
+            if (ent[m].flags & CDX_SELECTED)
+                ++nsel;
+        if ((sel = (zoff_t *)malloc((nsel + 1) * sizeof(zoff_t))) == NULL)
+            goto cleanup;
+        for (h = 0, m = 0;  m < nent;  ++m)
+            if (ent[m].flags & CDX_SELECTED)
+                sel[h++] = ent[m].cdoff;
+    }
+    *pnsel = nsel;
+    ok = TRUE;
+
+cleanup:
+    if (sorted)
+        free((zvoid *)sorted);
+    if (bucket)
+        free((zvoid *)bucket);
+    if (ent)
+        free((zvoid *)ent);
+    if (cdbuf)
+        free((zvoid *)cdbuf);
+    free((zvoid *)plens);
+    /* back to the start of the central directory for the regular loop */
+    if (seek_zipf(__G__ cdstart - G.extra_bytes) != PK_OK || !ok) {
+        if (sel)
+            free((zvoid *)sel);
+        sel = (zoff_t *)NULL;
+        *pnsel = 0L;
+    }
+    return sel;
+
+} /* end function cdir_index_select() */
+
+#endif /* CDIR_INDEX */
+
+
+
+
+
 /***************************/
 /*  Function store_info()  */
 /***************************/
@@ -1117,14 +1647,8 @@ static int extract_or_test_entrylist(__G__ numchunk,
 
         if (bufstart != G.cur_zipfile_bufstart) {
             Trace((stderr, "debug: bufstart != cur_zipfile_bufstart\n"));
-#ifdef USE_STRM_INPUT
-            zfseeko(G.zipfd, bufstart, SEEK_SET);
-            G.cur_zipfile_bufstart = zftello(G.zipfd);
-#else /* !USE_STRM_INPUT */
-            G.cur_zipfile_bufstart =
-              zlseek(G.zipfd, bufstart, SEEK_SET);
-#endif /* ?USE_STRM_INPUT */
-            if ((G.incnt = read(G.zipfd, (char *)G.inbuf, INBUFSIZ)) <= 0)
+            G.cur_zipfile_bufstart = bufstart;
+            if ((G.incnt = read_zipf(__G__ bufstart, INBUFSIZ)) <= 0)
             {
                 Info(slide, 0x401, ((char *)slide, LoadFarString(OffsetMsg),
                   *pfilnum, "lseek", (long)bufstart));
@@ -1587,7 +2111,16 @@ reprompt:
         G.filenote_slot = i;
 #endif
         G.disk_full = 0;
-        if ((error = extract_or_test_member(__G)) != PK_COOL) {
+#ifdef PARALLEL_EXTRACT
+        /* hand large regular members to a worker process; everything that
+         * needs the terminal or the parent's state stays in line */
+        if (uO.jobs > 1 && !uO.cflag && !G.pInfo->encrypted &&
+            !G.pInfo->symlink && G.lrec.ucsize >= PAR_MIN_UCSIZE)
+            error = par_extract_member(__G);
+        else
+#endif
+            error = EXTRACT_OR_TEST_MEMBER(__G);
+        if (error != PK_COOL) {
             if (error > error_in_archive)
                 error_in_archive = error;       /* ...and keep going */
 #ifdef DLL
@@ -1618,6 +2151,379 @@ reprompt:
 
 
 
+#ifdef PARALLEL_EXTRACT
+
+#define PAR_DISKFULL 0x80   /* worker exit status flag:  disk full */
+
+/***********************************/
+/*  Function par_extract_member()  */
+/***********************************/
+
+static int par_extract_member(__G)    /* return PK-type error code */
+     __GDEF
+{
+    /*
+     * Extract or test the current member in a forked worker process.  The
+     * local header has already been read and G.lrec, G.filename and the
+     * output directories are set up, so the worker only needs a private
+     * zipfile descriptor positioned at the start of the member data (none
+     * at all if the zipfile is mapped); the copy-on-write globals take
+     * care of the rest.  The worker's messages
+     * are captured in temporary files and relayed by par_wait() once it
+     * has finished, so that output of concurrent members does not mix.
+     * Returns the status of any worker reaped to free a slot; the status
+     * of this member is collected later.  Falls back to extracting in
+     * line whenever a worker cannot be started.
+     */
+    int i, r, error=PK_COOL;
+    zoff_t zipoff;
+    FILE *out, *err;
+    pid_t pid;
+
+    if (G.parworkers == (parworker *)NULL) {
+        G.parworkers = (parworker *)calloc(uO.jobs, sizeof(parworker));
+        if (G.parworkers == (parworker *)NULL)
+            return EXTRACT_OR_TEST_MEMBER(__G);
+    }
+
+    /* wait for a free slot */
+    for (;;) {
+        for (i = 0;  i < uO.jobs;  ++i)
+            if (G.parworkers[i].pid == 0)
+                break;
+        if (i < uO.jobs)
+            break;
+        if ((r = par_wait(__G__ FALSE)) > error)
+            error = r;
+        if (G.disk_full > 1)
+            return error;       /* don't start anything new */
+    }
+
+    out = tmpfile();
+    err = (out != (FILE *)NULL ? tmpfile() : (FILE *)NULL);
+#ifdef USE_MMAP_INPUT
+    if (G.zipmap != (uch *)NULL)
+        zipoff = 0;             /* the worker gets a private copy of the map */
+    else
+#endif
+        zipoff = zlseek(G.zipfd, 0, SEEK_CUR);
+    if (err == (FILE *)NULL || zipoff < 0) {
+        if (out != (FILE *)NULL)
+            fclose(out);
+        if (err != (FILE *)NULL)
+            fclose(err);
+        r = EXTRACT_OR_TEST_MEMBER(__G);
+        return (r > error ? r : error);
+    }
+
+    fflush(stdout);     /* or the worker would repeat pending output */
+    fflush(stderr);
+    if ((pid = fork()) == 0) {
+        /* worker:  the inherited descriptor shares its file offset with
+         * the parent, so reopen the zipfile and seek to the same spot */
+        dup2(fileno(out), fileno(stdout));
+        dup2(fileno(err), fileno(stderr));
+        r = PK_COOL;
+#ifdef USE_MMAP_INPUT
+        if (G.zipmap == (uch *)NULL)
+#endif
+        {
+            close(G.zipfd);
+            if (open_input_file(__G) ||
+                zlseek(G.zipfd, zipoff, SEEK_SET) != zipoff)
+                r = PK_ERR;
+        }
+        if (r == PK_COOL)
+            r = extract_or_test_member(__G);
+        if (G.disk_full > 1)
+            r |= PAR_DISKFULL;
+        fflush(stdout);
+        fflush(stderr);
+        _exit(r);
+    }
+    if (pid < 0) {
+        fclose(out);
+        fclose(err);
+        r = EXTRACT_OR_TEST_MEMBER(__G);
+        return (r > error ? r : error);
+    }
+
+    G.parworkers[i].pid = pid;
+    G.parworkers[i].out = out;
+    G.parworkers[i].err = err;
+#ifdef TEST_REPORT
+    G.parworkers[i].tstat = (uO.tflag > 1 ? tstat_new(__G) : NO_TSTAT);
+#endif
+    return error;
+
+} /* end function par_extract_member() */
+
+
+
+
+
+/*********************************/
+/*  Function par_relay_output()  */
+/*********************************/
+
+static void par_relay_output(captured, to)
+    FILE *captured;
+    FILE *to;
+{
+    char buf[512];
+    extent n;
+
+    rewind(captured);
+    while ((n = fread(buf, 1, sizeof(buf), captured)) > 0)
+        fwrite(buf, 1, n, to);
+    fflush(to);
+    fclose(captured);
+
+} /* end function par_relay_output() */
+
+
+
+
+
+/*************************/
+/*  Function par_wait()  */
+/*************************/
+
+static int par_wait(__G__ all)    /* return PK-type error code */
+     __GDEF
+    int all;            /* wait for all workers, not just the next one */
+{
+    int i, busy, status, error, error_in_archive=PK_COOL;
+    pid_t pid;
+#ifdef TEST_REPORT
+    double cpu0;
+#endif
+
+    for (;;) {
+        for (busy = 0, i = 0;  i < uO.jobs;  ++i)
+            if (G.parworkers[i].pid != 0)
+                ++busy;
+        if (busy == 0)
+            break;
+
+#ifdef TEST_REPORT
+        /* the CPU time of a reaped child is added to RUSAGE_CHILDREN */
+        cpu0 = (uO.tflag > 1 ? cpu_seconds(RUSAGE_CHILDREN) : 0.0);
+#endif
+        if ((pid = waitpid((pid_t)-1, &status, 0)) < 0) {
+            if (errno == EINTR)
+                continue;
+            /* lost track of our children (should not happen) */
+            for (i = 0;  i < uO.jobs;  ++i)
+                if (G.parworkers[i].pid != 0) {
+                    fclose(G.parworkers[i].out);
+                    fclose(G.parworkers[i].err);
+                    G.parworkers[i].pid = 0;
+                }
+            return PK_ERR;
+        }
+        for (i = 0;  i < uO.jobs;  ++i)
+            if (G.parworkers[i].pid == pid)
+                break;
+        if (i == uO.jobs)
+            continue;           /* not one of ours */
+#ifdef TEST_REPORT
+        if (uO.tflag > 1 && G.parworkers[i].tstat != NO_TSTAT)
+            G.tstats[G.parworkers[i].tstat].cpu =
+              cpu_seconds(RUSAGE_CHILDREN) - cpu0;
+#endif
+
+        par_relay_output(G.parworkers[i].out, stdout);
+        par_relay_output(G.parworkers[i].err, stderr);
+        G.parworkers[i].pid = 0;
+
+        if (WIFEXITED(status)) {
+            error = WEXITSTATUS(status);
+            if (error & PAR_DISKFULL) {
+                error &= ~PAR_DISKFULL;
+                G.disk_full = 2;
+            }
+        } else
+            error = PK_ERR;     /* killed by a signal */
+        if (error > error_in_archive)
+            error_in_archive = error;
+        if (!all)
+            break;
+    }
+    return error_in_archive;
+
+} /* end function par_wait() */
+
+#endif /* PARALLEL_EXTRACT */
+
+
+
+
+
+#ifdef TEST_REPORT
+
+/**************************/
+/*  Function tstat_new()  */
+/**************************/
+
+static ulg tstat_new(__G)   /* return index of new record, or NO_TSTAT */
+     __GDEF
+{
+    tstat *t;
+    ulg n;
+
+    if (G.tstatcnt == G.tstatmax) {
+        n = (G.tstatmax ? 2 * G.tstatmax : 256);
+        t = (tstat *)realloc(G.tstats, (extent)n * sizeof(tstat));
+        if (t == (tstat *)NULL)
+            return NO_TSTAT;    /* member is left out of the report */
+        G.tstats = t;
+        G.tstatmax = n;
+    }
+    t = &G.tstats[G.tstatcnt];
+    if ((t->name = (char *)malloc(strlen(G.filename) + 1)) == (char *)NULL)
+        return NO_TSTAT;
+    strcpy(t->name, G.filename);
+    t->ucsize = G.lrec.ucsize;
+    t->cpu = 0.0;
+    return G.tstatcnt++;
+
+} /* end function tstat_new() */
+
+
+
+
+
+/****************************/
+/*  Function cpu_seconds()  */
+/****************************/
+
+static double cpu_seconds(who)  /* user + system time of RUSAGE_xxx */
+    int who;
+{
+    struct rusage ru;
+
+    if (getrusage(who, &ru) != 0)
+        return 0.0;
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+
+} /* end function cpu_seconds() */
+
+
+
+
+
+/*****************************/
+/*  Function wall_seconds()  */
+/*****************************/
+
+static double wall_seconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, (struct timezone *)NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+
+} /* end function wall_seconds() */
+
+
+
+
+
+/*****************************/
+/*  Function timed_member()  */
+/*****************************/
+
+static int timed_member(__G)    /* extract_or_test_member(), timed for -tt */
+     __GDEF
+{
+    ulg i;
+    double cpu0;
+    int r;
+
+    if (uO.tflag < 2)
+        return extract_or_test_member(__G);
+
+    i = tstat_new(__G);
+    cpu0 = cpu_seconds(RUSAGE_SELF);
+    r = extract_or_test_member(__G);
+    if (i != NO_TSTAT)
+        G.tstats[i].cpu = cpu_seconds(RUSAGE_SELF) - cpu0;
+    return r;
+
+} /* end function timed_member() */
+
+
+
+
+
+/****************************/
+/*  Function test_report()  */
+/****************************/
+
+static void test_report(__G__ elapsed)
+     __GDEF
+    double elapsed;     /* wall-clock seconds of the whole test run */
+{
+    /*
+     * List the CPU time spent on each member tested (in the worker process
+     * for members handed out with -w), then the throughput of the whole
+     * run:  uncompressed bytes over elapsed time, so that it shows what -w
+     * buys on a machine with several cores.
+     */
+    zusz_t total=0;
+    double cpu=0.0;
+    ulg i;
+
+    if (G.tstatcnt > 0)
+        Info(slide, 0, ((char *)slide, LoadFarString(TestTimingHdr)));
+    for (i = 0;  i < G.tstatcnt;  ++i) {
+        Info(slide, 0, ((char *)slide, LoadFarString(TestTimingLine),
+          G.tstats[i].cpu, FmZofft(G.tstats[i].ucsize, NULL, "u"),
+          FnFilter1(G.tstats[i].name)));
+        total += G.tstats[i].ucsize;
+        cpu += G.tstats[i].cpu;
+    }
+    if (elapsed <= 0.0)
+        elapsed = 1e-6;
+    Info(slide, 0, ((char *)slide, LoadFarString(TestThroughput),
+      G.tstatcnt, (G.tstatcnt == 1L)? "" : "s", FmZofft(total, NULL, "u"),
+      elapsed, (double)total / 1e6 / elapsed, cpu));
+
+    test_report_free(__G);
+
+} /* end function test_report() */
+
+
+
+
+
+/*********************************/
+/*  Function test_report_free()  */
+/*********************************/
+
+void test_report_free(__G)      /* release the -tt records */
+     __GDEF
+{
+    ulg i;
+
+    if (G.tstats != (tstat *)NULL) {
+        for (i = 0;  i < G.tstatcnt;  ++i)
+            free(G.tstats[i].name);
+        free(G.tstats);
+        G.tstats = (tstat *)NULL;
+    }
+    G.tstatcnt = G.tstatmax = 0;
+
+} /* end function test_report_free() */
+
+#endif /* TEST_REPORT */
+
+
+
+
+
 /* wsize is used in extract_or_test_member() and UZbunzip2() */
 #if (defined(DLL) && !defined(NO_SLIDE_REDIR))
 #  define wsize G._wsize    /* wsize is a variable */
@@ -1713,6 +2619,9 @@ static int extract_or_test_member(__G)    /* return PK-type error code */
     Unpack the file.
   ---------------------------------------------------------------------------*/
 
+#ifdef USE_MMAP_INPUT
+    advise_zipf(__G__ G.cur_zipfile_bufstart + (G.inptr - G.inbuf), G.csize);
+#endif
     defer_leftover_input(__G);    /* so NEXTBYTE bounds check will work */
     switch (G.lrec.compression_method) {
         case STORED:
@@ -1981,8 +2890,12 @@ static int extract_or_test_member(__G)    /* return PK-type error code */
             close_outfile(__G);
     }
 #else
-    if (!uO.tflag && !uO.cflag)   /* don't close NULL file or stdout */
+    if (!uO.tflag && !uO.cflag) { /* don't close NULL file or stdout */
+#ifdef BIG_OUTBUF
+        flush_outbuf(__G__ TRUE); /* sets G.disk_full on failure */
+#endif
         close_outfile(__G);
+    }
 #endif
 #endif /* VMS */
 
@@ -2873,21 +3786,17 @@ uzbunzip_cleanup_exit:
 
 #ifdef USE_LZFSE
 
-static inline void *lzfse_reallocf(void *x, size_t s) {
-  void *y = realloc(x, s);
-  if (y == 0) {
-    free(x);
-    return 0;
-  }
-  return y;
-}
-
 int UZlzfse_decode(__G)
 __GDEF
-/* decompress a lzfsed entry using the lzfse routines */
+/* decompress a lzfsed entry using the lzfse streaming decoder */
 {
-    Trace((stderr, "LZFSE in\n"));
-    int retval = 0;
+    int retval = 0;     /* return code: 0 = "no error" */
+    int err = 0;
+    const uint8_t *next_in;
+    size_t avail_in;
+    uint8_t *next_out;
+    size_t avail_out;
+    zusz_t total_out = 0;
 
 #if (defined(DLL) && !defined(NO_SLIDE_REDIR))
     if (G.redirect_slide)
@@ -2896,34 +3805,61 @@ __GDEF
         wsize = WSIZE, redirSlide = slide;
 #endif
 
-    size_t out_allocated = G.lrec.ucsize;
-    uint8_t *out = (uint8_t *)malloc(out_allocated);
-
-    size_t in_allocated = G.lrec.csize;
-    uint8_t *in  = (uint8_t *)malloc(in_allocated);
+    /* one decoder, and its buffers, for all the entries of the archive */
+    if (G.lzfse_dstream == (lzfse_decode_stream *)NULL) {
+        Trace((stderr, "initializing lzfse decoder\n"));
+        if ((G.lzfse_dstream = lzfse_decode_stream_create()) == NULL)
+            return 3;
+    } else
+        lzfse_decode_stream_reset(G.lzfse_dstream);
 
-    size_t offset = 0;
+    next_in = (const uint8_t *)G.inptr;
+    avail_in = G.incnt;
 
-    do {
-        memcpy((uint8_t *)in + offset, (uint8_t*)G.inptr, G.incnt);
-        offset += G.incnt;
+    while (err == 0) {
+#if (defined(DLL) && !defined(NO_SLIDE_REDIR))
+        if (G.redirect_slide) {
+            /* the "window" is the whole caller's buffer:  go on behind
+             * what has been flushed into it so far */
+            redirSlide = G.redirect_buffer + (extent)total_out;
+            wsize = G.redirect_size - (extent)total_out;
+        }
+#endif
+        next_out = (uint8_t *)redirSlide;
+        avail_out = wsize;
+        err = lzfse_decode_stream_process(G.lzfse_dstream, &next_in,
+                                          &avail_in, &next_out, &avail_out);
+        if (err < 0 || (err == 0 && wsize == 0)) {
+            retval = 2;     /* corrupted data, or out of memory */
+            break;
+        }
 
-        if (G.csize > 0) {
-            // copy to in
-            size_t filled_size = fillinbuf(__G);
-            if (filled_size == 0) {
-                // error
-            }
-        } else {
+        /* flush slide[] */
+        if ((retval = FLUSH(wsize - avail_out)) != 0)
             break;
+        total_out += wsize - avail_out;
+        Trace((stderr, "LZFSE: flushing %ld bytes\n",
+          (long)(wsize - avail_out)));
+
+        if (err == 0 && avail_out > 0) {    /* needs more input */
+            if (G.csize <= 0L || fillinbuf(__G) == 0) {
+                /* no end-of-stream block yet, but no more data */
+                retval = 2;
+                break;
+            }
+            next_in = (const uint8_t *)G.inptr;
+            avail_in = G.incnt;
         }
-    } while (1);
+    }
 
-    size_t out_size = lzfse_decode_buffer(out, G.lrec.ucsize, in, in_allocated, NULL);
+    if (retval == 0 && total_out != G.lrec.ucsize) {
+        Trace((stderr, "LZFSE: %s bytes decoded, %s expected\n",
+          FmZofft(total_out, NULL, "u"), FmZofft(G.lrec.ucsize, NULL, "u")));
+        retval = 2;
+    }
 
-    flush(__G__ out, G.lrec.ucsize, 0);
-    free(out);
-    free(in);
+    G.inptr = (uch *)next_in;
+    G.incnt = avail_in;
 
     return retval;
 }
@@ -15,7 +15,14 @@
   of the stuff has to do with opening, closing, reading and/or writing files.
 
   Contains:  open_input_file()
+             map_zipf()               (USE_MMAP_INPUT only)
+             unmap_zipf()             (USE_MMAP_INPUT only)
+             advise_zipf()            (USE_MMAP_INPUT only)
+             read_zipf()
              open_outfile()           (not: VMS, AOS/VS, CMSMVS, MACOS, TANDEM)
+             open_outbuf()            (BIG_OUTBUF only)
+             flush_outbuf()           (BIG_OUTBUF only)
+             zero_block()             (BIG_OUTBUF only)
              undefer_input()
              defer_leftover_input()
              readbuf()
@@ -71,6 +78,12 @@
 #include "crc32.h"
 #include "crypt.h"
 #include "ttyio.h"
+#ifdef USE_MMAP_INPUT
+#  include <sys/mman.h>
+#  if (!defined(MAP_ANONYMOUS) && defined(MAP_ANON))
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+#endif
 
 /* setup of codepage conversion for decryption passwords */
 #if CRYPT
@@ -138,6 +151,15 @@ static int partflush OF((__GPRO__ uch *rawbuf, ulg size, int unshrink));
 static int is_vms_varlen_txt OF((__GPRO__ uch *ef_buf, unsigned ef_len));
 #endif
 static int disk_error OF((__GPRO));
+#ifdef BIG_OUTBUF
+static void open_outbuf OF((__GPRO));
+static int write_outbuf OF((__GPRO__ ZCONST uch *buf, ulg size));
+static int zero_block OF((ZCONST uch *p, extent n));
+#  if (defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE) && \
+       defined(FALLOC_FL_PUNCH_HOLE))
+#    define PREALLOC_OUTFILE    /* fallocate() both ways, see open_outbuf() */
+#  endif
+#endif
 
 
 /****************************/
@@ -260,6 +282,151 @@ int open_input_file(__G)    /* return 1 if open failed */
 
 
 
+#ifdef USE_MMAP_INPUT
+
+/***********************/
+/* Function map_zipf() */
+/***********************/
+
+void map_zipf(__G)    /* map the open zipfile; silently keep read() if not */
+    __GDEF
+{
+    /*
+     *  With the zipfile mapped, read_zipf() does not copy anything:  it
+     *  just points G.inbuf at the requested block of the map, so the
+     *  INBUFSIZ-block bookkeeping of the callers stays valid while the
+     *  read() and lseek() calls go away.  The map is followed by INBUFSIZ
+     *  zero bytes (anonymous memory) since some callers assume a whole
+     *  block behind G.inbuf even at the end of the zipfile.  It is private
+     *  and writable because decryption works in place on G.inbuf.
+     */
+    struct stat st;
+    zoff_t reserve;
+    uch *base;
+
+    G.zipmap = (uch *)NULL;
+    if (fstat(G.zipfd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return;
+    reserve = (zoff_t)st.st_size + INBUFSIZ + 4;
+    if ((zoff_t)(size_t)reserve != reserve)
+        return;                 /* too large for the address space */
+
+    base = (uch *)mmap(NULL, (size_t)reserve, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (uch *)MAP_FAILED)
+        return;
+    if (mmap(base, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, G.zipfd, 0) == MAP_FAILED) {
+        munmap(base, (size_t)reserve);
+        return;
+    }
+
+    G.zipmap = base;
+    G.zipmap_size = (zoff_t)st.st_size;
+    G.zipmap_pos = 0;
+    G.inbuf_alloc = G.inbuf;
+
+} /* end function map_zipf() */
+
+
+
+
+
+/*************************/
+/* Function unmap_zipf() */
+/*************************/
+
+void unmap_zipf(__G)
+    __GDEF
+{
+    if (G.zipmap != (uch *)NULL) {
+        munmap(G.zipmap, (size_t)(G.zipmap_size + INBUFSIZ + 4));
+        G.zipmap = (uch *)NULL;
+        G.inbuf = G.inbuf_alloc;
+        G.inptr = G.inbuf;
+        G.incnt = 0;
+    }
+
+} /* end function unmap_zipf() */
+
+
+
+
+
+/**************************/
+/* Function advise_zipf() */
+/**************************/
+
+void advise_zipf(__G__ offset, len)   /* about to read a member sequentially */
+    __GDEF
+    zoff_t offset;
+    zoff_t len;
+{
+    zoff_t start;
+
+    if (G.zipmap == (uch *)NULL || offset < 0 || offset >= G.zipmap_size)
+        return;
+    if (len > G.zipmap_size - offset)
+        len = G.zipmap_size - offset;
+    start = offset - offset % (zoff_t)sysconf(_SC_PAGESIZE);
+    if (offset + len > start)
+        madvise(G.zipmap + start, (size_t)(offset + len - start),
+                MADV_SEQUENTIAL);
+
+} /* end function advise_zipf() */
+
+#endif /* USE_MMAP_INPUT */
+
+
+
+
+
+/************************/
+/* Function read_zipf() */
+/************************/
+
+int read_zipf(__G__ offset, size)   /* return number of bytes in G.inbuf */
+    __GDEF
+    zoff_t offset;        /* where to read from, or -1 to read on */
+    unsigned size;
+{
+    /*
+     *  Fill G.inbuf with up to size bytes of the zipfile, like read() on
+     *  the zipfile descriptor after an optional seek to offset.  The
+     *  caller maintains G.cur_zipfile_bufstart.  Returns what read()
+     *  would:  the byte count, 0 at end of file, or -1 on error.
+     */
+#ifdef USE_MMAP_INPUT
+    if (G.zipmap != (uch *)NULL) {
+        zoff_t left;
+
+        if (offset >= 0)
+            G.zipmap_pos = offset;
+        if ((left = G.zipmap_size - G.zipmap_pos) <= 0)
+            return 0;
+        if ((zoff_t)size > left)
+            size = (unsigned)left;
+        G.inbuf = G.zipmap + G.zipmap_pos;
+        G.zipmap_pos += size;
+        return (int)size;
+    }
+#endif /* USE_MMAP_INPUT */
+
+    if (offset >= 0) {
+#ifdef USE_STRM_INPUT
+        if (zfseeko(G.zipfd, offset, SEEK_SET) != 0)
+#else
+        if (zlseek(G.zipfd, offset, SEEK_SET) != offset)
+#endif
+            return -1;
+    }
+    return read(G.zipfd, (char *)G.inbuf, size);
+
+} /* end function read_zipf() */
+
+
+
+
 #if (!defined(VMS) && !defined(AOS_VS) && !defined(CMS_MVS) && !defined(MACOS))
 #if (!defined(TANDEM))
 
@@ -493,12 +660,200 @@ int open_outfile(__G)           /* return 1 if fail */
 #ifdef OS2_W32
     /* preallocate the final file size to prevent file fragmentation */
     SetFileSize(G.outfile, G.lrec.ucsize);
+#endif
+#ifdef BIG_OUTBUF
+    open_outbuf(__G);
 #endif
     return 0;
 
 } /* end function open_outfile() */
 
 #endif /* !TANDEM */
+
+
+
+
+#ifdef BIG_OUTBUF
+
+/**************************/
+/* Function open_outbuf() */
+/**************************/
+
+static void open_outbuf(__G)    /* set up output buffering for G.outfile */
+    __GDEF
+{
+    z_stat st;
+
+    G.wbufcnt = 0;
+    G.wbufpos = 0;
+    G.wbufhole = FALSE;
+    G.wbufsparse = FALSE;
+    G.wbufprealloc = FALSE;
+
+    /* the buffer is kept for all following files; without it, flush()
+     * simply falls back to one write() call per slide */
+    if (G.wbuf == (uch *)NULL &&
+        (G.wbuf = (uch *)malloc(WBUFSIZ)) == (uch *)NULL)
+        return;
+
+    /* holes only make sense in regular files; a device or fifo (an
+     * existing name is not always unlinked first) must get every byte */
+    if (zfstat(fileno(G.outfile), &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+    G.wbufsparse = TRUE;
+
+#ifdef PREALLOC_OUTFILE
+    /* Reserve the space of large binary files in one go, which keeps
+     * them from fragmenting.  FALLOC_FL_KEEP_SIZE leaves the file size
+     * alone, so a bad ucsize in the zipfile cannot show up as garbage at
+     * the end of the file; flush_outbuf() gives back the reserved space
+     * of zero blocks and of whatever the file turned out not to need.
+     * Filesystems without fallocate() support just return an error. */
+    if (!G.pInfo->textmode && G.lrec.ucsize > WBUFSIZ &&
+        (zoff_t)G.lrec.ucsize > 0 &&
+        fallocate(fileno(G.outfile), FALLOC_FL_KEEP_SIZE, (zoff_t)0,
+                  (zoff_t)G.lrec.ucsize) == 0)
+        G.wbufprealloc = TRUE;
+#endif
+
+} /* end function open_outbuf() */
+
+
+
+
+
+/***************************/
+/* Function write_outbuf() */
+/***************************/
+
+static int write_outbuf(__G__ buf, size)   /* returns PK error codes */
+    __GDEF
+    ZCONST uch *buf;
+    ulg size;
+{
+    extent n;
+    int r;
+
+    /* the buffer is only ever flushed when completely full (or at the
+     * end of the file), so the blocks checked by flush_outbuf() are
+     * aligned to HOLE_BLKSIZ in the output file */
+    while (size > 0) {
+        n = (extent)(WBUFSIZ - G.wbufcnt);
+        if ((ulg)n > size)
+            n = (extent)size;
+        memcpy(G.wbuf + G.wbufcnt, buf, n);
+        G.wbufcnt += n;
+        G.wbufpos += n;
+        buf += n;
+        size -= n;
+        if (G.wbufcnt == WBUFSIZ && (r = flush_outbuf(__G__ FALSE)) != PK_OK)
+            return r;
+    }
+    return PK_OK;
+
+} /* end function write_outbuf() */
+
+
+
+
+
+/*************************/
+/* Function zero_block() */
+/*************************/
+
+static int zero_block(p, n)     /* return TRUE if p[0..n-1] are all zero */
+    ZCONST uch *p;
+    extent n;
+{
+    /* p[0] == 0 and every byte equals the one before it */
+    return (p[0] == 0 && (n == 1 || memcmp(p, p + 1, n - 1) == 0));
+
+} /* end function zero_block() */
+
+
+
+
+
+/***************************/
+/* Function flush_outbuf() */
+/***************************/
+
+int flush_outbuf(__G__ final)   /* returns PK error codes */
+    __GDEF
+    int final;                  /* TRUE at the end of the file */
+{
+    /*
+     *  Write out the contents of G.wbuf.  Runs of HOLE_BLKSIZ blocks that
+     *  contain nothing but zeros are not written but skipped with lseek(),
+     *  which leaves holes in the file on filesystems that know about
+     *  sparse files (and costs nothing on the others, which fill in the
+     *  zeros themselves).  If the file ends in such a hole, the final call
+     *  sets its size with ftruncate().
+     */
+    ZCONST uch *p, *run, *end;
+    extent n;
+    int fd;
+
+    if (G.wbuf == (uch *)NULL || G.disk_full) {
+        G.wbufcnt = 0;
+        return G.disk_full ? PK_DISK : PK_OK;
+    }
+    fd = fileno(G.outfile);
+    run = p = G.wbuf;
+    end = G.wbuf + G.wbufcnt;
+
+    while (p < end) {
+        n = ((extent)(end - p) < HOLE_BLKSIZ) ? (extent)(end - p) : HOLE_BLKSIZ;
+        if (!G.wbufsparse || !zero_block(p, n)) {
+            p += n;
+            continue;
+        }
+        if (p > run) {
+            if (WriteError(run, (extent)(p - run), G.outfile))
+                return disk_error(__G);
+        }
+        run = p;
+        do {
+            p += n;
+            n = ((extent)(end - p) < HOLE_BLKSIZ) ? (extent)(end - p)
+                                                  : HOLE_BLKSIZ;
+        } while (p < end && zero_block(p, n));
+#ifdef PREALLOC_OUTFILE
+        /* give back the reserved blocks; at least ext4 ignores a hole
+         * punched beyond the end of the file, so extend the file over
+         * the hole first (failure only costs disk space) */
+        if (G.wbufprealloc &&
+            ftruncate(fd, G.wbufpos - (zoff_t)(end - p)) == 0)
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      G.wbufpos - (zoff_t)(end - run), (zoff_t)(p - run));
+#endif
+        if (zlseek(fd, (zoff_t)(p - run), SEEK_CUR) == (zoff_t)-1)
+            return disk_error(__G);
+        G.wbufhole = TRUE;
+        run = p;
+    }
+    if (p > run) {
+        if (WriteError(run, (extent)(p - run), G.outfile))
+            return disk_error(__G);
+        G.wbufhole = FALSE;
+    }
+    G.wbufcnt = 0;
+
+    if (final) {
+        if (G.wbufhole && ftruncate(fd, G.wbufpos) != 0)
+            return disk_error(__G);
+#ifdef PREALLOC_OUTFILE
+        if (G.wbufprealloc && G.wbufpos < (zoff_t)G.lrec.ucsize)
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      G.wbufpos, (zoff_t)G.lrec.ucsize - G.wbufpos);
+#endif
+        G.wbufhole = FALSE;
+    }
+    return PK_OK;
+
+} /* end function flush_outbuf() */
+
+#endif /* BIG_OUTBUF */
 #endif /* !VMS && !AOS_VS && !CMS_MVS && !MACOS */
 
 
@@ -581,7 +936,7 @@ unsigned readbuf(__G__ buf, size)   /* return number of bytes read into buf */
     n = size;
     while (size) {
         if (G.incnt <= 0) {
-            if ((G.incnt = read(G.zipfd, (char *)G.inbuf, INBUFSIZ)) == 0)
+            if ((G.incnt = read_zipf(__G__ -1, INBUFSIZ)) == 0)
                 return (n-size);
             else if (G.incnt < 0) {
                 /* another hack, but no real harm copying same thing twice */
@@ -624,7 +979,7 @@ int readbyte(__G)   /* refill inbuf and return a byte if available, else EOF */
         return EOF;
     }
     if (G.incnt <= 0) {
-        if ((G.incnt = read(G.zipfd, (char *)G.inbuf, INBUFSIZ)) == 0) {
+        if ((G.incnt = read_zipf(__G__ -1, INBUFSIZ)) == 0) {
             return EOF;
         } else if (G.incnt < 0) {  /* "fail" (abort, retry, ...) returns this */
             /* another hack, but no real harm copying same thing twice */
@@ -676,8 +1031,7 @@ int readbyte(__G)   /* refill inbuf and return a byte if available, else EOF */
 int fillinbuf(__G) /* like readbyte() except returns number of bytes in inbuf */
     __GDEF
 {
-    if (G.mem_mode ||
-                  (G.incnt = read(G.zipfd, (char *)G.inbuf, INBUFSIZ)) <= 0)
+    if (G.mem_mode || (G.incnt = read_zipf(__G__ -1, INBUFSIZ)) <= 0)
         return 0;
     G.cur_zipfile_bufstart += INBUFSIZ;  /* always starts on a block boundary */
     G.inptr = G.inbuf;
@@ -743,12 +1097,7 @@ int seek_zipf(__G__ abs_offset)
           "fpos_zip: abs_offset = %s, G.extra_bytes = %s\n",
           FmZofft(abs_offset, NULL, NULL),
           FmZofft(G.extra_bytes, NULL, NULL)));
-#ifdef USE_STRM_INPUT
-        zfseeko(G.zipfd, bufstart, SEEK_SET);
-        G.cur_zipfile_bufstart = zftello(G.zipfd);
-#else /* !USE_STRM_INPUT */
-        G.cur_zipfile_bufstart = zlseek(G.zipfd, bufstart, SEEK_SET);
-#endif /* ?USE_STRM_INPUT */
+        G.cur_zipfile_bufstart = bufstart;
         Trace((stderr,
           "       request = %s, (abs+extra) = %s, inbuf_offset = %s\n",
           FmZofft(request, NULL, NULL),
@@ -757,7 +1106,7 @@ int seek_zipf(__G__ abs_offset)
         Trace((stderr, "       bufstart = %s, cur_zipfile_bufstart = %s\n",
           FmZofft(bufstart, NULL, NULL),
           FmZofft(G.cur_zipfile_bufstart, NULL, NULL)));
-        if ((G.incnt = read(G.zipfd, (char *)G.inbuf, INBUFSIZ)) <= 0)
+        if ((G.incnt = read_zipf(__G__ bufstart, INBUFSIZ)) <= 0)
             return(PK_EOF);
         G.incnt -= (int)inbuf_offset;
         G.inptr = G.inbuf + (int)inbuf_offset;
@@ -865,6 +1214,11 @@ static int partflush(__G__ rawbuf, size, unshrink)
             writeToMemory(__G__ rawbuf, (extent)size);
 #endif
         } else
+#endif
+#ifdef BIG_OUTBUF
+        if (!uO.cflag && G.wbuf != (uch *)NULL)
+            return write_outbuf(__G__ rawbuf, size);
+        else
 #endif
         if (!uO.cflag && WriteError(rawbuf, size, G.outfile))
             return disk_error(__G);
@@ -1642,6 +1996,13 @@ void handler(signal)   /* upon interrupt, turn on echo and exit cleanly */
 
 #ifdef SIGBUS
     if (signal == SIGBUS) {
+#ifdef USE_MMAP_INPUT
+        /* the mapped zipfile was truncated under us */
+        if (G.zipmap != (uch *)NULL)
+            Info(slide, 0x421, ((char *)slide, LoadFarString(ZipfileCorrupt),
+              "zipfile shrank while being read"));
+        else
+#endif
         Info(slide, 0x421, ((char *)slide, LoadFarString(ZipfileCorrupt),
           "bus error"));
         DESTROYGLOBALS();
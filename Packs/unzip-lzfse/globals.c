@@ -43,7 +43,7 @@ ZCONST char *fnames[2] = {"*", NULL};   /* default filenames vector */
 #else /* REENTRANT */
 
 #  ifndef USETHREADID
-     Uz_Globs *GG;
+     IZ_THREAD_LOCAL Uz_Globs *GG;
 #  else /* USETHREADID */
 #    define THREADID_ENTRIES  0x40
 
@@ -213,9 +213,9 @@ typedef struct Globals {
 # ifndef NO_SLIDE_REDIR
      uch *redirect_sldptr;         /* head of decompression slide buffer */
 # endif
-# ifdef OS2DLL
      cbList(processExternally);    /* call-back list */
-# endif
+     UzpStreamFn *redirect_fn;     /* UzpStreamEntry() callback, or NULL */
+     zvoid *redirect_arg;          /* its first argument */
 #endif /* DLL */
 
     char **pfnames;
@@ -254,6 +254,12 @@ typedef struct Globals {
     int       zipfd;                /* zipfile file handle */
 #endif
     zoff_t    ziplen;
+#ifdef USE_MMAP_INPUT
+    uch       *zipmap;              /* mapped zipfile (or NULL), see read_zipf */
+    zoff_t    zipmap_size;
+    zoff_t    zipmap_pos;           /* like the file offset of zipfd */
+    uch       *inbuf_alloc;         /* own inbuf while inbuf points into map */
+#endif
     zoff_t    cur_zipfile_bufstart; /* extract_or_test, readbuf, ReadByte */
     zoff_t    extra_bytes;          /* used in unzip.c, misc.c */
     uch       *extra_field;         /* Unix, VMS, Mac, OS/2, Acorn, ... */
@@ -280,11 +286,27 @@ typedef struct Globals {
     slinkentry *slink_head;        /* pointer to head of symlinks list */
     slinkentry *slink_last;        /* pointer to last entry in symlinks list */
 #endif
+#ifdef PARALLEL_EXTRACT
+    parworker *parworkers;         /* uO.jobs slots for -w worker processes */
+#endif
+#ifdef TEST_REPORT
+    tstat    *tstats;              /* -tt: timing of each member tested */
+    ulg      tstatcnt;             /* records used */
+    ulg      tstatmax;             /* records allocated */
+#endif
 #ifdef NOVELL_BUG_FAILSAFE
     int      dne;                  /* true if stat() says file doesn't exist */
 #endif
 
     FILE     *outfile;
+#ifdef BIG_OUTBUF
+    uch      *wbuf;                /* binary output waiting for write(), */
+    extent   wbufcnt;              /*  see flush_outbuf() in fileio.c */
+    zoff_t   wbufpos;              /* outfile size including wbuf contents */
+    int      wbufsparse;           /* regular outfile:  skip zero blocks */
+    int      wbufhole;             /* last block flushed was skipped */
+    int      wbufprealloc;         /* space was reserved by fallocate() */
+#endif
     uch      *outbuf;
     uch      *realbuf;
 
@@ -350,6 +372,10 @@ typedef struct Globals {
     unsigned bk;              /* inflate static: bits count in bit buffer */
 #endif /* ?USE_ZLIB */
 
+#ifdef USE_LZFSE
+    lzfse_decode_stream *lzfse_dstream;  /* UZlzfse_decode: reused decoder */
+#endif
+
 #ifndef FUNZIP
     /* cylindric buffer space for formatting zoff_t values (fileio static) */
     char fzofft_buf[FZOFFT_NUM][FZOFFT_LEN];
@@ -425,7 +451,7 @@ extern char end_centloc64_sig[4];
 #    define DESTROYGLOBALS()  do {free_G_buffers(pG); \
                                   deregisterGlobalPointer(pG);} while (0)
 #  else
-     extern Uz_Globs          *GG;
+     extern IZ_THREAD_LOCAL Uz_Globs *GG;
 #    define GETGLOBALS()      Uz_Globs *pG = GG
 #    define DESTROYGLOBALS()  do {free_G_buffers(pG); free(pG);} while (0)
 #  endif /* ?USETHREADID */
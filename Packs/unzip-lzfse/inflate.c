@@ -888,6 +888,36 @@ unsigned bk;                    /* bits in bit buffer */
 #define DUMPBITS(n) {b>>=(n);k-=(n);}
 
 
+/*
+   Where the bit buffer is 64 bits wide, inflate_codes() runs a fast inner
+   loop as long as the input buffer holds at least IFAST_INSLACK more
+   bytes.  FASTREFILL tops b up to 56..63 bits with a single unaligned
+   8-byte load and consumes only the whole bytes that fit; the bits above
+   k then already hold the next unconsumed input bits, so ORing the same
+   bytes in again on the next refill is harmless.  With at least 56 bits
+   on hand, a literal/length code plus its extra bits never need an EOF
+   check; one more refill covers the distance code.  Near the end of the
+   buffered input the byte-at-a-time NEEDBITS() loop takes over again.
+   Define NO_INFLATE_FAST64 to disable the fast loop.
+ */
+#if (!defined(FUNZIP) && !defined(NO_INFLATE_FAST64))
+#  if (defined(__LP64__) || defined(_LP64))
+#    if (!defined(DLL) || defined(NO_SLIDE_REDIR))
+#      define INFLATE_FAST64
+#    endif
+#  endif
+#endif
+
+#ifdef INFLATE_FAST64
+#  define IFAST_INSLACK 16      /* two refills of up to 7 bytes + 8 read */
+#  define LOAD64LE(p) ((ulg)(p)[0] | ((ulg)(p)[1]<<8) | \
+    ((ulg)(p)[2]<<16) | ((ulg)(p)[3]<<24) | ((ulg)(p)[4]<<32) | \
+    ((ulg)(p)[5]<<40) | ((ulg)(p)[6]<<48) | ((ulg)(p)[7]<<56))
+#  define FASTREFILL {b|=LOAD64LE(G.inptr)<<k;\
+    G.inptr+=(63-k)>>3;G.incnt-=(int)((63-k)>>3);k|=56;}
+#endif
+
+
 /*
    Huffman code decoding is performed using a multi-level table lookup.
    The fastest way to decode is to simply build a lookup table whose
@@ -958,6 +988,93 @@ unsigned bl, bd;        /* number of bits decoded by tl[] and td[] */
   md = mask_bits[bd];
   while (1)                     /* do until end of block */
   {
+#ifdef INFLATE_FAST64
+    if (G.incnt >= IFAST_INSLACK)
+    {
+      do {
+        FASTREFILL
+        t = tl + ((unsigned)b & ml);
+        DUMPBITS(t->b)
+        while ((e = t->e) > 32) {
+          if (IS_INVALID_CODE(e))
+            return 1;
+          t = t->v.t + ((unsigned)b & mask_bits[e & 31]);
+          DUMPBITS(t->b)
+        }
+
+        if (e == 32)            /* then it's a literal */
+        {
+          redirSlide[w++] = (uch)t->v.n;
+          if (w == wsize)
+          {
+            if ((retval = FLUSH(w)) != 0) goto cleanup_and_exit;
+            w = 0;
+          }
+          continue;
+        }
+
+        if (e == 31)            /* it's the EOB signal */
+        {
+          b &= ((ulg)1 << k) - 1;   /* drop the lookahead above k */
+          goto cleanup_decode;
+        }
+
+        /* get length of block to copy */
+        n = t->v.n + ((unsigned)b & mask_bits[e]);
+        DUMPBITS(e)
+
+        /* decode distance of block to copy */
+        if (k < 32)
+          FASTREFILL
+        t = td + ((unsigned)b & md);
+        DUMPBITS(t->b)
+        while ((e = t->e) >= 32) {
+          if (IS_INVALID_CODE(e))
+            return 1;
+          t = t->v.t + ((unsigned)b & mask_bits[e & 31]);
+          DUMPBITS(t->b)
+        }
+        d = (unsigned)w - t->v.n - ((unsigned)b & mask_bits[e]);
+        DUMPBITS(e)
+
+        /* do the copy; matches that neither wrap around nor reach the
+           end of the window are copied in 8-byte pieces when the
+           distance allows it */
+        d &= (unsigned)(wsize-1);
+        if (d < (unsigned)w && n < wsize - w)
+        {
+          uch *p = redirSlide + (unsigned)w;
+          uch *q = redirSlide + d;
+
+          w += n;
+          if ((unsigned)(p - q) >= 8) {
+            for (; n >= 8; n -= 8, p += 8, q += 8)
+              memcpy(p, q, 8);
+          }
+          while (n--)
+            *p++ = *q++;
+        }
+        else
+        {
+          do {
+            e = (unsigned)(wsize - (d > (unsigned)w ? (UINT_D64)d : w));
+            if ((UINT_D64)e > n) e = (unsigned)n;
+            n -= e;
+            do {
+              redirSlide[w++] = redirSlide[d++];
+            } while (--e);
+            if (w == wsize)
+            {
+              if ((retval = FLUSH(w)) != 0) goto cleanup_and_exit;
+              w = 0;
+            }
+            d &= (unsigned)(wsize-1);
+          } while (n);
+        }
+      } while (G.incnt >= IFAST_INSLACK);
+      b &= ((ulg)1 << k) - 1;       /* back to the NEEDBITS() invariant */
+    }
+#endif /* INFLATE_FAST64 */
     NEEDBITS(bl)
     t = tl + ((unsigned)b & ml);
     while (1) {
@@ -247,12 +247,16 @@ int list_files(__G)    /* return PK-type error code */
 
         if (G.process_all_files || do_this_file) {
 
-#ifdef OS2DLL
-            /* this is used by UzpFileTree() to allow easy processing of lists
-             * of zip directory contents */
+#ifdef DLL
+            /* this is used by UzpFileTree() and UzpListArchive() to allow
+             * easy processing of lists of zip directory contents */
             if (G.processExternally) {
-                if ((G.processExternally)(G.filename, &G.crec))
+                Uzp_cdir_Rec crec;
+
+                fill_cdir_rec(__G__ &crec);
+                if ((G.processExternally)(G.filename, &crec))
                     break;
+                SKIP_(G.crec.file_comment_length)
                 ++members;
             } else {
 #endif
@@ -422,7 +426,7 @@ int list_files(__G)    /* return PK-type error code */
                 ++tot_aclfiles;
             }
 #endif
-#ifdef OS2DLL
+#ifdef DLL
             } /* end of "if (G.processExternally) {...} else {..." */
 #endif
         } else {        /* not listing this file */
@@ -436,7 +440,7 @@ int list_files(__G)    /* return PK-type error code */
   ---------------------------------------------------------------------------*/
 
     if (uO.qflag < 2
-#ifdef OS2DLL
+#ifdef DLL
                      && !G.processExternally
 #endif
                                             ) {
@@ -13,6 +13,7 @@
   This file contains the top-level routines for processing multiple zipfiles.
 
   Contains:  process_zipfiles()
+             init_sigs()
              free_G_buffers()
              do_seekable()
              file_size()
@@ -21,6 +22,7 @@
              find_ecrec()
              process_zip_cmmnt()
              process_cdir_file_hdr()
+             process_cdir_byte_hdr()
              get_cdir_ent()
              process_local_file_hdr()
              getZip64Data()
@@ -55,7 +57,8 @@ static int    rec_find           OF((__GPRO__ zoff_t, char *, int));
 static int    find_ecrec64       OF((__GPRO__ zoff_t searchlen));
 static int    find_ecrec         OF((__GPRO__ zoff_t searchlen));
 static int    process_zip_cmmnt  OF((__GPRO));
-static int    get_cdir_ent       OF((__GPRO));
+static void   init_sigs          OF((void));
+static void   get_cdir_ent       OF((__GPRO__ ZCONST uch *byterec));
 #ifdef IZ_HAVE_UXUIDGID
 static int    read_ux3_value     OF((ZCONST uch *dbuf, unsigned uidgid_sz,
                                      ulg *p_uidgid));
@@ -268,13 +271,15 @@ int process_zipfiles(__G)    /* return PK-type error code */
 #endif /* 0 */
 
     /* finish up initialization of magic signature strings */
-    local_hdr_sig[0]  /* = extd_local_sig[0] */ =       /* ASCII 'P', */
-      central_hdr_sig[0] = end_central_sig[0] =         /* not EBCDIC */
-      end_centloc64_sig[0] = end_central64_sig[0] = 0x50;
+#ifdef REENTRANT_THREADS
+    {
+        static pthread_once_t sigs_once = PTHREAD_ONCE_INIT;
 
-    local_hdr_sig[1]  /* = extd_local_sig[1] */ =       /* ASCII 'K', */
-      central_hdr_sig[1] = end_central_sig[1] =         /* not EBCDIC */
-      end_centloc64_sig[1] = end_central64_sig[1] = 0x4B;
+        pthread_once(&sigs_once, init_sigs);    /* read by other threads */
+    }
+#else
+    init_sigs();
+#endif
 
 /*---------------------------------------------------------------------------
     Make sure timezone info is set correctly; localtime() returns GMT on some
@@ -313,9 +318,17 @@ int process_zipfiles(__G)    /* return PK-type error code */
    should be added to the system specifc configuration section.  */
 #if (!defined(T20_VMS) && !defined(MACOS) && !defined(RISCOS) && !defined(QDOS))
 #if (!defined(BSD) && !defined(MTS) && !defined(CMS_MVS) && !defined(TANDEM))
+#ifdef REENTRANT_THREADS
+    {
+        static pthread_once_t tz_once = PTHREAD_ONCE_INIT;
+
+        pthread_once(&tz_once, tzset);  /* not while another thread reads */
+    }
+#else
     tzset();
 #endif
 #endif
+#endif
 
 /* Initialize UnZip's built-in pseudo hard-coded "ISO <--> OEM" translation,
    depending on the detected codepage setup.  */
@@ -564,6 +577,26 @@ int process_zipfiles(__G)    /* return PK-type error code */
 
 
 
+/************************/
+/* Function init_sigs() */
+/************************/
+
+static void init_sigs()
+{
+    local_hdr_sig[0]  /* = extd_local_sig[0] */ =       /* ASCII 'P', */
+      central_hdr_sig[0] = end_central_sig[0] =         /* not EBCDIC */
+      end_centloc64_sig[0] = end_central64_sig[0] = 0x50;
+
+    local_hdr_sig[1]  /* = extd_local_sig[1] */ =       /* ASCII 'K', */
+      central_hdr_sig[1] = end_central_sig[1] =         /* not EBCDIC */
+      end_centloc64_sig[1] = end_central64_sig[1] = 0x4B;
+
+} /* end function init_sigs() */
+
+
+
+
+
 /*****************************/
 /* Function free_G_buffers() */
 /*****************************/
@@ -580,6 +613,30 @@ void free_G_buffers(__G)     /* releases all memory allocated in global vars */
 #endif
 
     inflate_free(__G);
+#ifdef USE_LZFSE
+    if (G.lzfse_dstream != (lzfse_decode_stream *)NULL) {
+        lzfse_decode_stream_destroy(G.lzfse_dstream);
+        G.lzfse_dstream = (lzfse_decode_stream *)NULL;
+    }
+#endif
+#ifdef USE_MMAP_INPUT
+    unmap_zipf(__G);            /* restores the malloc'd G.inbuf */
+#endif
+#ifdef BIG_OUTBUF
+    if (G.wbuf != (uch *)NULL) {
+        free(G.wbuf);
+        G.wbuf = (uch *)NULL;
+    }
+#endif
+#ifdef TEST_REPORT
+    test_report_free(__G);
+#endif
+#ifdef PARALLEL_EXTRACT
+    if (G.parworkers != (parworker *)NULL) {
+        free(G.parworkers);
+        G.parworkers = (parworker *)NULL;
+    }
+#endif
     checkdir(__G__ (char *)NULL, END);
 
 #ifdef DYNALLOC_CRCTAB
@@ -745,6 +802,10 @@ static int do_seekable(__G__ lastchance)        /* return PK-type error code */
     }
 #endif /* DO_SAFECHECK_2GB */
 
+#ifdef USE_MMAP_INPUT
+    map_zipf(__G);
+#endif
+
 /*---------------------------------------------------------------------------
     Find and process the end-of-central-directory header.  UnZip need only
     check last 65557 bytes of zipfile:  comment may be up to 65535, end-of-
@@ -1131,13 +1192,8 @@ static int rec_find(__G__ searchlen, signature, rec_size)
   ---------------------------------------------------------------------------*/
 
     if ((tail_len = G.ziplen % INBUFSIZ) > rec_size) {
-#ifdef USE_STRM_INPUT
-        zfseeko(G.zipfd, G.ziplen-tail_len, SEEK_SET);
-        G.cur_zipfile_bufstart = zftello(G.zipfd);
-#else /* !USE_STRM_INPUT */
-        G.cur_zipfile_bufstart = zlseek(G.zipfd, G.ziplen-tail_len, SEEK_SET);
-#endif /* ?USE_STRM_INPUT */
-        if ((G.incnt = read(G.zipfd, (char *)G.inbuf,
+        G.cur_zipfile_bufstart = G.ziplen - tail_len;
+        if ((G.incnt = read_zipf(__G__ G.cur_zipfile_bufstart,
             (unsigned int)tail_len)) != (int)tail_len)
             return 2;      /* it's expedient... */
 
@@ -1168,12 +1224,7 @@ static int rec_find(__G__ searchlen, signature, rec_size)
 
     for (i = 1;  !found && (i <= numblks);  ++i) {
         G.cur_zipfile_bufstart -= INBUFSIZ;
-#ifdef USE_STRM_INPUT
-        zfseeko(G.zipfd, G.cur_zipfile_bufstart, SEEK_SET);
-#else /* !USE_STRM_INPUT */
-        zlseek(G.zipfd, G.cur_zipfile_bufstart, SEEK_SET);
-#endif /* ?USE_STRM_INPUT */
-        if ((G.incnt = read(G.zipfd,(char *)G.inbuf,INBUFSIZ))
+        if ((G.incnt = read_zipf(__G__ G.cur_zipfile_bufstart, INBUFSIZ))
             != INBUFSIZ)
             return 2;          /* read error is fatal failure */
 
@@ -1456,12 +1507,7 @@ static int find_ecrec(__G__ searchlen)          /* return PK-class error */
   ---------------------------------------------------------------------------*/
 
     if (G.ziplen <= INBUFSIZ) {
-#ifdef USE_STRM_INPUT
-        zfseeko(G.zipfd, 0L, SEEK_SET);
-#else /* !USE_STRM_INPUT */
-        zlseek(G.zipfd, 0L, SEEK_SET);
-#endif /* ?USE_STRM_INPUT */
-        if ((G.incnt = read(G.zipfd,(char *)G.inbuf,(unsigned int)G.ziplen))
+        if ((G.incnt = read_zipf(__G__ 0L, (unsigned int)G.ziplen))
             == (int)G.ziplen)
 
             /* 'P' must be at least (ECREC_SIZE+4) bytes from end of zipfile */
@@ -1691,17 +1737,37 @@ static int process_zip_cmmnt(__G)       /* return PK-type error code */
 int process_cdir_file_hdr(__G)    /* return PK-type error code */
     __GDEF
 {
-    int error;
+    cdir_byte_hdr byterec;
+
+
+    if (readbuf(__G__ (char *)byterec, CREC_SIZE) == 0)
+        return PK_EOF;
+
+    process_cdir_byte_hdr(__G__ byterec);
+    return PK_COOL;
+
+} /* end function process_cdir_file_hdr() */
+
+
+
+
 
+/************************************/
+/* Function process_cdir_byte_hdr() */
+/************************************/
 
+void process_cdir_byte_hdr(__G__ byterec)
+    __GDEF
+    ZCONST uch *byterec;      /* central header as stored, sans signature */
+{
 /*---------------------------------------------------------------------------
     Get central directory info, save host and method numbers, and set flag
     for lowercase conversion of filename, depending on the OS from which the
-    file is coming.
+    file is coming.  (Also called by zipinfo's fast listing, straight on the
+    image of the central directory.)
   ---------------------------------------------------------------------------*/
 
-    if ((error = get_cdir_ent(__G)) != 0)
-        return error;
+    get_cdir_ent(__G__ byterec);
 
     G.pInfo->hostver = G.crec.version_made_by[0];
     G.pInfo->hostnum = MIN(G.crec.version_made_by[1], NUM_HOSTS);
@@ -1751,9 +1817,7 @@ int process_cdir_file_hdr(__G)    /* return PK-type error code */
         = (G.crec.general_purpose_bit_flag & (1 << 11)) == (1 << 11);
 #endif
 
-    return PK_COOL;
-
-} /* end function process_cdir_file_hdr() */
+} /* end function process_cdir_byte_hdr() */
 
 
 
@@ -1763,22 +1827,16 @@ int process_cdir_file_hdr(__G)    /* return PK-type error code */
 /* Function get_cdir_ent() */
 /***************************/
 
-static int get_cdir_ent(__G)    /* return PK-type error code */
+static void get_cdir_ent(__G__ byterec)
     __GDEF
+    ZCONST uch *byterec;
 {
-    cdir_byte_hdr byterec;
-
-
 /*---------------------------------------------------------------------------
-    Read the next central directory entry and do any necessary machine-type
-    conversions (byte ordering, structure padding compensation--do so by
-    copying the data from the array into which it was read (byterec) to the
-    usable struct (crec)).
+    Do any necessary machine-type conversions on the central directory entry
+    read into byterec (byte ordering, structure padding compensation--do so
+    by copying the data from that array to the usable struct (crec)).
   ---------------------------------------------------------------------------*/
 
-    if (readbuf(__G__ (char *)byterec, CREC_SIZE) == 0)
-        return PK_EOF;
-
     G.crec.version_made_by[0] = byterec[C_VERSION_MADE_BY_0];
     G.crec.version_made_by[1] = byterec[C_VERSION_MADE_BY_1];
     G.crec.version_needed_to_extract[0] =
@@ -1813,8 +1871,6 @@ static int get_cdir_ent(__G)    /* return PK-type error code */
     G.crec.relative_offset_local_header =
       makelong(&byterec[C_RELATIVE_OFFSET_LOCAL_HEADER]);
 
-    return PK_COOL;
-
 } /* end function get_cdir_ent() */
 
 
@@ -0,0 +1,177 @@
+/*
+  api_threads_test.c
+
+  Reads members of one archive through two UzpArchive handles on two
+  threads at once (see api.c) and checks the data.  The archive is a
+  small stored zipfile written by the test itself.  Returns 0 on success.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unzip.h"
+
+#define NMEMBERS   3
+#define MEMBERSIZE 50000
+#define ROUNDS     20
+
+static char member_name[NMEMBERS][8] = {"a.txt", "b.txt", "c.txt"};
+static unsigned char member_data[NMEMBERS][MEMBERSIZE];
+static char zipname[] = "/tmp/api_threads_testXXXXXX";
+
+
+static unsigned long test_crc32(const unsigned char *p, size_t n)
+{
+    unsigned long c = 0xffffffffUL;
+    int k;
+
+    while (n--) {
+        c ^= *p++;
+        for (k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+    }
+    return c ^ 0xffffffffUL;
+}
+
+
+static void put(FILE *f, unsigned long v, int n)
+{
+    while (n--) {
+        putc((int)(v & 0xff), f);
+        v >>= 8;
+    }
+}
+
+
+/* Write the members as a stored (uncompressed) zipfile. */
+static int write_zip(int fd)
+{
+    unsigned long offset[NMEMBERS], crc[NMEMBERS], pos = 0, cdir;
+    FILE *f = fdopen(fd, "wb");
+    int i;
+
+    if (f == NULL)
+        return -1;
+    for (i = 0; i < NMEMBERS; i++) {
+        size_t len = strlen(member_name[i]);
+
+        offset[i] = pos;
+        crc[i] = test_crc32(member_data[i], MEMBERSIZE);
+        put(f, 0x04034b50UL, 4);    /* local header */
+        put(f, 10, 2);              /* version needed */
+        put(f, 0, 2);               /* flags */
+        put(f, 0, 2);               /* stored */
+        put(f, 0, 4);               /* time and date */
+        put(f, crc[i], 4);
+        put(f, MEMBERSIZE, 4);
+        put(f, MEMBERSIZE, 4);
+        put(f, (unsigned long)len, 2);
+        put(f, 0, 2);
+        fwrite(member_name[i], 1, len, f);
+        fwrite(member_data[i], 1, MEMBERSIZE, f);
+        pos += 30 + len + MEMBERSIZE;
+    }
+    cdir = pos;
+    for (i = 0; i < NMEMBERS; i++) {
+        size_t len = strlen(member_name[i]);
+
+        put(f, 0x02014b50UL, 4);    /* central directory header */
+        put(f, 0x031e, 2);          /* made by Unix */
+        put(f, 10, 2);
+        put(f, 0, 2);
+        put(f, 0, 2);
+        put(f, 0, 4);
+        put(f, crc[i], 4);
+        put(f, MEMBERSIZE, 4);
+        put(f, MEMBERSIZE, 4);
+        put(f, (unsigned long)len, 2);
+        put(f, 0, 2);               /* extra field */
+        put(f, 0, 2);               /* comment */
+        put(f, 0, 2);               /* disk */
+        put(f, 0, 2);               /* internal attributes */
+        put(f, 0100644UL << 16, 4); /* external attributes */
+        put(f, offset[i], 4);
+        fwrite(member_name[i], 1, len, f);
+        pos += 46 + len;
+    }
+    put(f, 0x06054b50UL, 4);        /* end of central directory */
+    put(f, 0, 2);
+    put(f, 0, 2);
+    put(f, NMEMBERS, 2);
+    put(f, NMEMBERS, 2);
+    put(f, pos - cdir, 4);
+    put(f, cdir, 4);
+    put(f, 0, 2);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+
+static void *reader(void *arg)
+{
+    UzpArchive *ar = UzpOpenArchive(zipname, NULL, NULL);
+    int start = *(int *)arg;
+    int r, i;
+
+    if (ar == NULL) {
+        fprintf(stderr, "UzpOpenArchive failed\n");
+        return (void *)1;
+    }
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < NMEMBERS; i++) {
+            int m = (start + i) % NMEMBERS;
+            UzpBuffer buf;
+            int err = UzpReadEntry(ar, member_name[m], &buf);
+
+            if (err != PK_OK || buf.strlength != MEMBERSIZE ||
+                memcmp(buf.strptr, member_data[m], MEMBERSIZE) != 0) {
+                fprintf(stderr, "%s: UzpReadEntry returned %d\n",
+                        member_name[m], err);
+                if (err <= PK_WARN)
+                    UzpFreeMemBuffer(&buf);
+                UzpCloseArchive(ar);
+                return (void *)1;
+            }
+            UzpFreeMemBuffer(&buf);
+        }
+    }
+    UzpCloseArchive(ar);
+    return NULL;
+}
+
+
+int main()
+{
+    static int start[2] = {0, 1};
+    pthread_t thread[2];
+    void *ret[2];
+    unsigned long seed = 1;
+    int fd, i, j, errors = 0;
+
+    for (i = 0; i < NMEMBERS; i++)
+        for (j = 0; j < MEMBERSIZE; j++) {
+            seed = seed * 1103515245UL + 12345;
+            member_data[i][j] = (unsigned char)(seed >> 16);
+        }
+
+    if ((fd = mkstemp(zipname)) == -1 || write_zip(fd) != 0) {
+        perror(zipname);
+        return 1;
+    }
+
+    for (i = 0; i < 2; i++)
+        if (pthread_create(&thread[i], NULL, reader, &start[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    for (i = 0; i < 2; i++) {
+        pthread_join(thread[i], &ret[i]);
+        if (ret[i] != NULL)
+            errors++;
+    }
+
+    unlink(zipname);
+    return errors ? 1 : 0;
+}
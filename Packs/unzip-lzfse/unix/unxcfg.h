@@ -49,6 +49,12 @@
 # define __USE_LARGEFILE64
 #endif /* LARGE_FILE_SUPPORT */
 
+/* fallocate() and its FALLOC_FL_* flags are GNU extensions on Linux; they
+   reserve space for and punch holes into output files (see fileio.c) */
+#if (defined(__linux__) && !defined(NO_BIG_OUTBUF) && !defined(_GNU_SOURCE))
+# define _GNU_SOURCE
+#endif
+
 
 #include <sys/types.h>          /* off_t, time_t, dev_t, ... */
 #include <sys/stat.h>
@@ -136,6 +136,10 @@ static void  show_version_info  OF((__GPRO));
    static ZCONST char Far OnlyOneExdir[] =
      "error:  -d option used more than once (only one exdir allowed)\n";
 #endif
+#ifdef PARALLEL_EXTRACT
+   static ZCONST char Far MustGiveJobs[] =
+     "error:  must specify number of worker processes with -w option\n";
+#endif
 #if (defined(UNICODE_SUPPORT) && !defined(UNICODE_WCHAR))
   static ZCONST char Far UTF8EscapeUnSupp[] =
     "warning:  -U \"escape all non-ASCII UTF-8 chars\" is not supported\n";
@@ -256,6 +260,16 @@ M  pipe through \"more\" pager              -s  spaces in filenames => '_'\n\n";
 #else /* !VMS */
 #ifdef ATH_BEO_UNX
    static ZCONST char Far local2[] = " -X  restore UID/GID info";
+#ifdef PARALLEL_EXTRACT
+#ifdef MORE
+   static ZCONST char Far local3[] = "\
+  -K  keep setuid/setgid/tacky permissions   -M  pipe through \"more\" pager\n\
+  -w  extract with N worker processes (-w N)\n";
+#else
+   static ZCONST char Far local3[] = "\
+  -K  keep setuid/setgid/tacky permissions   -w  use N worker processes (-w N)\n";
+#endif
+#else /* !PARALLEL_EXTRACT */
 #ifdef MORE
    static ZCONST char Far local3[] = "\
   -K  keep setuid/setgid/tacky permissions   -M  pipe through \"more\" pager\n";
@@ -263,6 +277,7 @@ M  pipe through \"more\" pager              -s  spaces in filenames => '_'\n\n";
    static ZCONST char Far local3[] = "\
   -K  keep setuid/setgid/tacky permissions\n";
 #endif
+#endif /* ?PARALLEL_EXTRACT */
 #else /* !ATH_BEO_UNX */
 #ifdef TANDEM
    static ZCONST char Far local2[] = "\
@@ -318,14 +333,15 @@ ZipInfo %d.%d%d%s of %s, by Greg Roelofs and the Info-ZIP group.\n\
 List name, date/time, attribute, size, compression method, etc., about files\n\
 in list (excluding those in xlist) contained in the specified .zip archive(s).\
 \n\"file[.zip]\" may be a wildcard name containing %s.\n\n\
-   usage:  zipinfo [-12smlvChMtTz] file[.zip] [list...] [-x xlist...]\n\
-      or:  unzip %s-Z%s [-12smlvChMtTz] file[.zip] [list...] [-x xlist...]\n";
+   usage:  zipinfo [-12smlvejChMtTz] file[.zip] [list...] [-x xlist...]\n\
+      or:  unzip %s-Z%s [-12smlvejChMtTz] file[.zip] [list...] [-x xlist...]\n";
 
 static ZCONST char Far ZipInfoUsageLine2[] = "\nmain\
  listing-format options:             -s  short Unix \"ls -l\" format (def.)\n\
   -1  filenames ONLY, one per line       -m  medium Unix \"ls -l\" format\n\
   -2  just filenames but allow -h/-t/-z  -l  long Unix \"ls -l\" format\n\
-                                         -v  verbose, multi-page format\n";
+                                         -v  verbose, multi-page format\n\
+  -e  tab-separated fields, for scripts  -j  JSON object per line, for scripts\n";
 
 static ZCONST char Far ZipInfoUsageLine3[] = "miscellaneous options:\n\
   -h  print header line       -t  print totals for listed files or for all\n\
@@ -641,12 +657,22 @@ static ZCONST char Far UnzipUsageLine3[] = "\n\
   -v  list verbosely/show version info     %s\n\
   -x  exclude files that follow (in xlist)   -d  extract files onto disk fm\n";
 #else /* !VM_CMS */
+#ifdef TEST_REPORT
+static ZCONST char Far UnzipUsageLine3[] = "\n\
+  -p  extract files to pipe, no messages     -l  list files (short format)\n\
+  -f  freshen existing files, create none    -t  test compressed archive data\n\
+  -u  update files, create if necessary      -z  display archive comment only\n\
+  -v  list verbosely/show version info     %s\n\
+  -x  exclude files that follow (in xlist)   -d  extract files into exdir\n\
+  -tt test with timing/throughput report\n";
+#else
 static ZCONST char Far UnzipUsageLine3[] = "\n\
   -p  extract files to pipe, no messages     -l  list files (short format)\n\
   -f  freshen existing files, create none    -t  test compressed archive data\n\
   -u  update files, create if necessary      -z  display archive comment only\n\
   -v  list verbosely/show version info     %s\n\
   -x  exclude files that follow (in xlist)   -d  extract files into exdir\n";
+#endif /* ?TEST_REPORT */
 #endif /* ?VM_CMS */
 #endif /* ?MACOS */
 
@@ -1692,7 +1718,7 @@ int uz_opts(__G__ pargc, pargv)
                     if (negative)
                         uO.tflag = FALSE, negative = 0;
                     else
-                        uO.tflag = TRUE;
+                        ++uO.tflag;     /* -tt:  timing report (Unix) */
                     break;
 #ifdef TIMESTAMP
                 case ('T'):
@@ -1745,6 +1771,37 @@ int uz_opts(__G__ pargc, pargv)
                         uO.V_flag = TRUE;
                     break;
 #endif /* !CMS_MVS */
+#ifdef PARALLEL_EXTRACT
+                case ('w'):    /* extract with up to N worker processes */
+                    if (negative) {
+                        uO.jobs = 0, negative = 0;
+                        break;
+                    }
+                    /* first check for "-wN", then for "-w N" */
+                    if (*s == '\0') {
+                        if (argc > 1 && isdigit((uch)*argv[1])) {
+                            --argc;
+                            s = *++argv;
+                        } else {
+                            Info(slide, 0x401, ((char *)slide,
+                              LoadFarString(MustGiveJobs)));
+                            return(PK_PARAM);
+                        }
+                    }
+                    if (!isdigit((uch)*s)) {
+                        Info(slide, 0x401, ((char *)slide,
+                          LoadFarString(MustGiveJobs)));
+                        return(PK_PARAM);
+                    }
+                    uO.jobs = atoi(s);
+                    if (uO.jobs > MAX_JOBS)
+                        uO.jobs = MAX_JOBS;
+                    /* point s at end of the number to avoid misinterpretation
+                     * of its digits as more options */
+                    while (*++s != 0)
+                        ;
+                    break;
+#endif /* PARALLEL_EXTRACT */
 #ifdef WILD_STOP_AT_DIR
                 case ('W'):    /* Wildcard interpretation (stop at '/'?) */
                     if (negative)
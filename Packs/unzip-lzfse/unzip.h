@@ -415,6 +415,7 @@ typedef unsigned long   ulg;    /*  predefined on some systems) & match zip  */
    typedef int   (UZ_EXP StatCBFn)  (zvoid *pG, int fnflag, ZCONST char *zfn,
                                      ZCONST char *efn, ZCONST zvoid *details);
    typedef void  (UZ_EXP UsrIniFn)  (void);
+   typedef int   (UZ_EXP UzpStreamFn) (zvoid *arg, ZCONST uch *buf, ulg size);
 #else /* !PROTO */
    typedef int   (UZ_EXP MsgFn)     ();
    typedef int   (UZ_EXP InputFn)   ();
@@ -422,6 +423,7 @@ typedef unsigned long   ulg;    /*  predefined on some systems) & match zip  */
    typedef int   (UZ_EXP PasswdFn)  ();
    typedef int   (UZ_EXP StatCBFn)  ();
    typedef void  (UZ_EXP UsrIniFn)  ();
+   typedef int   (UZ_EXP UzpStreamFn) ();
 #endif /* ?PROTO */
 
 typedef struct _UzpBuffer {    /* rxstr */
@@ -534,6 +536,9 @@ typedef struct _UzpOpts {
 #endif
     int vflag;          /* -v: (verbosely) list directory */
     int V_flag;         /* -V: don't strip VMS version numbers */
+#ifdef UNIX
+    int jobs;           /* -w N: extract with up to N worker processes */
+#endif
     int W_flag;         /* -W: wildcard '*' won't match '/' dir separator */
 #if (defined (__ATHEOS__) || defined(__BEOS__) || defined(UNIX))
     int X_flag;         /* -X: restore owner/protection or UID/GID or ACLs */
@@ -626,6 +631,9 @@ typedef struct _Uzp_cdir_Rec {
 #define UZPVER_LEN    sizeof(UzpVer)
 #define cbList(func)  int (* UZ_EXP func)(char *filename, Uzp_cdir_Rec *crec)
 
+/* open archive handle of UzpOpenArchive() and friends (see api.c) */
+typedef struct _UzpArchive UzpArchive;
+
 
 /*---------------------------------------------------------------------------
     Return (and exit) values of the public UnZip API functions.
@@ -685,6 +693,15 @@ int      UZ_EXP UzpUnzipToMemory   OF((char *zip, char *file, UzpOpts *optflgs,
 int      UZ_EXP UzpGrep            OF((char *archive, char *file,
                                        char *pattern, int cmd, int SkipBin,
                                        UzpCB *UsrFunc));
+UzpArchive * UZ_EXP UzpOpenArchive OF((ZCONST char *zip, UzpOpts *optflgs,
+                                       UzpCB *UsrFunc));
+void     UZ_EXP UzpCloseArchive    OF((UzpArchive *archive));
+int      UZ_EXP UzpListArchive     OF((UzpArchive *archive,
+                                       cbList(callBack)));
+int      UZ_EXP UzpReadEntry       OF((UzpArchive *archive, ZCONST char *file,
+                                       UzpBuffer *retstr));
+int      UZ_EXP UzpStreamEntry     OF((UzpArchive *archive, ZCONST char *file,
+                                       UzpStreamFn *callBack, zvoid *arg));
 #endif
 #ifdef OS2
 int      UZ_EXP UzpFileTree        OF((char *name, cbList(callBack),
@@ -97,6 +97,84 @@
 #  define REENTRANT
 #endif
 
+/* On Unix, the library may be called from several threads at once, each
+ * with its own archive handle (see api.c).  The one-time initializations
+ * then go through pthread_once(), and GG is per thread.
+ */
+#if (!defined(NO_REENTRANT_THREADS) && !defined(REENTRANT_THREADS))
+#  if (defined(UNIX) && defined(REENTRANT))
+#    define REENTRANT_THREADS
+#  endif
+#endif
+#ifdef REENTRANT_THREADS
+#  include <pthread.h>
+#  define IZ_THREAD_LOCAL __thread
+#else
+#  define IZ_THREAD_LOCAL
+#endif
+
+/* Read seekable zipfiles through a memory map instead of lseek()/read()
+ * calls on Unix (see read_zipf() in fileio.c).  Not in the library build:
+ * a zipfile truncated while mapped raises SIGBUS, which would take the
+ * host program down with it.
+ */
+#if (!defined(NO_MMAP_INPUT) && !defined(USE_MMAP_INPUT))
+#  if (defined(UNIX) && !defined(USE_STRM_INPUT) && !defined(DLL))
+#    define USE_MMAP_INPUT
+#  endif
+#endif
+
+/* Enable the -w N option (extract large entries in parallel, each one in
+ * a forked worker process with its own copy of the globals) on Unix.
+ * (This list of systems must be kept in sync with the list of systems
+ * that add the jobs member to the UzpOpts structure, see unzip.h.)
+ */
+#if (!defined(NO_PARALLEL_EXTRACT) && !defined(PARALLEL_EXTRACT))
+#  if (defined(UNIX) && !defined(REENTRANT) && !defined(SFX))
+#    define PARALLEL_EXTRACT
+#  endif
+#endif
+
+/* "unzip -tt" times every member tested and ends with a throughput report
+ * (see test_report() in extract.c).
+ */
+#if (!defined(NO_TEST_REPORT) && !defined(TEST_REPORT))
+#  if (defined(UNIX) && !defined(SFX))
+#    define TEST_REPORT
+#  endif
+#endif
+
+/* Look up the members named on the command line in an in-memory index
+ * of the central directory (see cdir_index_select() in extract.c) rather
+ * than running every entry through match() for every filespec.
+ */
+#if (!defined(NO_CDIR_INDEX) && !defined(CDIR_INDEX))
+#  if (!defined(SFX) && !defined(EBCDIC))
+#    define CDIR_INDEX
+#  endif
+#endif
+
+/* List the names (zipinfo -1/-2) or the tab-separated/JSON records (-e/-j)
+ * straight from an image of the whole central directory, formatted into
+ * one output buffer (see zi_fast() in zipinfo.c).
+ */
+#if (!defined(NO_ZI_FAST) && !defined(ZI_FAST))
+#  if (!defined(SFX) && !defined(NO_ZIPINFO) && !defined(EBCDIC))
+#    define ZI_FAST
+#  endif
+#endif
+
+/* Collect binary output in a large buffer that is written with a single
+ * write() call, and seek over blocks of zeros instead of writing them so
+ * that the extracted file becomes sparse (see flush_outbuf() in fileio.c).
+ */
+#if (!defined(NO_BIG_OUTBUF) && !defined(BIG_OUTBUF))
+#  if (defined(UNIX) && !defined(USE_FWRITE) && !defined(DLL) && \
+       !defined(FUNZIP))
+#    define BIG_OUTBUF
+#  endif
+#endif
+
 #if (!defined(DYNAMIC_CRC_TABLE) && !defined(FUNZIP))
 #  define DYNAMIC_CRC_TABLE
 #endif
@@ -768,7 +846,11 @@
 #  define DATE_SEPCHAR  '-'
 #endif
 #ifndef CLOSE_INFILE
-#  define CLOSE_INFILE()  close(G.zipfd)
+#  ifdef USE_MMAP_INPUT
+#    define CLOSE_INFILE()  (unmap_zipf(__G), close(G.zipfd))
+#  else
+#    define CLOSE_INFILE()  close(G.zipfd)
+#  endif
 #endif
 #ifndef RETURN
 #  define RETURN        return  /* only used in main() */
@@ -1026,6 +1108,15 @@
 #  define RAWBUFSIZ OUTBUFSIZ
 #endif /* ?SMALL_MEM */
 
+#ifdef BIG_OUTBUF
+#  ifndef WBUFSIZ
+#    define WBUFSIZ 0x100000L        /* binary output collected per write() */
+#  endif
+#  ifndef HOLE_BLKSIZ
+#    define HOLE_BLKSIZ 4096         /* zero blocks of this size are skipped */
+#  endif
+#endif
+
 #ifndef Far
 #  define Far
 #endif
@@ -1549,6 +1640,7 @@
 
 #ifdef REALLY_SHORT_SYMS            /* TOPS-20 linker:  first 6 chars */
 #  define process_cdir_file_hdr     XXpcdfh
+#  define process_cdir_byte_hdr     XXpcdbh
 #  define process_local_file_hdr    XXplfh
 #  define extract_or_test_files     XXxotf  /* necessary? */
 #  define extract_or_test_member    XXxotm  /* necessary? */
@@ -2010,6 +2102,30 @@ typedef struct iztimes {
    } slinkentry;
 #endif /* SYMLINKS */
 
+#ifdef TEST_REPORT
+   typedef struct tstat {       /* -tt timing of one tested member */
+       char *name;
+       zusz_t ucsize;
+       double cpu;              /* seconds of CPU time spent testing it */
+   } tstat;
+
+#  define NO_TSTAT      ((ulg)-1)
+#endif /* TEST_REPORT */
+
+#ifdef PARALLEL_EXTRACT
+   typedef struct parworker {   /* one running -w extraction process */
+       pid_t pid;               /* 0 if the slot is free */
+       FILE *out;               /* captured stdout of the worker */
+       FILE *err;               /* captured stderr of the worker */
+#  ifdef TEST_REPORT
+       ulg tstat;               /* its G.tstats[] record (or NO_TSTAT) */
+#  endif
+   } parworker;
+
+#  define MAX_JOBS        64     /* upper limit for -w N */
+#  define PAR_MIN_UCSIZE  0x10000L  /* smaller entries are not worth a fork */
+#endif /* PARALLEL_EXTRACT */
+
 typedef struct min_info {
     zoff_t offset;
     zusz_t compr_size;       /* compressed size (needed if extended header) */
@@ -2254,6 +2370,7 @@ void     free_G_buffers          OF((__GPRO));
 /* static int    find_ecrec      OF((__GPRO__ long searchlen)); */
 /* static int    process_central_comment OF((__GPRO)); */
 int      process_cdir_file_hdr   OF((__GPRO));
+void     process_cdir_byte_hdr   OF((__GPRO__ ZCONST uch *byterec));
 int      process_local_file_hdr  OF((__GPRO));
 int      getZip64Data            OF((__GPRO__ ZCONST uch *ef_buf,
                                      unsigned ef_len));
@@ -2305,7 +2422,16 @@ void     fnprint                 OF((__GPRO));
   ---------------------------------------------------------------------------*/
 
 int      open_input_file      OF((__GPRO));
+#ifdef USE_MMAP_INPUT
+   void  map_zipf             OF((__GPRO));
+   void  unmap_zipf           OF((__GPRO));
+   void  advise_zipf          OF((__GPRO__ zoff_t offset, zoff_t len));
+#endif
+int      read_zipf            OF((__GPRO__ zoff_t offset, unsigned size));
 int      open_outfile         OF((__GPRO));                    /* also vms.c */
+#ifdef BIG_OUTBUF
+   int   flush_outbuf         OF((__GPRO__ int final));
+#endif
 void     undefer_input        OF((__GPRO));
 void     defer_leftover_input OF((__GPRO));
 unsigned readbuf              OF((__GPRO__ char *buf, register unsigned len));
@@ -2383,6 +2509,9 @@ int    extract_or_test_files     OF((__GPRO));
 #ifndef SFX
   unsigned find_compr_idx        OF((unsigned compr_methodnum));
 #endif
+#ifdef TEST_REPORT
+   void  test_report_free        OF((__GPRO));
+#endif
 int    memextract                OF((__GPRO__ uch *tgt, ulg tgtsize,
                                      ZCONST uch *src, ulg srcsize));
 int    memflush                  OF((__GPRO__ ZCONST uch *rawbuf, ulg size));
@@ -2443,6 +2572,7 @@ int    huft_build                OF((__GPRO__ ZCONST unsigned *b, unsigned n,
    int      writeToMemory         OF((__GPRO__ ZCONST uch *rawbuf,
                                       extent size));                /* api.c */
    int      close_redirect        OF((__GPRO));                     /* api.c */
+   void     fill_cdir_rec         OF((__GPRO__ Uzp_cdir_Rec *crec));  /* api.c */
    /* this obsolescent entry point kept for compatibility: */
    int      UzpUnzip              OF((int argc, char **argv));/* use UzpMain */
 #ifdef OS2DLL
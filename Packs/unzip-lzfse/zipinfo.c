@@ -15,6 +15,10 @@
   Contains:  zi_opts()
              zi_end_central()
              zipinfo()
+             zi_select()
+             zi_fast()
+             zi_export()
+             zi_flush()
              zi_long()
              zi_short()
              zi_time()
@@ -119,7 +123,30 @@
 #endif
 
 #define LFLAG  3   /* short "ls -l" type listing */
-
+#define LFLAG_TSV  6    /* -e:  one line of tab-separated fields per entry */
+#define LFLAG_JSON 7    /* -j:  one line with a JSON object per entry */
+
+#define ZI_OUTBUFSIZ 0x10000L   /* output collected for one message call */
+#define ZI_RECMAX    MAX(6*FILNAMSIZ + 256, (WSIZE>>1) + 2)  /* one record */
+
+typedef struct zi_outbuf {  /* listing output, see zi_export()/zi_flush() */
+    char *buf;              /* ZI_OUTBUFSIZ + ZI_RECMAX bytes */
+    extent len;
+    int tlast;              /* last time converted:  0 none, 1 DOS, 2 UT */
+    ulg dostime;
+    time_t utime;
+    char d_t_buf[32];       /* ...and its text */
+} zi_outbuf;
+
+static int   zi_select OF((__GPRO__ int *fn_matched, int *xn_matched));
+#ifdef ZI_FAST
+static int   zi_fast   OF((__GPRO__ zi_outbuf *ob, int *fn_matched,
+                           int *xn_matched, ulg *pj, ulg *pmembers,
+                           zusz_t *ptot_csize, zusz_t *ptot_ucsize));
+#endif
+static void  zi_export OF((__GPRO__ zi_outbuf *ob, ZCONST uch *ef,
+                           unsigned ef_len));
+static void  zi_flush  OF((__GPRO__ zi_outbuf *ob));
 static int   zi_long   OF((__GPRO__ zusz_t *pEndprev, int error_in_archive));
 static int   zi_short  OF((__GPRO));
 static void  zi_showMacTypeCreator
@@ -434,6 +461,7 @@ static ZCONST char Far BogusFmt[] = "%03d";
 static ZCONST char Far shtYMDHMTime[] = "%02u-%s-%02u %02u:%02u";
 static ZCONST char Far lngYMDHMSTime[] = "%u %s %u %02u:%02u:%02u";
 static ZCONST char Far DecimalTime[] = "%04u%02u%02u.%02u%02u%02u";
+static ZCONST char Far IsoTime[] = "%04u-%02u-%02uT%02u:%02u:%02u";
 #ifdef USE_EF_UT_TIME
   static ZCONST char Far lngYMDHMSTimeError[] = "???? ??? ?? ??:??:??";
 #endif
@@ -494,6 +522,12 @@ int zi_opts(__G__ pargc, pargv)
                         uO.C_flag = TRUE;
                     break;
 #endif /* !CMS_MVS */
+                case 'e':      /* tab-separated fields, for scripts */
+                    if (negative)
+                        uO.lflag = -2, negative = 0;
+                    else
+                        uO.lflag = LFLAG_TSV;
+                    break;
                 case 'h':      /* header line */
                     if (negative)
                         hflag_2 = hflag_slmv = FALSE, negative = 0;
@@ -503,6 +537,12 @@ int zi_opts(__G__ pargc, pargv)
                             uO.lflag = 0;
                     }
                     break;
+                case 'j':      /* JSON objects, for scripts */
+                    if (negative)
+                        uO.lflag = -2, negative = 0;
+                    else
+                        uO.lflag = LFLAG_JSON;
+                    break;
                 case 'l':      /* longer form of "ls -l" type listing */
                     if (negative)
                         uO.lflag = -2, negative = 0;
@@ -605,6 +645,8 @@ int zi_opts(__G__ pargc, pargv)
             uO.tflag = tflag_2v;
             break;
         case 1:   /* only filenames, *always* */
+        case LFLAG_TSV:
+        case LFLAG_JSON:
             uO.hflag = FALSE;
             uO.tflag = FALSE;
             uO.zflag = FALSE;
@@ -713,6 +755,7 @@ int zipinfo(__G)   /* return PK-type error code */
     zusz_t tot_csize=0L, tot_ucsize=0L;
     zusz_t endprev;   /* buffers end of previous entry for zi_long()'s check
                        *  of extra bytes */
+    zi_outbuf ob;
 
 
 /*---------------------------------------------------------------------------
@@ -730,6 +773,27 @@ int zipinfo(__G)   /* return PK-type error code */
         for (j = 0;  j < G.xfilespecs;  ++j)
             xn_matched[j] = FALSE;
 
+/*---------------------------------------------------------------------------
+    The script formats are collected in a large buffer and passed on in big
+    pieces; zi_fast() does the same with the names-only formats.
+  ---------------------------------------------------------------------------*/
+
+    ob.buf = (char *)NULL;
+    ob.len = 0;
+    ob.tlast = 0;
+    if (uO.lflag == 1 || uO.lflag == 2 ||
+        uO.lflag == LFLAG_TSV || uO.lflag == LFLAG_JSON)
+    {
+        ob.buf = (char *)malloc((extent)(ZI_OUTBUFSIZ + ZI_RECMAX));
+        if (ob.buf == (char *)NULL && uO.lflag > 2) {
+            if (fn_matched)
+                free((zvoid *)fn_matched);
+            if (xn_matched)
+                free((zvoid *)xn_matched);
+            return PK_MEM;
+        }
+    }
+
 /*---------------------------------------------------------------------------
     Set file pointer to start of central directory, then loop through cen-
     tral directory entries.  Check that directory-entry signature bytes are
@@ -749,8 +813,16 @@ int zipinfo(__G)   /* return PK-type error code */
     /* reset endprev for new zipfile; account for multi-part archives (?) */
     endprev = (G.crec.relative_offset_local_header == 4L)? 4L : 0L;
 
+    j = 1L;
+#ifdef ZI_FAST
+    /* run through as much of the directory as possible in its raw image */
+    if (ob.buf != (char *)NULL)
+        error_in_archive = zi_fast(__G__ &ob, fn_matched, xn_matched, &j,
+                                   &members, &tot_csize, &tot_ucsize);
 
-    for (j = 1L;; j++) {
+    if (error_in_archive <= PK_WARN)
+#endif /* ZI_FAST */
+    for (;; j++) {
         if (readbuf(__G__ G.sig, 4) == 0) {
             error_in_archive = PK_EOF;
             break;
@@ -793,31 +865,8 @@ int zipinfo(__G)   /* return PK-type error code */
               break;
         }
 
-        if (!G.process_all_files) {   /* check if specified on command line */
-            unsigned i;
-
-            if (G.filespecs == 0)
-                do_this_file = TRUE;
-            else {  /* check if this entry matches an `include' argument */
-                do_this_file = FALSE;
-                for (i = 0; i < G.filespecs; i++)
-                    if (match(G.filename, G.pfnames[i], uO.C_flag WISEP)) {
-                        do_this_file = TRUE;
-                        if (fn_matched)
-                            fn_matched[i] = TRUE;
-                        break;       /* found match, so stop looping */
-                    }
-            }
-            if (do_this_file) {  /* check if this is an excluded file */
-                for (i = 0; i < G.xfilespecs; i++)
-                    if (match(G.filename, G.pxnames[i], uO.C_flag WISEP)) {
-                        do_this_file = FALSE;  /* ^-- ignore case in match */
-                        if (xn_matched)
-                            xn_matched[i] = TRUE;
-                        break;
-                    }
-            }
-        }
+        if (!G.process_all_files)     /* check if specified on command line */
+            do_this_file = zi_select(__G__ fn_matched, xn_matched);
 
     /*-----------------------------------------------------------------------
         If current file was specified on command line, or if no names were
@@ -853,6 +902,13 @@ int zipinfo(__G)   /* return PK-type error code */
                     SKIP_(G.crec.file_comment_length)
                     break;
 
+                case LFLAG_TSV:
+                case LFLAG_JSON:
+                    zi_export(__G__ &ob, G.extra_field,
+                              G.crec.extra_field_length);
+                    SKIP_(G.crec.file_comment_length)
+                    break;
+
                 case 3:
                 case 4:
                 case 5:
@@ -906,6 +962,11 @@ int zipinfo(__G)   /* return PK-type error code */
 
     } /* end for-loop (j: member files) */
 
+    if (ob.buf != (char *)NULL) {
+        zi_flush(__G__ &ob);
+        free((zvoid *)ob.buf);
+    }
+
 /*---------------------------------------------------------------------------
     Check that we actually found requested files; if so, print totals.
   ---------------------------------------------------------------------------*/
@@ -982,6 +1043,358 @@ int zipinfo(__G)   /* return PK-type error code */
 
 
 
+/**************************/
+/*  Function zi_select()  */
+/**************************/
+
+static int zi_select(__G__ fn_matched, xn_matched)   /* TRUE if G.filename */
+    __GDEF                                             /*  is to be listed */
+    int *fn_matched;
+    int *xn_matched;
+{
+    unsigned i;
+    int do_this_file;
+
+    if (G.filespecs == 0)
+        do_this_file = TRUE;
+    else {  /* check if this entry matches an `include' argument */
+        do_this_file = FALSE;
+        for (i = 0; i < G.filespecs; i++)
+            if (match(G.filename, G.pfnames[i], uO.C_flag WISEP)) {
+                do_this_file = TRUE;
+                if (fn_matched)
+                    fn_matched[i] = TRUE;
+                break;       /* found match, so stop looping */
+            }
+    }
+    if (do_this_file) {  /* check if this is an excluded file */
+        for (i = 0; i < G.xfilespecs; i++)
+            if (match(G.filename, G.pxnames[i], uO.C_flag WISEP)) {
+                do_this_file = FALSE;  /* ^-- ignore case in match */
+                if (xn_matched)
+                    xn_matched[i] = TRUE;
+                break;
+            }
+    }
+    return do_this_file;
+
+} /* end function zi_select() */
+
+
+
+
+
+#ifdef ZI_FAST
+
+/************************/
+/*  Function zi_fast()  */
+/************************/
+
+static int zi_fast(__G__ ob, fn_matched, xn_matched, pj, pmembers,
+                   ptot_csize, ptot_ucsize)     /* return PK-type error code */
+    __GDEF
+    zi_outbuf *ob;
+    int *fn_matched;
+    int *xn_matched;
+    ulg *pj;
+    ulg *pmembers;
+    zusz_t *ptot_csize;
+    zusz_t *ptot_ucsize;
+{
+    ZCONST uch *cd, *p, *ef;
+    uch *cdbuf=(uch *)NULL;
+    zoff_t cdstart;
+    zusz_t cdlen, pos, reclen;
+    unsigned n, fnlen, eflen, cmlen;
+    int plain, error, error_in_archive=PK_COOL;
+
+
+/*---------------------------------------------------------------------------
+    List the names (-1, -2) or the script formats (-e, -j) straight from an
+    image of the central directory:  in place in the memory map, or else
+    read in all at once.  The header fields are taken from the image; only
+    names that do_string() may change (8-bit characters, volume labels,
+    Unicode path fields, overlong names) are read again the regular way.
+    At the first thing that is not a complete central header (normally the
+    end-of-central-directory record), the zipfile is positioned there, and
+    the rest, with all end-of-directory checks, is left to the regular loop
+    in zipinfo().  *pj counts the entries gone through.
+  ---------------------------------------------------------------------------*/
+
+    cdstart = G.cur_zipfile_bufstart + (G.inptr - G.inbuf);
+#ifdef USE_MMAP_INPUT
+    if (G.zipmap != (uch *)NULL) {
+        cd = G.zipmap + cdstart;
+        cdlen = (zusz_t)(G.zipmap_size - cdstart);
+    } else
+#endif
+    {
+        cdlen = G.ecrec.size_central_directory + 4;
+        if ((zusz_t)(unsigned)cdlen != cdlen ||
+            (cdbuf = (uch *)malloc((extent)cdlen)) == (uch *)NULL)
+            return PK_COOL;     /* leave it all to the regular loop */
+        cdlen = readbuf(__G__ (char *)cdbuf, (unsigned)cdlen);
+        cd = cdbuf;
+    }
+
+    for (pos = 0;  pos + 4 + CREC_SIZE <= cdlen;  pos += reclen, ++*pj) {
+        p = cd + (extent)pos;
+        if (memcmp(p, central_hdr_sig, 4))
+            break;
+        fnlen = makeword(p + 4 + C_FILENAME_LENGTH);
+        eflen = makeword(p + 4 + C_EXTRA_FIELD_LENGTH);
+        cmlen = makeword(p + 4 + C_FILE_COMMENT_LENGTH);
+        reclen = 4 + CREC_SIZE + fnlen + eflen + cmlen;
+        if (pos + reclen > cdlen)
+            break;
+        ef = p + 4 + CREC_SIZE + fnlen;
+
+        /* process_cdir_byte_hdr() sets pInfo->vollabel, pInfo->lcflag, ...: */
+        process_cdir_byte_hdr(__G__ p + 4);
+        plain = (fnlen < FILNAMSIZ && !G.pInfo->vollabel && !G.pInfo->lcflag);
+        for (n = 0;  n < fnlen && plain;  ++n)
+            if (p[4 + CREC_SIZE + n] & 0x80)    /* codepage translated */
+                plain = FALSE;
+#ifdef UNICODE_SUPPORT
+        for (n = 0;  n + EB_HEADSIZE <= eflen && plain;
+             n += EB_HEADSIZE + makeword(ef + n + EB_LEN))
+            if (makeword(ef + n + EB_ID) == EF_UNIPATH)
+                plain = FALSE;
+#endif
+
+        if (plain) {
+            memcpy(G.filename, p + 4 + CREC_SIZE, fnlen);
+            G.filename[fnlen] = '\0';
+        } else {
+            if ((error = seek_zipf(__G__ cdstart + (zoff_t)pos + 4 -
+                                   G.extra_bytes)) != PK_OK ||
+                (error = process_cdir_file_hdr(__G)) != PK_COOL)
+            {
+                error_in_archive = error;
+                break;
+            }
+            if ((error = do_string(__G__ fnlen, DS_FN)) != PK_COOL) {
+                if (error > error_in_archive)
+                    error_in_archive = error;
+                if (error > PK_WARN)        /* fatal */
+                    break;
+            }
+        }
+
+        if (!G.process_all_files && !zi_select(__G__ fn_matched, xn_matched))
+            continue;
+
+        /* resolve the Zip64 sizes and offset (do_string() does it, too) */
+        if (plain)
+            getZip64Data(__G__ ef, eflen);
+        else {
+            if ((error = do_string(__G__ eflen, EXTRA_FIELD)) != 0) {
+                if (G.extra_field != NULL) {
+                    free(G.extra_field);
+                    G.extra_field = NULL;
+                }
+                error_in_archive = error;   /* fatal ones after listing */
+            }
+            ef = G.extra_field;
+            eflen = G.crec.extra_field_length;
+        }
+
+        if (uO.lflag <= 2) {
+            fnfilter(G.filename, (uch *)ob->buf + ob->len,
+                     (extent)(WSIZE>>1));
+            ob->len += strlen(ob->buf + ob->len);
+            ob->buf[ob->len++] = '\n';
+            if (ob->len >= ZI_OUTBUFSIZ)
+                zi_flush(__G__ ob);
+        } else
+            zi_export(__G__ ob, ef, eflen);
+
+        *ptot_csize += G.crec.csize;
+        *ptot_ucsize += G.crec.ucsize;
+        if (G.crec.general_purpose_bit_flag & 1)
+            *ptot_csize -= 12;   /* don't count encryption header */
+        ++*pmembers;
+
+#ifdef DLL
+        if ((G.statreportcb != NULL) &&
+            (*G.statreportcb)(__G__ UZ_ST_FINISH_MEMBER, G.zipfn,
+                              G.filename, (zvoid *)&G.crec.ucsize)) {
+            /* cancel operation by user request */
+            error_in_archive = IZ_CTRLC;
+            break;
+        }
+#endif
+        if (error_in_archive > PK_WARN)     /* fatal */
+            break;
+    }
+
+    zi_flush(__G__ ob);
+    if (error_in_archive <= PK_WARN &&
+        (error = seek_zipf(__G__ cdstart + (zoff_t)pos - G.extra_bytes))
+        != PK_OK)
+        error_in_archive = error;
+    if (cdbuf != (uch *)NULL)
+        free((zvoid *)cdbuf);
+    return error_in_archive;
+
+} /* end function zi_fast() */
+
+#endif /* ZI_FAST */
+
+
+
+
+
+/**************************/
+/*  Function zi_export()  */
+/**************************/
+
+static void zi_export(__G__ ob, ef, ef_len)
+    __GDEF
+    zi_outbuf *ob;
+    ZCONST uch *ef;         /* extra field of the entry, for the UT time */
+    unsigned ef_len;
+{
+#ifdef USE_EF_UT_TIME
+    iztimes     z_utime;
+    time_t      *z_modtim;
+#endif
+    ZCONST uch  *s;
+    char        *d, *q, numbuf[24];
+    int         i, json=(uO.lflag == LFLAG_JSON);
+    int         utf8=((G.crec.general_purpose_bit_flag & (1 << 11)) != 0);
+    zusz_t      num[6];
+    static ZCONST char hexdigit[] = "0123456789abcdef";
+    static ZCONST char *key[6] = {     /* JSON keys */
+        ",\"size\":", ",\"csize\":", ",\"method\":", ",\"flags\":",
+        ",\"xattr\":", ",\"offset\":"
+    };
+
+
+/*---------------------------------------------------------------------------
+    Put one line into the output buffer:  the name, size, compressed size,
+    method, general purpose flags, CRC (hex), modification time (local, ISO
+    8601), external attributes and local header offset of the entry.  With
+    -e, these are separated by tabs, and tab, newline, CR and backslash in
+    the name are escaped with a backslash.  With -j, they make up a JSON
+    object; names not flagged as UTF-8 are taken as ISO 8859-1 (as UnZip
+    has them internally).
+  ---------------------------------------------------------------------------*/
+
+#ifdef USE_EF_UT_TIME
+    z_modtim = ef &&
+#ifdef IZ_CHECK_TZ
+               G.tz_is_valid &&
+#endif
+               (ef_scan_for_izux(ef, ef_len, 1, G.crec.last_mod_dos_datetime,
+                                 &z_utime, NULL) & EB_UT_FL_MTIME)
+              ? &z_utime.mtime : NULL;
+    TIMET_TO_NATIVE(z_utime.mtime)     /* NOP unless MSC 7.0 or Macintosh */
+#else
+#   define z_modtim NULL
+#endif
+    /* runs of entries often share their time:  convert it only once */
+    if (ob->tlast == 0 || ob->dostime != G.crec.last_mod_dos_datetime ||
+        (z_modtim == NULL) != (ob->tlast == 1)
+#ifdef USE_EF_UT_TIME
+        || (z_modtim != NULL && ob->utime != *z_modtim)
+#endif
+       )
+    {
+        ob->d_t_buf[0] = (char)0;      /* signal "show local time" */
+        zi_time(__G__ &G.crec.last_mod_dos_datetime, z_modtim, ob->d_t_buf);
+        ob->tlast = (z_modtim == NULL)? 1 : 2;
+        ob->dostime = G.crec.last_mod_dos_datetime;
+#ifdef USE_EF_UT_TIME
+        if (z_modtim != NULL)
+            ob->utime = *z_modtim;
+#endif
+    }
+
+    d = ob->buf + ob->len;
+    if (json) {
+        strcpy(d, "{\"name\":\"");
+        d += 9;
+    }
+    for (s = (ZCONST uch *)G.filename;  *s;  ++s) {
+        if (*s == '\\' || (json && *s == '"'))
+            *d++ = '\\', *d++ = (char)*s;
+        else if (*s == '\t')
+            *d++ = '\\', *d++ = 't';
+        else if (*s == '\n')
+            *d++ = '\\', *d++ = 'n';
+        else if (*s == '\r')
+            *d++ = '\\', *d++ = 'r';
+        else if (json && (*s < 0x20 || (*s >= 0x80 && !utf8))) {
+            strcpy(d, "\\u00");
+            d[4] = hexdigit[*s >> 4];
+            d[5] = hexdigit[*s & 0xf];
+            d += 6;
+        } else
+            *d++ = (char)*s;
+    }
+    if (json)
+        *d++ = '"';
+
+    num[0] = G.crec.ucsize;
+    num[1] = G.crec.csize;
+    num[2] = G.crec.compression_method;
+    num[3] = G.crec.general_purpose_bit_flag;
+    num[4] = G.crec.external_file_attributes;
+    num[5] = G.crec.relative_offset_local_header;
+    for (i = 0;  i < 6;  ++i) {
+        if (i == 4) {   /* CRC and time go before the attributes */
+            if (json)
+                d += sprintf(d, ",\"crc32\":\"%08lx\",\"mtime\":\"%s\"",
+                             G.crec.crc32, ob->d_t_buf);
+            else
+                d += sprintf(d, "\t%08lx\t%s", G.crec.crc32, ob->d_t_buf);
+        }
+        if (json) {
+            for (q = (char *)key[i];  *q;  ++q)
+                *d++ = *q;
+        } else
+            *d++ = '\t';
+        q = numbuf + sizeof(numbuf);
+        do {
+            *--q = (char)('0' + (int)(num[i] % 10));
+        } while ((num[i] /= 10) != 0);
+        while (q < numbuf + sizeof(numbuf))
+            *d++ = *q++;
+    }
+    if (json)
+        *d++ = '}';
+    *d++ = '\n';
+
+    ob->len = (extent)(d - ob->buf);
+    if (ob->len >= ZI_OUTBUFSIZ)
+        zi_flush(__G__ ob);
+
+} /* end function zi_export() */
+
+
+
+
+
+/*************************/
+/*  Function zi_flush()  */
+/*************************/
+
+static void zi_flush(__G__ ob)
+    __GDEF
+    zi_outbuf *ob;
+{
+    if (ob->len > 0) {
+        (*G.message)((zvoid *)&G, (uch *)ob->buf, (ulg)ob->len, 0);
+        ob->len = 0;
+    }
+
+} /* end function zi_flush() */
+
+
+
+
+
 /************************/
 /*  Function zi_long()  */
 /************************/
@@ -2303,6 +2716,9 @@ static char *zi_time(__G__ datetimez, modtimez, d_t_str)
     if (uO.lflag > 9)   /* verbose listing format */
         sprintf(d_t_str, LoadFarString(lngYMDHMSTime), yr+1900, monthstr, dy,
           hh, mm, ss);
+    else if (uO.lflag == LFLAG_TSV || uO.lflag == LFLAG_JSON)
+        sprintf(d_t_str, LoadFarString(IsoTime), yr+1900, mo, dy,
+          hh, mm, ss);
     else if (uO.T_flag)
         sprintf(d_t_str, LoadFarString(DecimalTime), yr+1900, mo, dy,
           hh, mm, ss);
@@ -22,6 +22,7 @@ bool opt_force = false;
 bool opt_keep_original = false;
 bool opt_robot = false;
 bool opt_ignore_check = false;
+bool opt_benchmark = false;
 
 // We don't modify or free() this, but we need to assign it in some
 // non-const pointers.
@@ -142,6 +143,11 @@ parse_real(args_info *args, int argc, char **argv)
 		OPT_ROBOT,
 		OPT_FLUSH_TIMEOUT,
 		OPT_IGNORE_CHECK,
+		OPT_JOBS,
+		OPT_OFFSET,
+		OPT_LENGTH,
+		OPT_BENCHMARK,
+		OPT_STATS_FD,
 	};
 
 	static const char short_opts[]
@@ -161,6 +167,8 @@ parse_real(args_info *args, int argc, char **argv)
 		{ "stdout",       no_argument,       NULL,  'c' },
 		{ "to-stdout",    no_argument,       NULL,  'c' },
 		{ "single-stream", no_argument,      NULL,  OPT_SINGLE_STREAM },
+		{ "offset",       required_argument, NULL,  OPT_OFFSET },
+		{ "length",       required_argument, NULL,  OPT_LENGTH },
 		{ "no-sparse",    no_argument,       NULL,  OPT_NO_SPARSE },
 		{ "suffix",       required_argument, NULL,  'S' },
 		// { "recursive",      no_argument,       NULL,  'r' }, // TODO
@@ -179,6 +187,7 @@ parse_real(args_info *args, int argc, char **argv)
 		{ "memory",       required_argument, NULL,  'M' }, // Old alias
 		{ "no-adjust",    no_argument,       NULL,  OPT_NO_ADJUST },
 		{ "threads",      required_argument, NULL,  'T' },
+		{ "jobs",         required_argument, NULL,  OPT_JOBS },
 		{ "flush-timeout", required_argument, NULL, OPT_FLUSH_TIMEOUT },
 
 		{ "extreme",      no_argument,       NULL,  'e' },
@@ -201,7 +210,9 @@ parse_real(args_info *args, int argc, char **argv)
 		{ "verbose",      no_argument,       NULL,  'v' },
 		{ "no-warn",      no_argument,       NULL,  'Q' },
 		{ "robot",        no_argument,       NULL,  OPT_ROBOT },
+		{ "stats-fd",     required_argument, NULL,  OPT_STATS_FD },
 		{ "info-memory",  no_argument,       NULL,  OPT_INFO_MEMORY },
+		{ "benchmark",    optional_argument, NULL,  OPT_BENCHMARK },
 		{ "help",         no_argument,       NULL,  'h' },
 		{ "long-help",    no_argument,       NULL,  'H' },
 		{ "version",      no_argument,       NULL,  'V' },
@@ -281,6 +292,14 @@ parse_real(args_info *args, int argc, char **argv)
 			// This doesn't return.
 			hardware_memlimit_show();
 
+		// --benchmark
+		case OPT_BENCHMARK:
+			opt_benchmark = true;
+			if (optarg != NULL)
+				bench_set_list(optarg);
+
+			break;
+
 		// --help
 		case 'h':
 			// This doesn't return.
@@ -396,6 +415,9 @@ parse_real(args_info *args, int argc, char **argv)
 				{ "alone",  FORMAT_LZMA },
 				// { "gzip",   FORMAT_GZIP },
 				// { "gz",     FORMAT_GZIP },
+#ifdef HAVE_LZFSE
+				{ "lzfse",  FORMAT_LZFSE },
+#endif
 				{ "raw",    FORMAT_RAW },
 			};
 
@@ -458,6 +480,16 @@ parse_real(args_info *args, int argc, char **argv)
 			opt_single_stream = true;
 			break;
 
+		case OPT_OFFSET:
+			opt_range_offset = str_to_uint64("offset", optarg,
+					0, UINT64_MAX);
+			break;
+
+		case OPT_LENGTH:
+			opt_range_length = str_to_uint64("length", optarg,
+					0, UINT64_MAX);
+			break;
+
 		case OPT_NO_SPARSE:
 			io_no_sparse();
 			break;
@@ -496,6 +528,16 @@ parse_real(args_info *args, int argc, char **argv)
 					optarg, 0, UINT64_MAX);
 			break;
 
+		case OPT_JOBS:
+			hardware_jobs_set(str_to_uint64("jobs",
+					optarg, 0, 16384));
+			break;
+
+		case OPT_STATS_FD:
+			message_set_stats_fd((int)(str_to_uint64("stats-fd",
+					optarg, 0, INT_MAX)));
+			break;
+
 		default:
 			message_try_help();
 			tuklib_exit(E_ERROR, E_ERROR, false);
@@ -650,6 +692,23 @@ args_parse(args_info *args, int argc, char **argv)
 				"at build time"));
 #endif
 
+	// Files are processed one at a time when there is only one, when
+	// the output goes to stdout, or with --flush-timeout. --jobs has
+	// no use with --list either. This has to be known before
+	// coder_set_compression_settings() because the jobs share the
+	// memory usage limit.
+	if ((argc - optind <= 1 && args->files_name == NULL)
+			|| (opt_stdout && opt_mode != MODE_TEST)
+			|| opt_mode == MODE_LIST || opt_flush_timeout != 0)
+		hardware_jobs_set(1);
+
+	// A part of the uncompressed data must not end up in a file that
+	// looks like the whole decompressed file.
+	if ((opt_range_offset != 0 || opt_range_length != UINT64_MAX)
+			&& (opt_mode != MODE_DECOMPRESS || !opt_stdout))
+		message_fatal(_("--offset and --length can only be used "
+				"when decompressing to standard output"));
+
 	// Never remove the source file when the destination is not on disk.
 	// In test mode the data is written nowhere, but setting opt_stdout
 	// will make the rest of the code behave well.
@@ -671,6 +730,13 @@ args_parse(args_info *args, int argc, char **argv)
 	if (opt_mode == MODE_COMPRESS || opt_format == FORMAT_RAW)
 		coder_set_compression_settings();
 
+	// --benchmark uses generated data if no files are given.
+	if (opt_benchmark && argv[optind] == NULL) {
+		args->arg_names = argv + optind;
+		args->arg_count = 0;
+		return;
+	}
+
 	// If no filenames are given, use stdin.
 	if (argv[optind] == NULL && args->files_name == NULL) {
 		// We don't modify or free() the "-" constant. The caller
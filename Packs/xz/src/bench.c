@@ -0,0 +1,434 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       bench.c
+/// \brief      Measuring the speed of the presets in memory
+//
+//  This file has been put into the public domain.
+//  You can do whatever you want with this file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "private.h"
+#include <time.h>
+
+
+/// Size of the sample data used when no file was given
+#define SAMPLE_SIZE (UINT32_C(16) << 20)
+
+/// Maximum number of entries in --benchmark=LIST
+#define BENCH_LIST_MAX 16
+
+
+/// Number of threads and Block size of each entry of --benchmark=LIST.
+/// A Block size of zero means the default of the threaded encoder, or
+/// the single-threaded encoder if there is one thread.
+static uint32_t bench_threads[BENCH_LIST_MAX];
+static uint64_t bench_block_sizes[BENCH_LIST_MAX];
+static size_t bench_count = 0;
+
+
+extern void
+bench_set_list(char *str)
+{
+	size_t count = 1;
+	for (size_t i = 0; str[i] != '\0'; ++i)
+		if (str[i] == ',')
+			++count;
+
+	if (count > BENCH_LIST_MAX)
+		message_fatal(_("%s: Too many arguments to --benchmark"),
+				str);
+
+	bench_count = 0;
+
+	while (true) {
+		// Split off the next entry and its optional Block size.
+		char *next = strchr(str, ',');
+		if (next != NULL)
+			*next++ = '\0';
+
+		char *size = strchr(str, ':');
+		if (size != NULL)
+			*size++ = '\0';
+
+		bench_threads[bench_count] = (uint32_t)(str_to_uint64(
+				"benchmark", str, 1, 16384));
+		bench_block_sizes[bench_count] = size == NULL ? 0
+				: str_to_uint64("benchmark", size,
+					1, SIZE_MAX);
+
+#ifndef MYTHREAD_ENABLED
+		if (bench_threads[bench_count] > 1
+				|| bench_block_sizes[bench_count] > 0)
+			message_fatal(_("Threads and Block sizes in "
+					"--benchmark are not supported "
+					"by this xz"));
+#endif
+
+		++bench_count;
+
+		if (next == NULL)
+			break;
+
+		str = next;
+	}
+
+	return;
+}
+
+
+#if defined(HAVE_ENCODERS) && defined(HAVE_DECODERS)
+/// Generate text that looks a bit like a log file. A fixed seed keeps
+/// the results comparable between runs and machines.
+static uint8_t *
+bench_sample(size_t *size)
+{
+	static const char *const words[] = {
+		"info", "warning", "error", "debug", "connection",
+		"request", "response", "timeout", "user", "session",
+		"started", "finished", "failed", "retrying", "cache",
+		"miss", "hit", "disk", "network", "queue",
+	};
+
+	uint8_t *buf = xmalloc(SAMPLE_SIZE);
+	uint32_t seed = 1;
+	uint64_t line_number = 0;
+	size_t pos = 0;
+
+	while (pos < SAMPLE_SIZE) {
+		char line[256];
+		int len = snprintf(line, sizeof(line), "%" PRIu64 ":",
+				++line_number);
+
+		seed = seed * UINT32_C(1103515245) + 12345;
+		const uint32_t count = 4 + (seed >> 16) % 8;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			seed = seed * UINT32_C(1103515245) + 12345;
+			len += snprintf(line + len, sizeof(line) - (size_t)len,
+					" %s", words[(seed >> 16)
+						% ARRAY_SIZE(words)]);
+		}
+
+		seed = seed * UINT32_C(1103515245) + 12345;
+		len += snprintf(line + len, sizeof(line) - (size_t)len,
+				" %" PRIu32 "\n", (seed >> 8) % 100000);
+
+		const size_t amount = my_min((size_t)(len),
+				SAMPLE_SIZE - pos);
+		memcpy(buf + pos, line, amount);
+		pos += amount;
+	}
+
+	*size = SAMPLE_SIZE;
+	return buf;
+}
+
+
+/// Read the whole file into memory.
+static uint8_t *
+bench_read(const char *filename, size_t *size)
+{
+	const bool is_stdin = strcmp(filename, "-") == 0;
+	FILE *file = is_stdin ? stdin : fopen(filename, "rb");
+	if (file == NULL)
+		message_fatal("%s: %s", filename, strerror(errno));
+
+	size_t alloc = UINT32_C(1) << 20;
+	uint8_t *buf = xmalloc(alloc);
+	*size = 0;
+
+	while (true) {
+		*size += fread(buf + *size, 1, alloc - *size, file);
+		if (*size < alloc)
+			break;
+
+		if (alloc > SIZE_MAX / 2)
+			message_fatal(_("%s: File is too big"), filename);
+
+		alloc *= 2;
+		buf = xrealloc(buf, alloc);
+	}
+
+	if (ferror(file))
+		message_fatal(_("%s: Read error: %s"), filename,
+				strerror(errno));
+
+	if (!is_stdin)
+		fclose(file);
+
+	if (*size == 0)
+		message_fatal(_("%s: File is empty"), filename);
+
+	return buf;
+}
+
+
+/// Get an upper limit for the size of in_size bytes compressed into Blocks
+/// of block_size bytes. lzma_stream_buffer_bound() allows for only one
+/// Block, so add the Block overhead and an Index Record for each Block.
+/// Return zero if the result wouldn't fit into size_t.
+static size_t
+bench_bound(size_t in_size, uint64_t block_size)
+{
+	if (block_size == 0 || block_size >= in_size)
+		return lzma_stream_buffer_bound(in_size);
+
+	const uint64_t blocks = in_size / block_size + 1;
+	const size_t block_bound = lzma_block_buffer_bound(
+			(size_t)(block_size));
+	const size_t record = 2 * LZMA_VLI_BYTES_MAX;
+	const size_t base = lzma_stream_buffer_bound(0);
+
+	if (block_bound == 0 || blocks > (SIZE_MAX - base)
+			/ (block_bound + record))
+		return 0;
+
+	return (size_t)(blocks) * (block_bound + record) + base;
+}
+
+
+/// Run the coder until all the input has been processed. Return the amount
+/// of output or SIZE_MAX on error.
+static size_t
+bench_code(lzma_stream *strm, const uint8_t *in, size_t in_size,
+		uint8_t *out, size_t out_max)
+{
+	strm->next_in = in;
+	strm->avail_in = in_size;
+	strm->next_out = out;
+	strm->avail_out = out_max;
+
+	lzma_ret ret;
+	do {
+		ret = lzma_code(strm, LZMA_FINISH);
+	} while (ret == LZMA_OK);
+
+	lzma_end(strm);
+
+	if (ret != LZMA_STREAM_END) {
+		message_error("%s", message_strm(ret));
+		return SIZE_MAX;
+	}
+
+	return out_max - strm->avail_out;
+}
+
+
+/// Convert the amount of data and the time taken to MB/s.
+static const char *
+bench_speed(size_t size, uint64_t msec, uint32_t slot)
+{
+	// The speeds are shown with one decimal, so calculate in
+	// units of 100 kB/s.
+	const uint64_t speed = (uint64_t)(size) / 100 / my_max(msec, 1);
+	static char buf[4][32];
+	snprintf(buf[slot], sizeof(buf[slot]), "%" PRIu64 ".%" PRIu64,
+			speed / 10, speed % 10);
+	return buf[slot];
+}
+
+
+/// Compress and decompress the data with one preset, number of threads,
+/// and Block size, and print one line of results.
+static void
+bench_one(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_max,
+		uint8_t *dec, uint32_t preset, uint32_t threads,
+		uint64_t block_size)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_ret ret;
+	uint64_t enc_mem;
+
+#ifdef MYTHREAD_ENABLED
+	if (threads > 1 || block_size > 0) {
+		const lzma_mt mt = {
+			.threads = threads,
+			.block_size = block_size,
+			.preset = preset,
+			.check = LZMA_CHECK_CRC64,
+		};
+		enc_mem = lzma_stream_encoder_mt_memusage(&mt);
+		ret = lzma_stream_encoder_mt(&strm, &mt);
+	} else
+#endif
+	{
+		enc_mem = lzma_easy_encoder_memusage(preset);
+		ret = lzma_easy_encoder(&strm, preset, LZMA_CHECK_CRC64);
+	}
+
+	if (ret != LZMA_OK) {
+		message_error("%s", message_strm(ret));
+		return;
+	}
+
+	// clock() gives the processor time used by all threads.
+	clock_t cpu = clock();
+	mytime_set_start_time();
+	const size_t out_size = bench_code(&strm, in, in_size, out, out_max);
+	const uint64_t enc_msec = mytime_get_elapsed();
+	const uint64_t cpu_msec = (uint64_t)(clock() - cpu)
+			* 1000 / CLOCKS_PER_SEC;
+
+	if (out_size == SIZE_MAX)
+		return;
+
+	ret = lzma_stream_decoder(&strm, UINT64_MAX, 0);
+	if (ret != LZMA_OK) {
+		message_error("%s", message_strm(ret));
+		return;
+	}
+
+	const uint64_t dec_mem = lzma_easy_decoder_memusage(preset);
+
+	mytime_set_start_time();
+	const size_t dec_size = bench_code(&strm, out, out_size,
+			dec, in_size);
+	const uint64_t dec_msec = mytime_get_elapsed();
+
+	if (dec_size == SIZE_MAX)
+		return;
+
+	if (dec_size != in_size || memcmp(in, dec, in_size) != 0) {
+		message_error(_("Decompressed data differs from "
+				"the original with preset %" PRIu32), preset);
+		return;
+	}
+
+	// Processor time per thread as a percentage of the wall-clock time
+	const uint64_t cpu_percent = cpu_msec * 100
+			/ my_max(enc_msec, 1) / threads;
+
+	const uint32_t level = preset & LZMA_PRESET_LEVEL_MASK;
+	const char *extreme = preset & LZMA_PRESET_EXTREME ? "e" : "";
+
+	if (opt_robot) {
+		printf("bench\t%" PRIu32 "%s\t%" PRIu32 "\t%" PRIu64
+				"\t%zu\t%zu\t%" PRIu64 "\t%" PRIu64
+				"\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+				level, extreme, threads, block_size,
+				in_size, out_size, enc_msec, dec_msec,
+				cpu_msec, enc_mem, dec_mem);
+	} else {
+		char ratio[16];
+		snprintf(ratio, sizeof(ratio), "%.3f",
+				(double)(out_size) / (double)(in_size));
+
+		char block[32];
+		if (threads == 1 && block_size == 0)
+			snprintf(block, sizeof(block), "-");
+		else if (block_size == 0)
+			snprintf(block, sizeof(block), "%s", _("default"));
+		else if (block_size % (UINT64_C(1) << 20) == 0)
+			snprintf(block, sizeof(block), "%s MiB",
+					uint64_to_str(block_size >> 20, 0));
+		else if (block_size % 1024 == 0)
+			snprintf(block, sizeof(block), "%s KiB",
+					uint64_to_str(block_size >> 10, 0));
+		else
+			snprintf(block, sizeof(block), "%s B",
+					uint64_to_str(block_size, 0));
+
+		printf("   -%" PRIu32 "%-2s %7" PRIu32 " %8s %7s %11s %10s "
+				"%6s MiB %6s MiB %4" PRIu64 " %%\n",
+				level, extreme, threads, block, ratio,
+				bench_speed(in_size, enc_msec, 0),
+				bench_speed(in_size, dec_msec, 1),
+				uint64_to_str(round_up_to_mib(enc_mem), 1),
+				uint64_to_str(round_up_to_mib(dec_mem), 2),
+				cpu_percent);
+	}
+
+	fflush(stdout);
+	return;
+}
+#endif
+
+
+extern void
+bench_run(const char *filename)
+{
+#if defined(HAVE_ENCODERS) && defined(HAVE_DECODERS)
+	size_t in_size;
+	uint8_t *in = filename == NULL ? bench_sample(&in_size)
+			: bench_read(filename, &in_size);
+
+	// Without --benchmark=LIST, single-threaded mode is always
+	// measured. --threads adds the threaded encoder with
+	// --block-size or its default.
+	if (bench_count == 0) {
+		bench_threads[bench_count] = 1;
+		bench_block_sizes[bench_count] = 0;
+		++bench_count;
+
+		if (hardware_threads_get() > 1) {
+			bench_threads[bench_count] = hardware_threads_get();
+			bench_block_sizes[bench_count] = opt_block_size;
+			++bench_count;
+		}
+	}
+
+	// The threaded encoder splits the input into Blocks. Its default
+	// Block size depends on the preset but is at least 1 MiB.
+	size_t out_max = 0;
+	for (size_t i = 0; i < bench_count; ++i) {
+		uint64_t block_size = bench_block_sizes[i];
+		if (block_size == 0 && bench_threads[i] > 1)
+			block_size = UINT64_C(1) << 20;
+
+		const size_t bound = bench_bound(in_size, block_size);
+		if (bound == 0)
+			message_fatal(_("%s: File is too big"), filename);
+
+		out_max = my_max(out_max, bound);
+	}
+
+	uint8_t *out = xmalloc(out_max);
+	uint8_t *dec = xmalloc(in_size);
+
+	// Use the preset from the command line or try all of them.
+	// -e alone makes all presets extreme.
+	uint32_t preset;
+	const bool preset_given = coder_get_preset(&preset);
+	const uint32_t first = preset_given
+			? preset & LZMA_PRESET_LEVEL_MASK : 0;
+	const uint32_t last = preset_given ? first : 9;
+	const uint32_t extreme = preset & LZMA_PRESET_EXTREME;
+
+	if (opt_robot) {
+		printf("name\t%s\n", filename == NULL ? "" : filename);
+	} else {
+		if (filename == NULL)
+			printf(_("Sample: %s of generated text\n"),
+					uint64_to_nicestr(in_size, NICESTR_B,
+						NICESTR_TIB, true, 0));
+		else
+			printf("%s: %s\n", filename,
+					uint64_to_nicestr(in_size, NICESTR_B,
+						NICESTR_TIB, true, 0));
+
+		// TRANSLATORS: These are column headings. The speeds
+		// are in megabytes (10^6 bytes) per second of the
+		// uncompressed data. CPU is the processor time used
+		// by the compressor per thread.
+		puts(_("Preset  Threads    Block   Ratio  Comp. MB/s  "
+				"Dec. MB/s  Comp. mem   Dec. mem    CPU"));
+	}
+
+	for (uint32_t level = first; level <= last; ++level)
+		for (size_t i = 0; i < bench_count; ++i)
+			bench_one(in, in_size, out, out_max, dec,
+					level | extreme, bench_threads[i],
+					bench_block_sizes[i]);
+
+	free(in);
+	free(out);
+	free(dec);
+#else
+	(void)filename;
+	message_fatal(_("--benchmark needs both compression and "
+			"decompression support"));
+#endif
+
+	return;
+}
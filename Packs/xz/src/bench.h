@@ -0,0 +1,26 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       bench.h
+/// \brief      Measuring the speed of the presets in memory
+//
+//  This file has been put into the public domain.
+//  You can do whatever you want with this file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/// \brief      Set the thread counts and Block sizes to measure
+///
+/// \param      str     Argument of --benchmark=LIST: a comma-separated
+///                     list of thread counts, each optionally followed by
+///                     a colon and a Block size. The string is modified.
+extern void bench_set_list(char *str);
+
+
+/// \brief      Compress and decompress a file in memory and show the results
+///
+/// The file is read into memory and compressed with each preset (or the one
+/// given on the command line) and each entry of bench_set_list(). Without
+/// a list, one thread and, if --threads=NUM gives more, also the threaded
+/// encoder are used. The result is decompressed and compared to the
+/// original. If filename is NULL, generated sample data is used.
+extern void bench_run(const char *filename);
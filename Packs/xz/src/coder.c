@@ -12,11 +12,18 @@
 
 #include "private.h"
 
+#ifdef HAVE_LZFSE
+#	include "lzfse.h"
+#endif
+
 
 /// Return value type for coder_init().
 enum coder_init_ret {
 	CODER_INIT_NORMAL,
 	CODER_INIT_PASSTHRU,
+	CODER_INIT_THREADED,
+	CODER_INIT_RANGE,
+	CODER_INIT_LZFSE,
 	CODER_INIT_ERROR,
 };
 
@@ -27,6 +34,8 @@ bool opt_auto_adjust = true;
 bool opt_single_stream = false;
 uint64_t opt_block_size = 0;
 uint64_t *opt_block_list = NULL;
+uint64_t opt_range_offset = 0;
+uint64_t opt_range_length = UINT64_MAX;
 
 
 /// Stream used to communicate with liblzma
@@ -35,9 +44,12 @@ static lzma_stream strm = LZMA_STREAM_INIT;
 /// Filters needed for all encoding all formats, and also decoding in raw data
 static lzma_filter filters[LZMA_FILTERS_MAX + 1];
 
-/// Input and output buffers
-static io_buf in_buf;
-static io_buf out_buf;
+/// Input and output buffers. These are arrays of io_buf that can hold
+/// IO_BUFFER_SIZE_BIG bytes. They are allocated by coder_run() when first
+/// needed and kept for the following files. Only pair->src_buffer_size
+/// and pair->dest_buffer_size bytes of them are used at a time.
+static io_buf *in_buf = NULL;
+static io_buf *out_buf = NULL;
 
 /// Number of filters. Zero indicates that we are using a preset.
 static uint32_t filters_count = 0;
@@ -45,6 +57,9 @@ static uint32_t filters_count = 0;
 /// Number of the preset (0-9)
 static uint32_t preset_number = LZMA_PRESET_DEFAULT;
 
+/// True if a preset level was given on the command line
+static bool preset_is_set = false;
+
 /// Integrity check type
 static lzma_check check;
 
@@ -89,11 +104,20 @@ coder_set_preset(uint32_t new_preset)
 {
 	preset_number &= ~LZMA_PRESET_LEVEL_MASK;
 	preset_number |= new_preset;
+	preset_is_set = true;
 	forget_filter_chain();
 	return;
 }
 
 
+extern bool
+coder_get_preset(uint32_t *preset)
+{
+	*preset = preset_number;
+	return preset_is_set;
+}
+
+
 extern void
 coder_set_extreme(void)
 {
@@ -123,6 +147,71 @@ coder_add_filter(lzma_vli id, void *options)
 }
 
 
+#if defined(HAVE_ENCODERS) && defined(MYTHREAD_ENABLED)
+/// Choose the number of threads and the Block size for --threads=0 so
+/// that the threaded encoder fits in hardware_memlimit_mt_get(). If all
+/// cores cannot be used with the default Block size (three times the
+/// dictionary size), Blocks down to the dictionary size are tried too
+/// since more threads are worth a little worse compression ratio.
+/// Return the memory usage or UINT64_MAX if the options are unsupported.
+static uint64_t
+mt_auto_plan(void)
+{
+	const uint64_t budget = hardware_memlimit_mt_get(MODE_COMPRESS);
+	const uint32_t cores = hardware_threads_get();
+
+	// LZMA2 is the last filter when compressing to .xz.
+	uint64_t dict_size = 0;
+	if (filters[filters_count - 1].id == LZMA_FILTER_LZMA2) {
+		const lzma_options_lzma *opt
+				= filters[filters_count - 1].options;
+		dict_size = opt->dict_size;
+	}
+
+	uint32_t best_threads = 0;
+	uint64_t best_block_size = 0;
+	uint64_t best_usage = UINT64_MAX;
+
+	for (uint64_t mult = 3; mult > 0; --mult) {
+		// Like the default in liblzma, use at least 1 MiB Blocks.
+		mt_options.block_size = opt_block_size != 0 ? opt_block_size
+				: my_max(dict_size * mult, UINT64_C(1) << 20);
+		mt_options.threads = cores;
+
+		uint64_t usage = lzma_stream_encoder_mt_memusage(&mt_options);
+		if (usage == UINT64_MAX)
+			return UINT64_MAX;
+
+		while (usage > budget && mt_options.threads > 1) {
+			--mt_options.threads;
+			usage = lzma_stream_encoder_mt_memusage(&mt_options);
+		}
+
+		if (mt_options.threads > best_threads) {
+			best_threads = mt_options.threads;
+			best_block_size = mt_options.block_size;
+			best_usage = usage;
+		}
+
+		if (best_threads == cores || opt_block_size != 0)
+			break;
+	}
+
+	mt_options.threads = best_threads;
+	mt_options.block_size = best_block_size;
+
+	message(V_DEBUG, _("Automatic threading: %s of %s processor cores, "
+			"%s MiB Blocks, %s MiB memory budget"),
+			uint64_to_str(best_threads, 0),
+			uint64_to_str(hardware_cpu_count(), 1),
+			uint64_to_str(round_up_to_mib(best_block_size), 2),
+			uint64_to_str(round_up_to_mib(budget), 3));
+
+	return best_usage;
+}
+#endif
+
+
 static void lzma_attribute((__noreturn__))
 memlimit_too_small(uint64_t memory_usage)
 {
@@ -136,6 +225,22 @@ memlimit_too_small(uint64_t memory_usage)
 extern void
 coder_set_compression_settings(void)
 {
+#ifdef HAVE_LZFSE
+	// LZFSE has no options, so the filter chain, the integrity check,
+	// and the memory usage limit don't apply to it.
+	if (opt_format == FORMAT_LZFSE) {
+		if (filters_count != 0)
+			message_fatal(_("The .lzfse format doesn't support "
+					"custom filter chains"));
+
+		if (opt_flush_timeout != 0)
+			message_fatal(_("The .lzfse format is incompatible "
+					"with --flush-timeout"));
+
+		return;
+	}
+#endif
+
 	// The default check type is CRC64, but fallback to CRC32
 	// if CRC64 isn't supported by the copy of liblzma we are
 	// using. CRC32 is always supported.
@@ -229,8 +334,11 @@ coder_set_compression_settings(void)
 			mt_options.threads = hardware_threads_get();
 			mt_options.block_size = opt_block_size;
 			mt_options.check = check;
-			memory_usage = lzma_stream_encoder_mt_memusage(
-					&mt_options);
+			if (hardware_threads_are_automatic())
+				memory_usage = mt_auto_plan();
+			else
+				memory_usage = lzma_stream_encoder_mt_memusage(
+						&mt_options);
 			if (memory_usage != UINT64_MAX)
 				message(V_DEBUG, _("Using up to %" PRIu32
 						" threads."),
@@ -266,162 +374,1450 @@ coder_set_compression_settings(void)
 	}
 #endif
 
-	if (memory_usage <= memory_limit)
-		return;
+	if (memory_usage <= memory_limit)
+		return;
+
+	// If --no-adjust was used or we didn't find LZMA1 or
+	// LZMA2 as the last filter, give an error immediately.
+	// --format=raw implies --no-adjust.
+	if (!opt_auto_adjust || opt_format == FORMAT_RAW)
+		memlimit_too_small(memory_usage);
+
+	assert(opt_mode == MODE_COMPRESS);
+
+#ifdef HAVE_ENCODERS
+#	ifdef MYTHREAD_ENABLED
+	if (opt_format == FORMAT_XZ && mt_options.threads > 1) {
+		// Try to reduce the number of threads before
+		// adjusting the compression settings down.
+		do {
+			// FIXME? The real single-threaded mode has
+			// lower memory usage, but it's not comparable
+			// because it doesn't write the size info
+			// into Block Headers.
+			if (--mt_options.threads == 0)
+				memlimit_too_small(memory_usage);
+
+			memory_usage = lzma_stream_encoder_mt_memusage(
+					&mt_options);
+			if (memory_usage == UINT64_MAX)
+				message_bug();
+
+		} while (memory_usage > memory_limit);
+
+		message(V_WARNING, _("Adjusted the number of threads "
+			"from %s to %s to not exceed "
+			"the memory usage limit of %s MiB"),
+			uint64_to_str(hardware_threads_get(), 0),
+			uint64_to_str(mt_options.threads, 1),
+			uint64_to_str(round_up_to_mib(
+				memory_limit), 2));
+	}
+#	endif
+
+	if (memory_usage <= memory_limit)
+		return;
+
+	// Look for the last filter if it is LZMA2 or LZMA1, so we can make
+	// it use less RAM. With other filters we don't know what to do.
+	size_t i = 0;
+	while (filters[i].id != LZMA_FILTER_LZMA2
+			&& filters[i].id != LZMA_FILTER_LZMA1) {
+		if (filters[i].id == LZMA_VLI_UNKNOWN)
+			memlimit_too_small(memory_usage);
+
+		++i;
+	}
+
+	// Decrease the dictionary size until we meet the memory
+	// usage limit. First round down to full mebibytes.
+	lzma_options_lzma *opt = filters[i].options;
+	const uint32_t orig_dict_size = opt->dict_size;
+	opt->dict_size &= ~((UINT32_C(1) << 20) - 1);
+	while (true) {
+		// If it is below 1 MiB, auto-adjusting failed. We could be
+		// more sophisticated and scale it down even more, but let's
+		// see if many complain about this version.
+		//
+		// FIXME: Displays the scaled memory usage instead
+		// of the original.
+		if (opt->dict_size < (UINT32_C(1) << 20))
+			memlimit_too_small(memory_usage);
+
+		memory_usage = lzma_raw_encoder_memusage(filters);
+		if (memory_usage == UINT64_MAX)
+			message_bug();
+
+		// Accept it if it is low enough.
+		if (memory_usage <= memory_limit)
+			break;
+
+		// Otherwise 1 MiB down and try again. I hope this
+		// isn't too slow method for cases where the original
+		// dict_size is very big.
+		opt->dict_size -= UINT32_C(1) << 20;
+	}
+
+	// Tell the user that we decreased the dictionary size.
+	message(V_WARNING, _("Adjusted LZMA%c dictionary size "
+			"from %s MiB to %s MiB to not exceed "
+			"the memory usage limit of %s MiB"),
+			filters[i].id == LZMA_FILTER_LZMA2
+				? '2' : '1',
+			uint64_to_str(orig_dict_size >> 20, 0),
+			uint64_to_str(opt->dict_size >> 20, 1),
+			uint64_to_str(round_up_to_mib(memory_limit), 2));
+#endif
+
+	return;
+}
+
+
+#ifdef HAVE_DECODERS
+/// Return true if the data in in_buf seems to be in the .xz format.
+static bool
+is_format_xz(void)
+{
+	// Specify the magic as hex to be compatible with EBCDIC systems.
+	static const uint8_t magic[6] = { 0xFD, 0x37, 0x7A, 0x58, 0x5A, 0x00 };
+	return strm.avail_in >= sizeof(magic)
+			&& memcmp(in_buf->u8, magic, sizeof(magic)) == 0;
+}
+
+
+/// Return true if the data in in_buf seems to be in the .lzma format.
+static bool
+is_format_lzma(void)
+{
+	// The .lzma header is 13 bytes.
+	if (strm.avail_in < 13)
+		return false;
+
+	// Decode the LZMA1 properties.
+	lzma_filter filter = { .id = LZMA_FILTER_LZMA1 };
+	if (lzma_properties_decode(&filter, NULL, in_buf->u8, 5) != LZMA_OK)
+		return false;
+
+	// A hack to ditch tons of false positives: We allow only dictionary
+	// sizes that are 2^n or 2^n + 2^(n-1) or UINT32_MAX. LZMA_Alone
+	// created only files with 2^n, but accepts any dictionary size.
+	// If someone complains, this will be reconsidered.
+	lzma_options_lzma *opt = filter.options;
+	const uint32_t dict_size = opt->dict_size;
+	free(opt);
+
+	if (dict_size != UINT32_MAX) {
+		uint32_t d = dict_size - 1;
+		d |= d >> 2;
+		d |= d >> 3;
+		d |= d >> 4;
+		d |= d >> 8;
+		d |= d >> 16;
+		++d;
+		if (d != dict_size || dict_size == 0)
+			return false;
+	}
+
+	// Another hack to ditch false positives: Assume that if the
+	// uncompressed size is known, it must be less than 256 GiB.
+	// Again, if someone complains, this will be reconsidered.
+	uint64_t uncompressed_size = 0;
+	for (size_t i = 0; i < 8; ++i)
+		uncompressed_size |= (uint64_t)(in_buf->u8[5 + i]) << (i * 8);
+
+	if (uncompressed_size != UINT64_MAX
+			&& uncompressed_size > (UINT64_C(1) << 38))
+		return false;
+
+	return true;
+}
+
+
+#ifdef HAVE_LZFSE
+/// Return true if the data in in_buf seems to be in the .lzfse format.
+static bool
+is_format_lzfse(void)
+{
+	// LZFSE streams are a sequence of blocks, each starting with
+	// "bvx" and a character telling the block type.
+	static const uint8_t magic[3] = { 0x62, 0x76, 0x78 };
+	static const uint8_t types[] = {
+		0x2D, // '-' uncompressed
+		0x31, // '1' LZFSE with uncompressed tables
+		0x32, // '2' LZFSE
+		0x6E, // 'n' LZVN
+		0x63, // 'c' checksum of the decoded stream
+		0x24, // '$' end of stream
+	};
+
+	return strm.avail_in >= 4
+			&& memcmp(in_buf->u8, magic, sizeof(magic)) == 0
+			&& memchr(types, in_buf->u8[3], sizeof(types))
+				!= NULL;
+}
+#endif
+#endif
+
+
+#ifdef MYTHREAD_ENABLED
+/// The threaded decoder and the pipelined coder don't let the main thread
+/// touch strm while coding. Progress information is kept in total_in and
+/// total_out like in passthru mode.
+static lzma_stream mt_progress = LZMA_STREAM_INIT;
+
+
+/// Number of input and output buffers in the pipelined coder
+#define PIPELINE_BUFS 4
+
+/// The coder thread gives the input buffers to liblzma in slices of this
+/// many bytes so that its progress is published often enough.
+#define PIPELINE_SLICE (IO_BUFFER_SIZE_BIG / 16)
+
+/// How long the main thread waits for the coder thread at a time (in
+/// milliseconds) before checking if the progress indicator needs updating
+#define PIPELINE_PROGRESS_TIMEOUT 100
+
+
+/// State of the pipelined coder. lzma_code() is called in a separate
+/// thread while the main thread reads the input file ahead into in[]
+/// and writes the finished buffers from out[]. The buffers hold
+/// IO_BUFFER_SIZE_BIG bytes; in[0] and out[0] are in_buf and out_buf.
+static struct {
+	io_buf *in[PIPELINE_BUFS];
+	io_buf *out[PIPELINE_BUFS];
+
+	/// Amount of data in each buffer
+	size_t in_size[PIPELINE_BUFS];
+	size_t out_size[PIPELINE_BUFS];
+
+	/// The filled input buffers are in_count buffers starting from
+	/// in[in_first]. The coder thread keeps using in[in_first] until
+	/// all of it has been consumed.
+	unsigned in_first;
+	unsigned in_count;
+
+	/// The finished output buffers are out_count buffers starting from
+	/// out[out_first]. The coder thread fills the buffer after them.
+	unsigned out_first;
+	unsigned out_count;
+
+	/// Amount of in[in_first] after strm.next_in + strm.avail_in that
+	/// hasn't been given to liblzma yet. Used only by the coder thread.
+	size_t in_rest;
+
+	/// Input consumed and output produced by the coder thread according
+	/// to lzma_get_progress(). The main thread copies these to
+	/// mt_progress; counting the data read and written instead would
+	/// run ahead of the coder by up to PIPELINE_BUFS buffers.
+	uint64_t progress_in;
+	uint64_t progress_out;
+
+	/// True once the main thread has read the whole input file
+	bool in_eof;
+
+	/// True once the coder thread has finished and published its
+	/// last output buffer. ret is then the final return value.
+	bool done;
+	lzma_ret ret;
+
+	/// LZMA_NO_CHECK or LZMA_UNSUPPORTED_CHECK if the main thread
+	/// needs to display a warning, otherwise LZMA_OK
+	lzma_ret warning;
+
+	/// True when the coder thread should exit
+	bool exit;
+
+	mythread thread;
+	mythread_mutex mutex;
+
+	/// Signaled by both threads when the rings change. Only one of
+	/// the two threads can be waiting at a time.
+	mythread_cond cond;
+
+} pipeline;
+
+
+/// Give the next slice of the current input buffer to liblzma.
+static void
+pipeline_next_slice(void)
+{
+	const size_t size = my_min(pipeline.in_rest, PIPELINE_SLICE);
+	strm.avail_in = size;
+	pipeline.in_rest -= size;
+	return;
+}
+
+
+/// Release the input buffer that has been consumed (if any) and wait for
+/// the next one. *holding is set to false when there is no more input.
+/// Return true if the coder thread should exit.
+static bool
+pipeline_next_input(bool *holding)
+{
+	bool exit;
+
+	mythread_sync(pipeline.mutex) {
+		if (*holding) {
+			pipeline.in_first = (pipeline.in_first + 1)
+					% PIPELINE_BUFS;
+			--pipeline.in_count;
+			mythread_cond_signal(&pipeline.cond);
+		}
+
+		while (pipeline.in_count == 0 && !pipeline.in_eof
+				&& !pipeline.exit)
+			mythread_cond_wait(&pipeline.cond, &pipeline.mutex);
+
+		exit = pipeline.exit;
+		*holding = pipeline.in_count > 0;
+		if (*holding) {
+			strm.next_in = pipeline.in[pipeline.in_first]->u8;
+			pipeline.in_rest = pipeline.in_size[pipeline.in_first];
+			pipeline_next_slice();
+		}
+	}
+
+	return exit;
+}
+
+
+/// Pass the full output buffer to the main thread and wait for a free one.
+/// Return true if the coder thread should exit.
+static bool
+pipeline_next_output(void)
+{
+	bool exit;
+
+	mythread_sync(pipeline.mutex) {
+		unsigned i = (pipeline.out_first + pipeline.out_count)
+				% PIPELINE_BUFS;
+		pipeline.out_size[i] = IO_BUFFER_SIZE_BIG;
+		++pipeline.out_count;
+		mythread_cond_signal(&pipeline.cond);
+
+		while (pipeline.out_count == PIPELINE_BUFS && !pipeline.exit)
+			mythread_cond_wait(&pipeline.cond, &pipeline.mutex);
+
+		exit = pipeline.exit;
+		i = (pipeline.out_first + pipeline.out_count) % PIPELINE_BUFS;
+		strm.next_out = pipeline.out[i]->u8;
+		strm.avail_out = IO_BUFFER_SIZE_BIG;
+	}
+
+	return exit;
+}
+
+
+/// Publish the progress of the coder thread for the main thread.
+static void
+pipeline_progress(void)
+{
+	uint64_t in_pos;
+	uint64_t out_pos;
+	lzma_get_progress(&strm, &in_pos, &out_pos);
+
+	mythread_sync(pipeline.mutex) {
+		pipeline.progress_in = in_pos;
+		pipeline.progress_out = out_pos;
+	}
+
+	return;
+}
+
+
+/// The coding loop of the pipelined coder. This is coder_normal() without
+/// the features that pipeline_start() doesn't allow.
+static MYTHREAD_RET_TYPE
+pipeline_coder(void *arg lzma_attribute((__unused__)))
+{
+	// When decompressing, the first input chunk in in_buf is in use.
+	// The main thread may already be reading more input so in_count
+	// cannot be used to determine this.
+	bool holding = opt_mode != MODE_COMPRESS;
+	lzma_action action = LZMA_RUN;
+	lzma_ret ret = LZMA_PROG_ERROR;
+
+	while (true) {
+		if (strm.avail_in == 0 && action == LZMA_RUN) {
+			if (pipeline.in_rest > 0) {
+				pipeline_next_slice();
+			} else {
+				if (pipeline_next_input(&holding))
+					break;
+
+				if (!holding)
+					action = LZMA_FINISH;
+			}
+		}
+
+		ret = lzma_code(&strm, action);
+		pipeline_progress();
+
+		if (strm.avail_out == 0 && pipeline_next_output())
+			break;
+
+		if (ret == LZMA_OK)
+			continue;
+
+		if (ret == LZMA_NO_CHECK || ret == LZMA_UNSUPPORTED_CHECK) {
+			mythread_sync(pipeline.mutex) {
+				pipeline.warning = ret;
+				mythread_cond_signal(&pipeline.cond);
+			}
+
+			continue;
+		}
+
+		// Check that there is no trailing garbage. This is needed
+		// for LZMA_Alone and raw streams.
+		if (ret == LZMA_STREAM_END) {
+			if (strm.avail_in == 0 && pipeline.in_rest == 0
+					&& pipeline_next_input(&holding))
+				break;
+
+			if (holding && (strm.avail_in != 0
+					|| pipeline.in_rest != 0))
+				ret = LZMA_DATA_ERROR;
+		}
+
+		break;
+	}
+
+	// Pass also the last partial output buffer to the main thread.
+	// It is written even if something went wrong, because that way
+	// the user gets as much data as possible.
+	mythread_sync(pipeline.mutex) {
+		const unsigned i = (pipeline.out_first + pipeline.out_count)
+				% PIPELINE_BUFS;
+		pipeline.out_size[i] = IO_BUFFER_SIZE_BIG - strm.avail_out;
+		if (!pipeline.exit && pipeline.out_size[i] > 0)
+			++pipeline.out_count;
+
+		pipeline.done = true;
+		pipeline.ret = ret;
+		mythread_cond_signal(&pipeline.cond);
+	}
+
+	return MYTHREAD_RET_VALUE;
+}
+
+
+/// Start the coder thread of the pipelined coder if it can be used with
+/// this file pair. strm has to be ready for coding, and with decompression
+/// the first input chunk has been read into in_buf. Return true if the
+/// thread was started and coder_pipelined() has to be called.
+static bool
+pipeline_start(file_pair *pair)
+{
+	// Reading ahead and writing in the background are useful only
+	// with regular files. With them the 2 MiB buffers are used, which
+	// also means that --flush-timeout wasn't used. Files that fit into
+	// one buffer don't need a pipeline.
+	if (pair->src_buffer_size != IO_BUFFER_SIZE_BIG
+			|| pair->dest_buffer_size != IO_BUFFER_SIZE_BIG
+			|| pair->src_st.st_size <= IO_BUFFER_SIZE_BIG)
+		return false;
+
+	// --single-stream needs to know exactly how much input the decoder
+	// left unused, and Block splitting in single-threaded compression
+	// is driven by the amount of input read. Let coder_normal() handle
+	// these cases.
+	if (opt_single_stream)
+		return false;
+
+	if (opt_mode == MODE_COMPRESS && opt_format == FORMAT_XZ
+			&& (opt_block_list != NULL
+				|| (hardware_threads_get() == 1
+					&& opt_block_size > 0)))
+		return false;
+
+#ifdef ENABLE_SANDBOX
+	// Don't create threads when the sandbox is going to be used.
+	if (io_sandbox_allowed())
+		return false;
+#endif
+
+	if (pipeline.in[0] == NULL) {
+		pipeline.in[0] = in_buf;
+		pipeline.out[0] = out_buf;
+
+		for (unsigned i = 1; i < PIPELINE_BUFS; ++i) {
+			pipeline.in[i] = xmalloc(IO_BUFFER_SIZE_BIG);
+			pipeline.out[i] = xmalloc(IO_BUFFER_SIZE_BIG);
+		}
+	}
+
+	if (mythread_mutex_init(&pipeline.mutex)
+			|| mythread_cond_init(&pipeline.cond))
+		message_fatal(_("Cannot initialize threads"));
+
+	// When decompressing, the rest of the first input chunk is
+	// still in in_buf.
+	pipeline.in_first = 0;
+	pipeline.in_count = opt_mode == MODE_COMPRESS ? 0 : 1;
+	pipeline.in_size[0] = strm.avail_in;
+	pipeline.in_eof = pair->src_eof;
+	pipeline.out_first = 0;
+	pipeline.out_count = 0;
+	pipeline.done = false;
+	pipeline.warning = LZMA_OK;
+	pipeline.exit = false;
+
+	// The coder thread starts with the first slice of what is left.
+	pipeline.in_rest = strm.avail_in;
+	strm.avail_in = 0;
+
+	pipeline.progress_in = strm.total_in;
+	pipeline.progress_out = strm.total_out;
+	mt_progress.total_in = strm.total_in;
+	mt_progress.total_out = strm.total_out;
+
+	strm.next_out = out_buf->u8;
+	strm.avail_out = IO_BUFFER_SIZE_BIG;
+
+	if (mythread_create(&pipeline.thread, &pipeline_coder, NULL)) {
+		mythread_cond_destroy(&pipeline.cond);
+		mythread_mutex_destroy(&pipeline.mutex);
+		return false;
+	}
+
+	return true;
+}
+
+
+/// Read and write the files while the thread started by pipeline_start()
+/// does the coding.
+static bool
+coder_pipelined(file_pair *pair)
+{
+	// True if the coder thread finished and all its output was written
+	bool finished = false;
+
+	while (!user_abort) {
+		bool done;
+		bool can_read;
+		lzma_ret warning;
+		unsigned out_count;
+		unsigned out_index;
+		unsigned in_index;
+
+		mythread_sync(pipeline.mutex) {
+			// Don't wait for so long that the progress indicator
+			// or SIGUSR1 would go unanswered.
+			mythread_condtime wait_until;
+			mythread_condtime_set(&wait_until, &pipeline.cond,
+					PIPELINE_PROGRESS_TIMEOUT);
+
+			while (!user_abort && pipeline.out_count == 0
+					&& !pipeline.done
+					&& pipeline.warning == LZMA_OK
+					&& (pipeline.in_eof
+						|| pipeline.in_count
+							== PIPELINE_BUFS))
+				if (mythread_cond_timedwait(&pipeline.cond,
+						&pipeline.mutex, &wait_until))
+					break;
+
+			mt_progress.total_in = pipeline.progress_in;
+			mt_progress.total_out = pipeline.progress_out;
+
+			done = pipeline.done;
+			warning = pipeline.warning;
+			pipeline.warning = LZMA_OK;
+			out_count = pipeline.out_count;
+			out_index = pipeline.out_first;
+			can_read = !pipeline.in_eof
+					&& pipeline.in_count < PIPELINE_BUFS;
+			in_index = (pipeline.in_first + pipeline.in_count)
+					% PIPELINE_BUFS;
+		}
+
+		if (warning != LZMA_OK) {
+			// When compressing, all possible errors set
+			// pipeline.ret instead.
+			assert(opt_mode != MODE_COMPRESS);
+			message_warning("%s: %s", pair->src_name,
+					message_strm(warning));
+		}
+
+		if (out_count > 0) {
+			const size_t size = pipeline.out_size[out_index];
+			if (opt_mode != MODE_TEST && io_write(pair,
+					pipeline.out[out_index], size))
+				break;
+
+			mythread_sync(pipeline.mutex) {
+				pipeline.out_first = (pipeline.out_first + 1)
+						% PIPELINE_BUFS;
+				--pipeline.out_count;
+				mythread_cond_signal(&pipeline.cond);
+			}
+
+		} else if (done) {
+			finished = true;
+			break;
+		}
+
+		if (can_read && !done) {
+			const size_t size = io_read(pair,
+					pipeline.in[in_index],
+					IO_BUFFER_SIZE_BIG);
+			if (size == SIZE_MAX)
+				break;
+
+			mythread_sync(pipeline.mutex) {
+				pipeline.in_size[in_index] = size;
+				if (size > 0)
+					++pipeline.in_count;
+
+				pipeline.in_eof = pair->src_eof;
+				mythread_cond_signal(&pipeline.cond);
+			}
+		}
+
+		message_progress_update();
+	}
+
+	mythread_sync(pipeline.mutex) {
+		pipeline.exit = true;
+		mythread_cond_signal(&pipeline.cond);
+	}
+
+	mythread_join(pipeline.thread);
+	mythread_cond_destroy(&pipeline.cond);
+	mythread_mutex_destroy(&pipeline.mutex);
+
+	if (!finished)
+		return false;
+
+	if (pipeline.ret != LZMA_STREAM_END) {
+		message_error("%s: %s", pair->src_name,
+				message_strm(pipeline.ret));
+
+		if (pipeline.ret == LZMA_MEMLIMIT_ERROR)
+			message_mem_needed(V_ERROR, lzma_memusage(&strm));
+
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+
+#if defined(HAVE_DECODERS) && defined(MYTHREAD_ENABLED)
+/// State of a Block slot in the threaded decoder
+enum slot_state {
+	SLOT_FREE,
+	SLOT_PENDING,
+	SLOT_RUNNING,
+	SLOT_DONE,
+};
+
+
+/// One Block queued to the threaded decoder
+typedef struct {
+	/// State of this slot; protected by mtd.mutex
+	enum slot_state state;
+
+	/// Number of the Block in the file
+	lzma_vli number;
+
+	/// Integrity check type of the Stream containing this Block
+	lzma_check check;
+
+	/// Unpadded Size of the Block as stored in the Index
+	lzma_vli unpadded_size;
+
+	/// Size of the whole Block in in[] (Total Size in the Index)
+	size_t in_size;
+
+	/// Uncompressed Size of the Block as stored in the Index
+	size_t out_size;
+
+	/// Return value from decoding the Block
+	lzma_ret ret;
+
+	/// Decoder memory usage of the Block, set by the worker
+	uint64_t memusage;
+
+	/// Input and output buffers, allocated for the biggest Block
+	io_buf *in;
+	io_buf *out;
+
+} mt_slot;
+
+
+/// State of the threaded decoder
+static struct {
+	/// Combined Index of the input file, read in coder_init()
+	lzma_index *idx;
+
+	/// Number of worker threads and also the number of slots
+	uint32_t threads;
+
+	/// Size of the biggest Block in the file as multiples of io_buf
+	size_t in_bufs;
+	size_t out_bufs;
+
+	mt_slot *slots;
+	mythread *workers;
+
+	mythread_mutex mutex;
+
+	/// Signaled when a slot becomes SLOT_PENDING or when
+	/// the workers need to exit
+	mythread_cond work_cond;
+
+	/// Signaled when a slot becomes SLOT_DONE
+	mythread_cond done_cond;
+
+	/// True when the workers should exit
+	bool exit;
+
+} mtd;
+
+
+/// Decode one Block from slot->in into slot->out. This is called
+/// from the worker threads without holding the mutex.
+static lzma_ret
+mt_decode_block(mt_slot *slot)
+{
+	lzma_filter block_filters[LZMA_FILTERS_MAX + 1];
+	lzma_block block = {
+		.version = 1,
+		.check = slot->check,
+		.filters = block_filters,
+	};
+
+	const uint8_t *in = slot->in->u8;
+	block.header_size = lzma_block_header_size_decode(in[0]);
+	if (in[0] == 0x00 || block.header_size > slot->in_size)
+		return LZMA_DATA_ERROR;
+
+	lzma_ret ret = lzma_block_header_decode(&block, NULL, in);
+	if (ret != LZMA_OK)
+		return ret;
+
+	// lzma_block_header_decode() resets ignore_check.
+	block.ignore_check = opt_ignore_check;
+
+	slot->memusage = lzma_raw_decoder_memusage(block_filters);
+	if (slot->memusage > hardware_memlimit_get(MODE_DECOMPRESS))
+		ret = LZMA_MEMLIMIT_ERROR;
+	else
+		ret = lzma_block_compressed_size(&block, slot->unpadded_size);
+
+	if (ret == LZMA_OK) {
+		size_t in_pos = block.header_size;
+		size_t out_pos = 0;
+		ret = lzma_block_buffer_decode(&block, NULL,
+				in, &in_pos, slot->in_size,
+				slot->out->u8, &out_pos, slot->out_size);
+
+		// The sizes in the Index must match the Block exactly.
+		if (ret == LZMA_OK && (in_pos != slot->in_size
+				|| out_pos != slot->out_size))
+			ret = LZMA_DATA_ERROR;
+	}
+
+	for (size_t i = 0; block_filters[i].id != LZMA_VLI_UNKNOWN; ++i)
+		free(block_filters[i].options);
+
+	return ret;
+}
+
+
+static MYTHREAD_RET_TYPE
+mt_worker(void *arg lzma_attribute((__unused__)))
+{
+	mythread_mutex_lock(&mtd.mutex);
+
+	while (true) {
+		// Take the oldest pending Block so that the Blocks
+		// become ready in about the same order as they
+		// are written out.
+		mt_slot *slot = NULL;
+		while (!mtd.exit) {
+			for (uint32_t i = 0; i < mtd.threads; ++i)
+				if (mtd.slots[i].state == SLOT_PENDING
+						&& (slot == NULL
+						|| mtd.slots[i].number
+							< slot->number))
+					slot = &mtd.slots[i];
+
+			if (slot != NULL)
+				break;
+
+			mythread_cond_wait(&mtd.work_cond, &mtd.mutex);
+		}
+
+		if (slot == NULL)
+			break;
+
+		slot->state = SLOT_RUNNING;
+		mythread_mutex_unlock(&mtd.mutex);
+
+		const lzma_ret ret = mt_decode_block(slot);
+
+		mythread_mutex_lock(&mtd.mutex);
+		slot->ret = ret;
+		slot->state = SLOT_DONE;
+		mythread_cond_signal(&mtd.done_cond);
+	}
+
+	mythread_mutex_unlock(&mtd.mutex);
+	return MYTHREAD_RET_VALUE;
+}
+
+
+/// Round size up to a multiple of io_buf. Zero is rounded to one
+/// so that the buffers can always be allocated.
+static size_t
+mt_bufs(uint64_t size)
+{
+	return size == 0 ? 1 : (size_t)((size + IO_BUFFER_SIZE - 1)
+			/ IO_BUFFER_SIZE);
+}
+
+
+/// See if the threaded decoder can be used for the input file. This is
+/// called from coder_init() after the first Block Header has been decoded
+/// with strm. On success mtd.idx and mtd.threads have been set and true
+/// is returned. If the file should be decoded with strm, false is
+/// returned and the input file position is left untouched. If the Index
+/// cannot be read, *error is set to true.
+static bool
+mt_decoder_init(file_pair *pair, bool *error)
+{
+	// Only regular files can be read out of order. Small files are
+	// read completely already and aren't worth the threads.
+	if (hardware_threads_get() < 2 || opt_single_stream
+			|| pair->src_fd == STDIN_FILENO
+			|| !S_ISREG(pair->src_st.st_mode)
+			|| pair->src_eof
+			|| pair->src_st.st_size < 2 * LZMA_STREAM_HEADER_SIZE)
+		return false;
+
+	const off_t src_pos = lseek(pair->src_fd, 0, SEEK_CUR);
+	if (src_pos == -1)
+		return false;
+
+	// Check that the file ends with a Stream Footer before trying
+	// to read the Index. This way truncated files, which may still
+	// be partially recovered with the single-threaded decoder,
+	// don't get reported as an Index error.
+	io_buf buf;
+	lzma_stream_flags footer_flags;
+	bool use_threads = !io_pread(pair, &buf, LZMA_STREAM_HEADER_SIZE,
+			pair->src_st.st_size - LZMA_STREAM_HEADER_SIZE)
+		&& lzma_stream_footer_decode(&footer_flags, buf.u8)
+			== LZMA_OK;
+
+	if (use_threads) {
+		mtd.idx = list_read_index(pair);
+		if (mtd.idx == NULL) {
+			*error = true;
+			return false;
+		}
+
+		const lzma_vli blocks = lzma_index_block_count(mtd.idx);
+
+		lzma_index_iter iter;
+		lzma_index_iter_init(&iter, mtd.idx);
+
+		uint64_t in_max = 0;
+		uint64_t out_max = 0;
+		while (use_threads && !lzma_index_iter_next(
+				&iter, LZMA_INDEX_ITER_BLOCK)) {
+			in_max = my_max(in_max, iter.block.total_size);
+			out_max = my_max(out_max,
+					iter.block.uncompressed_size);
+
+			// Let the single-threaded decoder warn about
+			// unsupported checks.
+			if (!opt_ignore_check && !lzma_check_is_supported(
+					iter.stream.flags->check))
+				use_threads = false;
+		}
+
+		// Each thread needs a decoder like the one for the first
+		// Block and the buffers for the biggest Block. The total
+		// is kept within the memory usage limit and, to not hog
+		// all the RAM by default, within a quarter of the RAM.
+		const uint64_t memlimit
+				= hardware_memlimit_mt_get(MODE_DECOMPRESS);
+
+		const uint64_t per_thread = lzma_memusage(&strm)
+				+ in_max + out_max + 2 * IO_BUFFER_SIZE;
+
+		uint64_t threads = my_min(hardware_threads_get(), blocks);
+		if (out_max > SIZE_MAX / 4 || in_max > SIZE_MAX / 4)
+			threads = 0;
+		else
+			threads = my_min(threads, memlimit / per_thread);
+
+		if (use_threads && threads >= 2) {
+			mtd.threads = (uint32_t)(threads);
+			mtd.in_bufs = mt_bufs(in_max);
+			mtd.out_bufs = mt_bufs(out_max);
+			message(V_DEBUG, _("Using up to %" PRIu32
+					" threads."), mtd.threads);
+		} else {
+			use_threads = false;
+			lzma_index_end(mtd.idx, NULL);
+			mtd.idx = NULL;
+		}
+	}
+
+	// Restore the file position for the single-threaded decoder.
+	if (!use_threads && lseek(pair->src_fd, src_pos, SEEK_SET) == -1) {
+		message_error(_("%s: Error seeking the file: %s"),
+				pair->src_name, strerror(errno));
+		*error = true;
+	}
+
+	return use_threads;
+}
+
+
+/// Decompress or test with the threaded decoder. The main thread reads
+/// the Blocks into free slots and writes the decoded Blocks in order
+/// while the worker threads decode the Blocks.
+static bool
+coder_threaded(file_pair *pair)
+{
+	bool success = false;
+
+	if (mythread_mutex_init(&mtd.mutex)
+			|| mythread_cond_init(&mtd.work_cond)
+			|| mythread_cond_init(&mtd.done_cond))
+		message_fatal(_("Cannot initialize threads"));
+
+	mtd.exit = false;
+	mtd.slots = xmalloc(mtd.threads * sizeof(mt_slot));
+	mtd.workers = xmalloc(mtd.threads * sizeof(mythread));
+
+	for (uint32_t i = 0; i < mtd.threads; ++i) {
+		mtd.slots[i].state = SLOT_FREE;
+		mtd.slots[i].in = xmalloc(mtd.in_bufs * sizeof(io_buf));
+		mtd.slots[i].out = xmalloc(mtd.out_bufs * sizeof(io_buf));
+	}
+
+	// If fewer threads than planned can be created, the slots
+	// are simply shared by fewer workers.
+	uint32_t workers = 0;
+	while (workers < mtd.threads) {
+		const int err = mythread_create(&mtd.workers[workers],
+				&mt_worker, NULL);
+		if (err != 0) {
+			if (workers == 0) {
+				message_error(_("%s: Cannot create "
+						"a thread: %s"),
+						pair->src_name,
+						strerror(err));
+				goto out;
+			}
+
+			break;
+		}
+
+		++workers;
+	}
+
+	lzma_index_iter iter;
+	lzma_index_iter_init(&iter, mtd.idx);
+
+	const lzma_vli blocks = lzma_index_block_count(mtd.idx);
+	lzma_vli next_read = 0;
+	lzma_vli next_write = 0;
+
+	while (!user_abort) {
+		// Read more Blocks as long as there are free slots.
+		while (next_read < blocks
+				&& next_read - next_write < mtd.threads) {
+			mt_slot *slot = &mtd.slots[next_read % mtd.threads];
+			if (lzma_index_iter_next(
+					&iter, LZMA_INDEX_ITER_BLOCK))
+				message_bug();
+
+			slot->number = next_read;
+			slot->check = iter.stream.flags->check;
+			slot->unpadded_size = iter.block.unpadded_size;
+			slot->in_size = (size_t)(iter.block.total_size);
+			slot->out_size = (size_t)(
+					iter.block.uncompressed_size);
+
+			const off_t offset = (off_t)(
+					iter.block.compressed_file_offset);
+			for (size_t pos = 0; pos < slot->in_size;
+					pos += pair->src_buffer_size) {
+				const size_t size = my_min(
+						pair->src_buffer_size,
+						slot->in_size - pos);
+				if (io_pread(pair,
+						&slot->in[pos / IO_BUFFER_SIZE],
+						size, offset + (off_t)(pos)))
+					goto out;
+			}
+
+			mythread_sync(mtd.mutex) {
+				slot->state = SLOT_PENDING;
+				mythread_cond_signal(&mtd.work_cond);
+			}
+
+			++next_read;
+		}
+
+		if (next_write == blocks) {
+			mt_progress.total_in = (uint64_t)(
+					pair->src_st.st_size);
+			success = true;
+			break;
+		}
+
+		// Wait for the oldest Block and write it out.
+		mt_slot *slot = &mtd.slots[next_write % mtd.threads];
+		mythread_sync(mtd.mutex) {
+			while (slot->state != SLOT_DONE)
+				mythread_cond_wait(&mtd.done_cond,
+						&mtd.mutex);
+		}
+
+		if (slot->ret != LZMA_OK) {
+			message_error("%s: %s", pair->src_name,
+					message_strm(slot->ret));
+			if (slot->ret == LZMA_MEMLIMIT_ERROR)
+				message_mem_needed(V_ERROR, slot->memusage);
+
+			break;
+		}
+
+		if (opt_mode != MODE_TEST) {
+			for (size_t pos = 0; pos < slot->out_size;
+					pos += pair->dest_buffer_size)
+				if (io_write(pair,
+						&slot->out[pos / IO_BUFFER_SIZE],
+						my_min(pair->dest_buffer_size,
+							slot->out_size - pos)))
+					goto out;
+		}
+
+		mt_progress.total_in += slot->in_size;
+		mt_progress.total_out += slot->out_size;
+
+		mythread_sync(mtd.mutex) {
+			slot->state = SLOT_FREE;
+		}
+
+		++next_write;
+
+		message_progress_update();
+	}
+
+out:
+	// Tell the workers to exit. Blocks that are being decoded are
+	// finished first but pending Blocks are ignored.
+	mythread_sync(mtd.mutex) {
+		mtd.exit = true;
+		for (uint32_t i = 0; i < workers; ++i)
+			mythread_cond_signal(&mtd.work_cond);
+	}
+
+	for (uint32_t i = 0; i < workers; ++i)
+		mythread_join(mtd.workers[i]);
+
+	for (uint32_t i = 0; i < mtd.threads; ++i) {
+		free(mtd.slots[i].in);
+		free(mtd.slots[i].out);
+	}
+
+	free(mtd.slots);
+	free(mtd.workers);
+	mythread_cond_destroy(&mtd.done_cond);
+	mythread_cond_destroy(&mtd.work_cond);
+	mythread_mutex_destroy(&mtd.mutex);
+
+	return success;
+}
+#endif
+
+
+#ifdef HAVE_DECODERS
+/// Combined Index of the input file when --offset or --length was used
+static lzma_index *range_idx = NULL;
+
+
+/// Read the Index of the input file for --offset and --length.
+/// Return true on error.
+static bool
+range_init(file_pair *pair)
+{
+	if (!S_ISREG(pair->src_st.st_mode)) {
+		message_error(_("%s: --offset and --length need "
+				"a seekable .xz file"), pair->src_name);
+		return true;
+	}
+
+	range_idx = list_read_index(pair);
+	return range_idx == NULL;
+}
+
+
+/// Write the decoded data from out_buf except the first *skip bytes and
+/// anything after *left bytes.
+static bool
+range_write(file_pair *pair, uint64_t *skip, uint64_t *left)
+{
+	const size_t size = pair->dest_buffer_size - strm.avail_out;
+	const size_t start = my_min(*skip, size);
+	const size_t amount = my_min(size - start, *left);
+	*skip -= start;
+
+	if (amount > 0) {
+		// io_write() needs the data at the beginning of an io_buf.
+		memmove(out_buf->u8, out_buf->u8 + start, amount);
+		if (io_write(pair, out_buf, amount))
+			return true;
+
+		*left -= amount;
+	}
+
+	strm.next_out = out_buf->u8;
+	strm.avail_out = pair->dest_buffer_size;
+	return false;
+}
+
+
+/// Decode the Block pointed by *iter, stopping early if the rest of
+/// the Block isn't needed. Return true on error.
+static bool
+range_decode_block(file_pair *pair, const lzma_index_iter *iter,
+		uint64_t *skip, uint64_t *left)
+{
+	lzma_filter block_filters[LZMA_FILTERS_MAX + 1];
+	lzma_block block = {
+		.version = 1,
+		.check = iter->stream.flags->check,
+		.filters = block_filters,
+	};
+
+	off_t pos = (off_t)(iter->block.compressed_file_offset);
+	uint64_t remaining = iter->block.total_size;
+
+	// Read the Block Header. in_buf is big enough for the biggest
+	// possible Block Header.
+	if (io_pread(pair, in_buf, 1, pos))
+		return true;
+
+	block.header_size = lzma_block_header_size_decode(in_buf->u8[0]);
+	if (in_buf->u8[0] == 0x00 || block.header_size > remaining) {
+		message_error("%s: %s", pair->src_name,
+				message_strm(LZMA_DATA_ERROR));
+		return true;
+	}
+
+	if (io_pread(pair, in_buf, block.header_size, pos))
+		return true;
+
+	lzma_ret ret = lzma_block_header_decode(&block, NULL, in_buf->u8);
+	if (ret != LZMA_OK) {
+		message_error("%s: %s", pair->src_name, message_strm(ret));
+		return true;
+	}
+
+	// lzma_block_header_decode() resets ignore_check.
+	block.ignore_check = opt_ignore_check;
+
+	const uint64_t memusage = lzma_raw_decoder_memusage(block_filters);
+	if (memusage > hardware_memlimit_get(MODE_DECOMPRESS))
+		ret = LZMA_MEMLIMIT_ERROR;
+	else
+		ret = lzma_block_compressed_size(
+				&block, iter->block.unpadded_size);
+
+	// The offsets are calculated from the Index so the Block
+	// must agree with it.
+	if (ret == LZMA_OK) {
+		if (block.uncompressed_size == LZMA_VLI_UNKNOWN)
+			block.uncompressed_size
+					= iter->block.uncompressed_size;
+		else if (block.uncompressed_size
+				!= iter->block.uncompressed_size)
+			ret = LZMA_DATA_ERROR;
+	}
+
+	if (ret == LZMA_OK) {
+		// lzma_block_decoder() resets the totals. Keep them
+		// counting for the progress indicator.
+		const uint64_t total_in = strm.total_in;
+		const uint64_t total_out = strm.total_out;
+		ret = lzma_block_decoder(&strm, &block);
+		strm.total_in = total_in;
+		strm.total_out = total_out;
+	}
+
+	pos += block.header_size;
+	remaining -= block.header_size;
+	strm.avail_in = 0;
+
+	bool error = ret != LZMA_OK;
 
-	// If --no-adjust was used or we didn't find LZMA1 or
-	// LZMA2 as the last filter, give an error immediately.
-	// --format=raw implies --no-adjust.
-	if (!opt_auto_adjust || opt_format == FORMAT_RAW)
-		memlimit_too_small(memory_usage);
+	while (!error && !user_abort) {
+		if (strm.avail_in == 0 && remaining > 0) {
+			const size_t size = my_min(remaining,
+					pair->src_buffer_size);
+			if (io_pread(pair, in_buf, size, pos)) {
+				error = true;
+				break;
+			}
 
-	assert(opt_mode == MODE_COMPRESS);
+			pos += (off_t)(size);
+			remaining -= size;
+			strm.next_in = in_buf->u8;
+			strm.avail_in = size;
+		}
 
-#ifdef HAVE_ENCODERS
-#	ifdef MYTHREAD_ENABLED
-	if (opt_format == FORMAT_XZ && mt_options.threads > 1) {
-		// Try to reduce the number of threads before
-		// adjusting the compression settings down.
-		do {
-			// FIXME? The real single-threaded mode has
-			// lower memory usage, but it's not comparable
-			// because it doesn't write the size info
-			// into Block Headers.
-			if (--mt_options.threads == 0)
-				memlimit_too_small(memory_usage);
+		ret = lzma_code(&strm, LZMA_RUN);
 
-			memory_usage = lzma_stream_encoder_mt_memusage(
-					&mt_options);
-			if (memory_usage == UINT64_MAX)
-				message_bug();
+		// Write also what was decoded before an error, because
+		// that way the user gets as much data as possible.
+		if (strm.avail_out == 0 || ret != LZMA_OK) {
+			if (range_write(pair, skip, left)) {
+				error = true;
+				break;
+			}
 
-		} while (memory_usage > memory_limit);
+			if (*left == 0)
+				break;
+		}
 
-		message(V_WARNING, _("Adjusted the number of threads "
-			"from %s to %s to not exceed "
-			"the memory usage limit of %s MiB"),
-			uint64_to_str(hardware_threads_get(), 0),
-			uint64_to_str(mt_options.threads, 1),
-			uint64_to_str(round_up_to_mib(
-				memory_limit), 2));
+		if (ret == LZMA_STREAM_END)
+			break;
+
+		error = ret != LZMA_OK;
+		message_progress_update();
 	}
-#	endif
 
-	if (memory_usage <= memory_limit)
-		return;
+	if (error && ret != LZMA_OK) {
+		message_error("%s: %s", pair->src_name, message_strm(ret));
+		if (ret == LZMA_MEMLIMIT_ERROR)
+			message_mem_needed(V_ERROR, memusage);
+	}
 
-	// Look for the last filter if it is LZMA2 or LZMA1, so we can make
-	// it use less RAM. With other filters we don't know what to do.
-	size_t i = 0;
-	while (filters[i].id != LZMA_FILTER_LZMA2
-			&& filters[i].id != LZMA_FILTER_LZMA1) {
-		if (filters[i].id == LZMA_VLI_UNKNOWN)
-			memlimit_too_small(memory_usage);
+	for (size_t i = 0; block_filters[i].id != LZMA_VLI_UNKNOWN; ++i)
+		free(block_filters[i].options);
 
-		++i;
-	}
+	return error;
+}
 
-	// Decrease the dictionary size until we meet the memory
-	// usage limit. First round down to full mebibytes.
-	lzma_options_lzma *opt = filters[i].options;
-	const uint32_t orig_dict_size = opt->dict_size;
-	opt->dict_size &= ~((UINT32_C(1) << 20) - 1);
-	while (true) {
-		// If it is below 1 MiB, auto-adjusting failed. We could be
-		// more sophisticated and scale it down even more, but let's
-		// see if many complain about this version.
-		//
-		// FIXME: Displays the scaled memory usage instead
-		// of the original.
-		if (opt->dict_size < (UINT32_C(1) << 20))
-			memlimit_too_small(memory_usage);
 
-		memory_usage = lzma_raw_encoder_memusage(filters);
-		if (memory_usage == UINT64_MAX)
-			message_bug();
+/// Decompress only the Blocks that contain the part of the uncompressed
+/// data selected with --offset and --length.
+static bool
+coder_range(file_pair *pair)
+{
+	lzma_index_iter iter;
+	lzma_index_iter_init(&iter, range_idx);
 
-		// Accept it if it is low enough.
-		if (memory_usage <= memory_limit)
-			break;
+	// Nothing is written if the range starts at or after the end
+	// of the uncompressed data.
+	if (opt_range_length == 0
+			|| lzma_index_iter_locate(&iter, opt_range_offset))
+		return true;
 
-		// Otherwise 1 MiB down and try again. I hope this
-		// isn't too slow method for cases where the original
-		// dict_size is very big.
-		opt->dict_size -= UINT32_C(1) << 20;
-	}
+	uint64_t skip = opt_range_offset
+			- iter.block.uncompressed_file_offset;
+	uint64_t left = opt_range_length;
 
-	// Tell the user that we decreased the dictionary size.
-	message(V_WARNING, _("Adjusted LZMA%c dictionary size "
-			"from %s MiB to %s MiB to not exceed "
-			"the memory usage limit of %s MiB"),
-			filters[i].id == LZMA_FILTER_LZMA2
-				? '2' : '1',
-			uint64_to_str(orig_dict_size >> 20, 0),
-			uint64_to_str(opt->dict_size >> 20, 1),
-			uint64_to_str(round_up_to_mib(memory_limit), 2));
+	strm.next_out = out_buf->u8;
+	strm.avail_out = pair->dest_buffer_size;
+
+	do {
+		if (range_decode_block(pair, &iter, &skip, &left))
+			return false;
+	} while (left > 0 && !user_abort && !lzma_index_iter_next(
+			&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK));
+
+	return !user_abort;
+}
 #endif
 
+
+#ifdef HAVE_LZFSE
+/// Amount of input compressed at a time to the .lzfse format. The LZFSE
+/// library compresses only whole buffers, so the input is split into
+/// chunks that are compressed independently. Matches cannot be longer
+/// than 256 KiB apart anyway, so bigger chunks would help very little.
+#define LZFSE_CHUNK_SIZE (UINT32_C(1) << 20)
+
+/// The end of stream block of LZFSE is just the magic bytes "bvx$".
+static const uint8_t lzfse_end_of_stream[4] = { 0x62, 0x76, 0x78, 0x24 };
+
+/// LZFSE encoder and decoder. They are kept between files so that their
+/// buffers don't need to be allocated again.
+static lzfse_encoder_context *lzfse_enc = NULL;
+static lzfse_decode_stream *lzfse_dec = NULL;
+
+
+/// Get the LZFSE encoder or decoder ready for a new file. The progress
+/// info is kept in strm.total_in and strm.total_out like in passthru mode.
+static void
+lzfse_init(void)
+{
+	if (opt_mode == MODE_COMPRESS) {
+		if (lzfse_enc == NULL) {
+			lzfse_enc = lzfse_encoder_context_create();
+			if (lzfse_enc == NULL)
+				message_fatal("%s", message_strm(
+						LZMA_MEM_ERROR));
+		}
+	} else {
+		if (lzfse_dec == NULL) {
+			lzfse_dec = lzfse_decode_stream_create();
+			if (lzfse_dec == NULL)
+				message_fatal("%s", message_strm(
+						LZMA_MEM_ERROR));
+		} else {
+			lzfse_decode_stream_reset(lzfse_dec);
+		}
+	}
+
+	strm.total_in = 0;
+	strm.total_out = 0;
 	return;
 }
 
 
-#ifdef HAVE_DECODERS
-/// Return true if the data in in_buf seems to be in the .xz format.
+/// Compress to the .lzfse format. Each chunk of input becomes one or more
+/// blocks. The end of stream marker is removed from all but the last chunk
+/// so that the result is a single stream.
 static bool
-is_format_xz(void)
+coder_lzfse_compress(file_pair *pair)
 {
-	// Specify the magic as hex to be compatible with EBCDIC systems.
-	static const uint8_t magic[6] = { 0xFD, 0x37, 0x7A, 0x58, 0x5A, 0x00 };
-	return strm.avail_in >= sizeof(magic)
-			&& memcmp(in_buf.u8, magic, sizeof(magic)) == 0;
+	while (!user_abort) {
+		const size_t in_size = io_read(pair, in_buf, LZFSE_CHUNK_SIZE);
+		if (in_size == SIZE_MAX)
+			return false;
+
+		size_t out_size = 0;
+
+		if (in_size > 0) {
+			// The input is stored uncompressed if it doesn't
+			// compress, which needs 12 bytes more than the
+			// input. out_buf is much bigger than that.
+			out_size = lzfse_encode_buffer_with_context(
+					out_buf->u8, IO_BUFFER_SIZE_BIG,
+					in_buf->u8, in_size, lzfse_enc);
+			if (out_size < sizeof(lzfse_end_of_stream))
+				message_bug();
+
+			out_size -= sizeof(lzfse_end_of_stream);
+		}
+
+		if (pair->src_eof) {
+			memcpy(out_buf->u8 + out_size, lzfse_end_of_stream,
+					sizeof(lzfse_end_of_stream));
+			out_size += sizeof(lzfse_end_of_stream);
+		}
+
+		if (io_write(pair, out_buf, out_size))
+			return false;
+
+		strm.total_in += in_size;
+		strm.total_out += out_size;
+
+		if (pair->src_eof)
+			return true;
+
+		message_progress_update();
+	}
+
+	return false;
 }
 
 
-/// Return true if the data in in_buf seems to be in the .lzma format.
+/// Decompress or test a .lzfse file. The first input chunk has already
+/// been read into in_buf. Like with .lzma, data after the end of the
+/// stream (also another LZFSE stream) is an error.
 static bool
-is_format_lzma(void)
+coder_lzfse_decompress(file_pair *pair)
 {
-	// The .lzma header is 13 bytes.
-	if (strm.avail_in < 13)
-		return false;
+	const uint8_t *next_in = strm.next_in;
+	size_t avail_in = strm.avail_in;
 
-	// Decode the LZMA1 properties.
-	lzma_filter filter = { .id = LZMA_FILTER_LZMA1 };
-	if (lzma_properties_decode(&filter, NULL, in_buf.u8, 5) != LZMA_OK)
-		return false;
+	while (!user_abort) {
+		uint8_t *next_out = out_buf->u8;
+		size_t avail_out = pair->dest_buffer_size;
+		const size_t in_start = avail_in;
 
-	// A hack to ditch tons of false positives: We allow only dictionary
-	// sizes that are 2^n or 2^n + 2^(n-1) or UINT32_MAX. LZMA_Alone
-	// created only files with 2^n, but accepts any dictionary size.
-	// If someone complains, this will be reconsidered.
-	lzma_options_lzma *opt = filter.options;
-	const uint32_t dict_size = opt->dict_size;
-	free(opt);
+		const int ret = lzfse_decode_stream_process(lzfse_dec,
+				&next_in, &avail_in, &next_out, &avail_out);
 
-	if (dict_size != UINT32_MAX) {
-		uint32_t d = dict_size - 1;
-		d |= d >> 2;
-		d |= d >> 3;
-		d |= d >> 4;
-		d |= d >> 8;
-		d |= d >> 16;
-		++d;
-		if (d != dict_size || dict_size == 0)
+		const size_t out_size = pair->dest_buffer_size - avail_out;
+		strm.total_in += in_start - avail_in;
+		strm.total_out += out_size;
+
+		if (opt_mode != MODE_TEST && out_size > 0
+				&& io_write(pair, out_buf, out_size))
+			return false;
+
+		if (ret == 1) {
+			// The decoder may have consumed some of the input
+			// that follows the stream. Otherwise read once more
+			// to see if the file ends here.
+			if (lzfse_decode_stream_unused(lzfse_dec) == 0
+					&& avail_in == 0 && !pair->src_eof) {
+				avail_in = io_read(pair, in_buf,
+						pair->src_buffer_size);
+				if (avail_in == SIZE_MAX)
+					return false;
+			}
+
+			if (lzfse_decode_stream_unused(lzfse_dec) == 0
+					&& avail_in == 0)
+				return true;
+
+			message_error("%s: %s", pair->src_name,
+					message_strm(LZMA_DATA_ERROR));
 			return false;
+		}
+
+		if (ret == -1) {
+			message_error("%s: %s", pair->src_name,
+					message_strm(LZMA_DATA_ERROR));
+			return false;
+		}
+
+		// More input is needed if the output buffer isn't full.
+		if (avail_out > 0) {
+			if (pair->src_eof) {
+				message_error("%s: %s", pair->src_name,
+						message_strm(LZMA_BUF_ERROR));
+				return false;
+			}
+
+			avail_in = io_read(pair, in_buf,
+					pair->src_buffer_size);
+			if (avail_in == SIZE_MAX)
+				return false;
+
+			next_in = in_buf->u8;
+		}
+
+		message_progress_update();
 	}
 
-	// Another hack to ditch false positives: Assume that if the
-	// uncompressed size is known, it must be less than 256 GiB.
-	// Again, if someone complains, this will be reconsidered.
-	uint64_t uncompressed_size = 0;
-	for (size_t i = 0; i < 8; ++i)
-		uncompressed_size |= (uint64_t)(in_buf.u8[5 + i]) << (i * 8);
+	return false;
+}
 
-	if (uncompressed_size != UINT64_MAX
-			&& uncompressed_size > (UINT64_C(1) << 38))
-		return false;
 
-	return true;
+/// Compress, decompress, or test using the LZFSE library.
+static bool
+coder_lzfse(file_pair *pair)
+{
+	return opt_mode == MODE_COMPRESS ? coder_lzfse_compress(pair)
+			: coder_lzfse_decompress(pair);
 }
 #endif
 
@@ -429,8 +1825,11 @@ is_format_lzma(void)
 /// Detect the input file type (for now, this done only when decompressing),
 /// and initialize an appropriate coder. Return value indicates if a normal
 /// liblzma-based coder was initialized (CODER_INIT_NORMAL), if passthru
-/// mode should be used (CODER_INIT_PASSTHRU), or if an error occurred
-/// (CODER_INIT_ERROR).
+/// mode should be used (CODER_INIT_PASSTHRU), if the Blocks of a .xz file
+/// should be decoded in parallel (CODER_INIT_THREADED), if only a part of
+/// a .xz file should be decoded (CODER_INIT_RANGE), if the LZFSE library
+/// is used instead of liblzma (CODER_INIT_LZFSE), or if an error
+/// occurred (CODER_INIT_ERROR).
 static enum coder_init_ret
 coder_init(file_pair *pair)
 {
@@ -459,6 +1858,16 @@ coder_init(file_pair *pair)
 			ret = lzma_alone_encoder(&strm, filters[0].options);
 			break;
 
+		case FORMAT_LZFSE:
+#	ifdef HAVE_LZFSE
+			lzfse_init();
+			return CODER_INIT_LZFSE;
+#	else
+			// args.c ensures this.
+			assert(0);
+			break;
+#	endif
+
 		case FORMAT_RAW:
 			ret = lzma_raw_encoder(&strm, filters);
 			break;
@@ -488,6 +1897,10 @@ coder_init(file_pair *pair)
 				init_format = FORMAT_XZ;
 			else if (is_format_lzma())
 				init_format = FORMAT_LZMA;
+#	ifdef HAVE_LZFSE
+			else if (is_format_lzfse())
+				init_format = FORMAT_LZFSE;
+#	endif
 			break;
 
 		case FORMAT_XZ:
@@ -500,11 +1913,31 @@ coder_init(file_pair *pair)
 				init_format = FORMAT_LZMA;
 			break;
 
+		case FORMAT_LZFSE:
+#	ifdef HAVE_LZFSE
+			if (is_format_lzfse())
+				init_format = FORMAT_LZFSE;
+#	endif
+			break;
+
 		case FORMAT_RAW:
 			init_format = FORMAT_RAW;
 			break;
 		}
 
+		// --offset and --length use the Index to find the Blocks
+		// that need to be decoded.
+		if (opt_range_offset != 0 || opt_range_length != UINT64_MAX) {
+			if (init_format == FORMAT_XZ)
+				return range_init(pair) ? CODER_INIT_ERROR
+						: CODER_INIT_RANGE;
+
+			message_error(_("%s: --offset and --length need "
+					"a seekable .xz file"),
+					pair->src_name);
+			return CODER_INIT_ERROR;
+		}
+
 		switch (init_format) {
 		case FORMAT_AUTO:
 			// Unknown file format. If --decompress --stdout
@@ -531,6 +1964,16 @@ coder_init(file_pair *pair)
 						MODE_DECOMPRESS));
 			break;
 
+		case FORMAT_LZFSE:
+#	ifdef HAVE_LZFSE
+			lzfse_init();
+			return CODER_INIT_LZFSE;
+#	else
+			// is_format_lzfse() doesn't exist then.
+			assert(0);
+			break;
+#	endif
+
 		case FORMAT_RAW:
 			// Memory usage has already been checked in
 			// coder_set_compression_settings().
@@ -547,6 +1990,19 @@ coder_init(file_pair *pair)
 			strm.avail_out = 0;
 			ret = lzma_code(&strm, LZMA_RUN);
 		}
+
+#	ifdef MYTHREAD_ENABLED
+		// The Blocks of seekable .xz files can be decoded in
+		// parallel using the Index at the end of the file.
+		if (ret == LZMA_OK && init_format == FORMAT_XZ) {
+			bool error = false;
+			if (mt_decoder_init(pair, &error))
+				return CODER_INIT_THREADED;
+
+			if (error)
+				return CODER_INIT_ERROR;
+		}
+#	endif
 #endif
 	}
 
@@ -616,12 +2072,13 @@ static bool
 coder_write_output(file_pair *pair)
 {
 	if (opt_mode != MODE_TEST) {
-		if (io_write(pair, &out_buf, IO_BUFFER_SIZE - strm.avail_out))
+		if (io_write(pair, out_buf,
+				pair->dest_buffer_size - strm.avail_out))
 			return true;
 	}
 
-	strm.next_out = out_buf.u8;
-	strm.avail_out = IO_BUFFER_SIZE;
+	strm.next_out = out_buf->u8;
+	strm.avail_out = pair->dest_buffer_size;
 	return false;
 }
 
@@ -685,17 +2142,17 @@ coder_normal(file_pair *pair)
 		}
 	}
 
-	strm.next_out = out_buf.u8;
-	strm.avail_out = IO_BUFFER_SIZE;
+	strm.next_out = out_buf->u8;
+	strm.avail_out = pair->dest_buffer_size;
 
 	while (!user_abort) {
 		// Fill the input buffer if it is empty and we aren't
 		// flushing or finishing.
 		if (strm.avail_in == 0 && action == LZMA_RUN) {
-			strm.next_in = in_buf.u8;
-			strm.avail_in = io_read(pair, &in_buf,
+			strm.next_in = in_buf->u8;
+			strm.avail_in = io_read(pair, in_buf,
 					my_min(block_remaining,
-						IO_BUFFER_SIZE));
+						pair->src_buffer_size));
 
 			if (strm.avail_in == SIZE_MAX)
 				break;
@@ -786,7 +2243,7 @@ coder_normal(file_pair *pair)
 					// input, and thus pair->src_eof
 					// becomes true.
 					strm.avail_in = io_read(
-							pair, &in_buf, 1);
+							pair, in_buf, 1);
 					if (strm.avail_in == SIZE_MAX)
 						break;
 
@@ -849,14 +2306,14 @@ coder_passthru(file_pair *pair)
 		if (user_abort)
 			return false;
 
-		if (io_write(pair, &in_buf, strm.avail_in))
+		if (io_write(pair, in_buf, strm.avail_in))
 			return false;
 
 		strm.total_in += strm.avail_in;
 		strm.total_out = strm.total_in;
 		message_progress_update();
 
-		strm.avail_in = io_read(pair, &in_buf, IO_BUFFER_SIZE);
+		strm.avail_in = io_read(pair, in_buf, pair->src_buffer_size);
 		if (strm.avail_in == SIZE_MAX)
 			return false;
 	}
@@ -865,6 +2322,58 @@ coder_passthru(file_pair *pair)
 }
 
 
+/// Tell the progress info how many threads code the file and how much
+/// memory they use.
+static void
+progress_usage(enum coder_init_ret init_ret)
+{
+	uint32_t threads = 1;
+	uint64_t memusage = 0;
+
+	if (init_ret == CODER_INIT_LZFSE) {
+#ifdef HAVE_LZFSE
+		// The decoder has a 1 MiB window and a 64 KiB block
+		// buffer in addition to the state. See lzfse.h.
+		memusage = opt_mode == MODE_COMPRESS
+				? lzfse_encode_scratch_size()
+				: lzfse_decode_scratch_size()
+					+ (UINT32_C(1) << 20)
+					+ (UINT32_C(64) << 10);
+#endif
+	} else if (opt_mode == MODE_COMPRESS) {
+		// lzma_memusage() doesn't support the encoders.
+#ifdef HAVE_ENCODERS
+#	ifdef MYTHREAD_ENABLED
+		if (opt_format == FORMAT_XZ && hardware_threads_get() > 1) {
+			threads = mt_options.threads;
+			memusage = lzma_stream_encoder_mt_memusage(
+					&mt_options);
+		} else
+#	endif
+		{
+			memusage = lzma_raw_encoder_memusage(filters);
+		}
+#endif
+	} else if (init_ret == CODER_INIT_NORMAL
+			|| init_ret == CODER_INIT_THREADED) {
+		// With --offset and --length strm is initialized
+		// separately for each Block later.
+		memusage = lzma_memusage(&strm);
+
+#if defined(HAVE_DECODERS) && defined(MYTHREAD_ENABLED)
+		// Each thread has a decoder like the one in strm.
+		if (init_ret == CODER_INIT_THREADED) {
+			threads = mtd.threads;
+			memusage *= mtd.threads;
+		}
+#endif
+	}
+
+	message_progress_usage(threads, memusage);
+	return;
+}
+
+
 extern void
 coder_run(const char *filename)
 {
@@ -879,14 +2388,19 @@ coder_run(const char *filename)
 	// Assume that something goes wrong.
 	bool success = false;
 
+	if (in_buf == NULL) {
+		in_buf = xmalloc(IO_BUFFER_SIZE_BIG);
+		out_buf = xmalloc(IO_BUFFER_SIZE_BIG);
+	}
+
 	if (opt_mode == MODE_COMPRESS) {
 		strm.next_in = NULL;
 		strm.avail_in = 0;
 	} else {
 		// Read the first chunk of input data. This is needed
 		// to detect the input file type.
-		strm.next_in = in_buf.u8;
-		strm.avail_in = io_read(pair, &in_buf, IO_BUFFER_SIZE);
+		strm.next_in = in_buf->u8;
+		strm.avail_in = io_read(pair, in_buf, pair->src_buffer_size);
 	}
 
 	if (strm.avail_in != SIZE_MAX) {
@@ -912,12 +2426,54 @@ coder_run(const char *filename)
 				const uint64_t in_size
 					= pair->src_st.st_size <= 0
 					? 0 : (uint64_t)(pair->src_st.st_size);
+
+				// This has to be done before the other
+				// threads may start using strm.
+				progress_usage(init_ret);
+
+#ifdef MYTHREAD_ENABLED
+				// Overlap reading and writing with coding
+				// if possible. The progress indicator can
+				// then use only mt_progress.
+				const bool pipelined = init_ret
+						== CODER_INIT_NORMAL
+						&& pipeline_start(pair);
+#	ifdef HAVE_DECODERS
+				if (init_ret == CODER_INIT_THREADED) {
+					mt_progress.total_in = 0;
+					mt_progress.total_out = 0;
+				}
+#	endif
+				if (pipelined || init_ret
+						== CODER_INIT_THREADED)
+					message_progress_start(&mt_progress,
+							true, in_size);
+				else
+#endif
 				message_progress_start(&strm,
-						is_passthru, in_size);
+						is_passthru || init_ret
+							== CODER_INIT_LZFSE,
+						in_size);
 
 				// Do the actual coding or passthru.
 				if (is_passthru)
 					success = coder_passthru(pair);
+#ifdef HAVE_LZFSE
+				else if (init_ret == CODER_INIT_LZFSE)
+					success = coder_lzfse(pair);
+#endif
+#ifdef HAVE_DECODERS
+				else if (init_ret == CODER_INIT_RANGE)
+					success = coder_range(pair);
+#endif
+#if defined(HAVE_DECODERS) && defined(MYTHREAD_ENABLED)
+				else if (init_ret == CODER_INIT_THREADED)
+					success = coder_threaded(pair);
+#endif
+#ifdef MYTHREAD_ENABLED
+				else if (pipelined)
+					success = coder_pipelined(pair);
+#endif
 				else
 					success = coder_normal(pair);
 
@@ -926,6 +2482,17 @@ coder_run(const char *filename)
 		}
 	}
 
+#if defined(HAVE_DECODERS) && defined(MYTHREAD_ENABLED)
+	// Free the Index of the threaded decoder. It is still here
+	// also if the destination file couldn't be opened.
+	lzma_index_end(mtd.idx, NULL);
+	mtd.idx = NULL;
+#endif
+#ifdef HAVE_DECODERS
+	lzma_index_end(range_idx, NULL);
+	range_idx = NULL;
+#endif
+
 	// Close the file pair. It needs to know if coding was successful to
 	// know if the source or target file should be unlinked.
 	io_close(pair, success);
@@ -939,6 +2506,25 @@ extern void
 coder_free(void)
 {
 	lzma_end(&strm);
+	free(in_buf);
+	free(out_buf);
+
+#ifdef HAVE_LZFSE
+	if (lzfse_enc != NULL)
+		lzfse_encoder_context_destroy(lzfse_enc);
+
+	lzfse_decode_stream_destroy(lzfse_dec);
+#endif
+
+#ifdef MYTHREAD_ENABLED
+	// pipeline.in[0] and pipeline.out[0] are in_buf and out_buf.
+	if (pipeline.in[0] != NULL) {
+		for (unsigned i = 1; i < PIPELINE_BUFS; ++i) {
+			free(pipeline.in[i]);
+			free(pipeline.out[i]);
+		}
+	}
+#endif
 	return;
 }
 #endif
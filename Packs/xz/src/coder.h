@@ -24,6 +24,7 @@ enum format_type {
 	FORMAT_XZ,
 	FORMAT_LZMA,
 	// HEADER_GZIP,
+	FORMAT_LZFSE,
 	FORMAT_RAW,
 };
 
@@ -52,12 +53,22 @@ extern uint64_t opt_block_size;
 /// as an array that is terminated with 0.
 extern uint64_t *opt_block_list;
 
+/// Uncompressed offset and the maximum size of the data to decompress
+/// (--offset and --length). The whole file is decompressed when these
+/// are 0 and UINT64_MAX.
+extern uint64_t opt_range_offset;
+extern uint64_t opt_range_length;
+
 /// Set the integrity check type used when compressing
 extern void coder_set_check(lzma_check check);
 
 /// Set preset number
 extern void coder_set_preset(uint32_t new_preset);
 
+/// Get the preset number, possibly ORed with LZMA_PRESET_EXTREME.
+/// Return false if no preset level was given on the command line.
+extern bool coder_get_preset(uint32_t *preset);
+
 /// Enable extreme mode
 extern void coder_set_extreme(void);
 
@@ -164,6 +164,13 @@ io_allow_sandbox(void)
 }
 
 
+extern bool
+io_sandbox_allowed(void)
+{
+	return sandbox_allowed;
+}
+
+
 /// Enables operating-system-specific sandbox if it is possible.
 /// src_fd is the file descriptor of the input file.
 static void
@@ -497,6 +504,22 @@ io_copy_attrs(const file_pair *pair)
 }
 
 
+/// Get the buffer size to use with fd. Only regular files get the big
+/// buffers: reads from pipes and terminals must return as soon as there
+/// is some input, and the output written to them shouldn't be delayed
+/// either. --flush-timeout needs the small buffers always.
+static size_t
+io_buffer_size(int fd)
+{
+	struct stat st;
+	if (opt_flush_timeout != 0 || fstat(fd, &st)
+			|| !S_ISREG(st.st_mode))
+		return IO_BUFFER_SIZE;
+
+	return IO_BUFFER_SIZE_BIG;
+}
+
+
 /// Opens the source file. Returns false on success, true on error.
 static bool
 io_open_src_real(file_pair *pair)
@@ -755,8 +778,14 @@ io_open_src(const char *src_name)
 		.src_eof = false,
 		.src_has_seen_input = false,
 		.flush_needed = false,
+		.src_try_holes = false,
+		.src_pos = 0,
+		.src_hole_end = 0,
+		.src_data_end = 0,
 		.dest_try_sparse = false,
 		.dest_pending_sparse = 0,
+		.src_buffer_size = IO_BUFFER_SIZE,
+		.dest_buffer_size = IO_BUFFER_SIZE,
 	};
 
 	// Block the signals, for which we have a custom signal handler, so
@@ -765,6 +794,29 @@ io_open_src(const char *src_name)
 	const bool error = io_open_src_real(&pair);
 	signals_unblock();
 
+	if (!error) {
+		pair.src_buffer_size = io_buffer_size(pair.src_fd);
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+		// A regular file that takes less space than its size
+		// may have holes. They don't need to be read from disk
+		// when compressing. Standard input can be a regular file
+		// too, so the starting position isn't necessarily zero.
+		if (opt_mode == MODE_COMPRESS
+				&& S_ISREG(pair.src_st.st_mode)
+				&& (off_t)(pair.src_st.st_blocks) * 512
+					< pair.src_st.st_size) {
+			pair.src_pos = lseek(pair.src_fd, 0, SEEK_CUR);
+			pair.src_try_holes = pair.src_pos != -1;
+		}
+#endif
+
+		// With --test there's no destination file and thus
+		// nothing that would wait for the output.
+		if (opt_flush_timeout == 0)
+			pair.dest_buffer_size = IO_BUFFER_SIZE_BIG;
+	}
+
 #ifdef ENABLE_SANDBOX
 	if (!error)
 		io_sandbox_enter(pair.src_fd);
@@ -993,6 +1045,10 @@ io_open_dest(file_pair *pair)
 	signals_block();
 	const bool ret = io_open_dest_real(pair);
 	signals_unblock();
+
+	if (!ret)
+		pair->dest_buffer_size = io_buffer_size(pair->dest_fd);
+
 	return ret;
 }
 
@@ -1100,7 +1156,7 @@ io_close(file_pair *pair, bool success)
 extern void
 io_fix_src_pos(file_pair *pair, size_t rewind_size)
 {
-	assert(rewind_size <= IO_BUFFER_SIZE);
+	assert(rewind_size <= IO_BUFFER_SIZE_BIG);
 
 	if (rewind_size > 0) {
 		// This doesn't need to work on unseekable file descriptors,
@@ -1112,6 +1168,67 @@ io_fix_src_pos(file_pair *pair, size_t rewind_size)
 }
 
 
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+/// Check if there is a hole at pair->src_pos in the source file. Return
+/// the number of zero bytes (at most *limit) to use instead of reading
+/// the file. If there is data instead, zero is returned and *limit is
+/// reduced so that the read() doesn't continue into the next hole. On
+/// error, SIZE_MAX is returned.
+static size_t
+io_src_hole(file_pair *pair, size_t *limit)
+{
+	if (pair->src_pos >= pair->src_hole_end
+			&& pair->src_pos >= pair->src_data_end) {
+		const off_t data = lseek(pair->src_fd, pair->src_pos,
+				SEEK_DATA);
+
+		if (data == -1) {
+			// ENXIO means that there is no data after src_pos.
+			// With other errors, the file is read normally.
+			const off_t end = errno == ENXIO
+					? lseek(pair->src_fd, 0, SEEK_END)
+					: -1;
+			if (end == -1)
+				pair->src_try_holes = false;
+			else
+				pair->src_hole_end = end;
+
+		} else if (data > pair->src_pos) {
+			pair->src_hole_end = data;
+
+		} else {
+			const off_t hole = lseek(pair->src_fd, pair->src_pos,
+					SEEK_HOLE);
+			if (hole == -1)
+				pair->src_try_holes = false;
+			else
+				pair->src_data_end = hole;
+		}
+
+		// The lseek() calls above moved the file position.
+		if (lseek(pair->src_fd, pair->src_pos, SEEK_SET) == -1) {
+			message_error(_("%s: Error seeking the file: %s"),
+					pair->src_name, strerror(errno));
+			return SIZE_MAX;
+		}
+
+		if (!pair->src_try_holes)
+			return 0;
+	}
+
+	if (pair->src_pos < pair->src_hole_end)
+		return my_min(*limit,
+				(uint64_t)(pair->src_hole_end - pair->src_pos));
+
+	if (pair->src_pos < pair->src_data_end)
+		*limit = my_min(*limit,
+				(uint64_t)(pair->src_data_end - pair->src_pos));
+
+	return 0;
+}
+#endif
+
+
 extern size_t
 io_read(file_pair *pair, io_buf *buf, size_t size)
 {
@@ -1121,8 +1238,26 @@ io_read(file_pair *pair, io_buf *buf, size_t size)
 	size_t pos = 0;
 
 	while (pos < size) {
+		size_t limit = size - pos;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+		// Holes are read as zeros without touching the disk.
+		if (pair->src_try_holes) {
+			const size_t zeros = io_src_hole(pair, &limit);
+			if (zeros == SIZE_MAX)
+				return SIZE_MAX;
+
+			if (zeros > 0) {
+				memset(buf->u8 + pos, 0, zeros);
+				pos += zeros;
+				pair->src_pos += (off_t)(zeros);
+				continue;
+			}
+		}
+#endif
+
 		const ssize_t amount = read(
-				pair->src_fd, buf->u8 + pos, size - pos);
+				pair->src_fd, buf->u8 + pos, limit);
 
 		if (amount == 0) {
 			pair->src_eof = true;
@@ -1171,6 +1306,7 @@ io_read(file_pair *pair, io_buf *buf, size_t size)
 		}
 
 		pos += (size_t)(amount);
+		pair->src_pos += amount;
 
 		if (!pair->src_has_seen_input) {
 			pair->src_has_seen_input = true;
@@ -1271,51 +1407,72 @@ io_write_buf(file_pair *pair, const uint8_t *buf, size_t size)
 }
 
 
+/// Write data that isn't a part of a hole. If there is a pending hole,
+/// skip over it first.
+static bool
+io_write_data(file_pair *pair, const uint8_t *buf, size_t size)
+{
+	// Since io_close() requires that dest_pending_sparse > 0
+	// if the file ends with sparse block, we must return
+	// if size == 0 to avoid doing the lseek().
+	if (size == 0)
+		return false;
+
+	// This is not a sparse block. If we have a pending hole,
+	// skip it now.
+	if (pair->dest_pending_sparse > 0) {
+		if (lseek(pair->dest_fd, pair->dest_pending_sparse,
+				SEEK_CUR) == -1) {
+			message_error(_("%s: Seeking failed when "
+					"trying to create a sparse "
+					"file: %s"), pair->dest_name,
+					strerror(errno));
+			return true;
+		}
+
+		pair->dest_pending_sparse = 0;
+	}
+
+	return io_write_buf(pair, buf, size);
+}
+
+
 extern bool
 io_write(file_pair *pair, const io_buf *buf, size_t size)
 {
-	assert(size <= IO_BUFFER_SIZE);
+	assert(size <= IO_BUFFER_SIZE_BIG);
 
-	if (pair->dest_try_sparse) {
-		// Check if the block is sparse (contains only zeros). If it
-		// sparse, we just store the amount and return. We will take
-		// care of actually skipping over the hole when we hit the
-		// next data block or close the file.
-		//
-		// Since io_close() requires that dest_pending_sparse > 0
-		// if the file ends with sparse block, we must also return
-		// if size == 0 to avoid doing the lseek().
-		if (size == IO_BUFFER_SIZE) {
-			// Even if the block was sparse, treat it as non-sparse
-			// if the pending sparse amount is large compared to
-			// the size of off_t. In practice this only matters
-			// on 32-bit systems where off_t isn't always 64 bits.
-			const off_t pending_max
-				= (off_t)(1) << (sizeof(off_t) * CHAR_BIT - 2);
-			if (is_sparse(buf) && pair->dest_pending_sparse
-					< pending_max) {
-				pair->dest_pending_sparse += (off_t)(size);
-				return false;
-			}
-		} else if (size == 0) {
-			return false;
-		}
+	if (!pair->dest_try_sparse)
+		return io_write_buf(pair, buf->u8, size);
 
-		// This is not a sparse block. If we have a pending hole,
-		// skip it now.
-		if (pair->dest_pending_sparse > 0) {
-			if (lseek(pair->dest_fd, pair->dest_pending_sparse,
-					SEEK_CUR) == -1) {
-				message_error(_("%s: Seeking failed when "
-						"trying to create a sparse "
-						"file: %s"), pair->dest_name,
-						strerror(errno));
+	// Check each IO_BUFFER_SIZE block if it is sparse (contains only
+	// zeros). Sparse blocks are only added to the amount of the pending
+	// hole. We will take care of actually skipping over the hole when
+	// we hit the next data block or close the file. The data between
+	// the holes is written with one write() call.
+	//
+	// Even if a block was sparse, treat it as non-sparse if the pending
+	// sparse amount is large compared to the size of off_t. In practice
+	// this only matters on 32-bit systems where off_t isn't always
+	// 64 bits.
+	const off_t pending_max
+			= (off_t)(1) << (sizeof(off_t) * CHAR_BIT - 2);
+
+	// Start of the data that hasn't been written or skipped yet
+	size_t data_pos = 0;
+
+	for (size_t pos = 0; size - pos >= IO_BUFFER_SIZE;
+			pos += IO_BUFFER_SIZE) {
+		if (is_sparse(&buf[pos / IO_BUFFER_SIZE])
+				&& pair->dest_pending_sparse < pending_max) {
+			if (io_write_data(pair, buf->u8 + data_pos,
+					pos - data_pos))
 				return true;
-			}
 
-			pair->dest_pending_sparse = 0;
+			pair->dest_pending_sparse += IO_BUFFER_SIZE;
+			data_pos = pos + IO_BUFFER_SIZE;
 		}
 	}
 
-	return io_write_buf(pair, buf->u8, size);
+	return io_write_data(pair, buf->u8 + data_pos, size - data_pos);
 }
@@ -18,6 +18,13 @@
 #	define IO_BUFFER_SIZE (BUFSIZ & ~7U)
 #endif
 
+// Size of the big buffers used when reading from and writing to regular
+// files. With multi-GB/s decompression speeds, a syscall and a round of
+// lzma_code() per IO_BUFFER_SIZE bytes is a significant overhead. This
+// must be a multiple of IO_BUFFER_SIZE.
+#define IO_BUFFER_SIZE_BIG \
+	((UINT32_C(2) << 20) / IO_BUFFER_SIZE * IO_BUFFER_SIZE)
+
 
 /// is_sparse() accesses the buffer as uint64_t for maximum speed.
 /// The u32 and u64 members must only be access through this union
@@ -56,6 +63,19 @@ typedef struct {
 	/// For --flush-timeout: True when flushing is needed.
 	bool flush_needed;
 
+	/// If true, the source file may be sparse, and its holes are found
+	/// with SEEK_DATA and SEEK_HOLE. io_read() returns zeros for them
+	/// without reading them. This is used only when compressing.
+	bool src_try_holes;
+
+	/// These are used only if src_try_holes is true. src_pos is the
+	/// position in src_fd. The bytes before src_hole_end are a hole,
+	/// and the bytes before src_data_end can be read normally. When
+	/// src_pos reaches both, the next hole or data is looked for.
+	off_t src_pos;
+	off_t src_hole_end;
+	off_t src_data_end;
+
 	/// If true, we look for long chunks of zeros and try to create
 	/// a sparse file.
 	bool dest_try_sparse;
@@ -65,6 +85,14 @@ typedef struct {
 	/// to make that byte range a sparse chunk.
 	off_t dest_pending_sparse;
 
+	/// How much to read or write at a time: IO_BUFFER_SIZE_BIG with
+	/// regular files and IO_BUFFER_SIZE with pipes, terminals, and
+	/// --flush-timeout so that the data flows without waiting for
+	/// a big buffer to fill. dest_buffer_size is set by io_open_dest()
+	/// but it is valid also in --test mode.
+	size_t src_buffer_size;
+	size_t dest_buffer_size;
+
 	/// Stat of the source file.
 	struct stat src_st;
 
@@ -93,6 +121,9 @@ extern void io_no_sparse(void);
 #ifdef ENABLE_SANDBOX
 /// \brief      main() calls this if conditions for sandboxing have been met.
 extern void io_allow_sandbox(void);
+
+/// \brief      Returns true if io_allow_sandbox() has been called
+extern bool io_sandbox_allowed(void);
 #endif
 
 
@@ -158,8 +189,10 @@ extern bool io_pread(file_pair *pair, io_buf *buf, size_t size, off_t pos);
 /// \brief      Writes a buffer to the destination file
 ///
 /// \param      pair    File pair having the destination file open for writing
-/// \param      buf     Buffer containing the data to be written
-/// \param      size    Size of the buffer; assumed be smaller than SSIZE_MAX
+/// \param      buf     Buffer containing the data to be written. It may
+///                     be an array of io_buf when size is bigger than
+///                     IO_BUFFER_SIZE.
+/// \param      size    Size of the buffer; at most IO_BUFFER_SIZE_BIG
 ///
 /// \return     On success, zero is returned. On error, -1 is returned
 ///             and error message printed.
@@ -17,34 +17,179 @@
 /// the --threads=NUM command line option.
 static uint32_t threads_max = 1;
 
+/// True if --threads=0 was used
+static bool threads_are_automatic = false;
+
+/// Number of processor cores that can be used. On Linux this takes
+/// the CPU quota of the control group into account.
+static uint32_t cpu_count = 1;
+
+/// Maximum number of files processed at the same time. This can be set
+/// with the --jobs=NUM command line option.
+static uint32_t jobs_max = 1;
+
 /// Memory usage limit for compression
 static uint64_t memlimit_compress;
 
 /// Memory usage limit for decompression
 static uint64_t memlimit_decompress;
 
-/// Total amount of physical RAM
+/// Total amount of physical RAM, or the memory limit of the control group
+/// if it is smaller
 static uint64_t total_ram;
 
 
+#ifdef __linux__
+/// Read a number from the cgroup file dir/name. "max" is read as UINT64_MAX.
+/// If second isn't NULL, a second number is read from the same line like
+/// in cpu.max. Return true if the file cannot be read.
+static bool
+cgroup_read(const char *dir, const char *name,
+		uint64_t *first, uint64_t *second)
+{
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name)
+			>= (int)(sizeof(path)))
+		return true;
+
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return true;
+
+	char line[64];
+	const bool error = fgets(line, sizeof(line), file) == NULL;
+	fclose(file);
+	if (error)
+		return true;
+
+	char *p = line;
+	for (unsigned i = 0; i < (second == NULL ? 1 : 2); ++i) {
+		uint64_t *value = i == 0 ? first : second;
+
+		if (strncmp(p, "max", 3) == 0) {
+			*value = UINT64_MAX;
+			p += 3;
+		} else {
+			// "-1" means no limit in cgroup v1 files.
+			// strtoull() makes it ULLONG_MAX.
+			char *end;
+			errno = 0;
+			*value = strtoull(p, &end, 10);
+			if (end == p || errno != 0)
+				return true;
+
+			p = end;
+		}
+	}
+
+	return false;
+}
+
+
+/// Lower *cpus and *ram to the limits of the control group in dir and
+/// of its ancestors up to the mount point of the hierarchy, which is
+/// the first root_len characters of dir.
+static void
+cgroup_walk(char *dir, size_t root_len, bool v2,
+		uint64_t *cpus, uint64_t *ram)
+{
+	while (true) {
+		uint64_t quota;
+		uint64_t period;
+		if ((v2 ? !cgroup_read(dir, "cpu.max", &quota, &period)
+				: !cgroup_read(dir, "cpu.cfs_quota_us",
+					&quota, NULL)
+				&& !cgroup_read(dir, "cpu.cfs_period_us",
+					&period, NULL))
+				&& quota != UINT64_MAX && period > 0) {
+			// Round up so that a quota of 1.5 cores
+			// gives two threads.
+			const uint64_t n = quota / period
+					+ (quota % period != 0);
+			*cpus = my_min(*cpus, my_max(n, 1));
+		}
+
+		uint64_t limit;
+		if (!cgroup_read(dir, v2 ? "memory.max"
+					: "memory.limit_in_bytes",
+				&limit, NULL))
+			*ram = my_min(*ram, limit);
+
+		char *slash = strrchr(dir + root_len, '/');
+		if (slash == NULL)
+			break;
+
+		*slash = '\0';
+	}
+
+	return;
+}
+
+
+/// Get the CPU quota and the memory limit of the control groups of this
+/// process from /proc/self/cgroup and /sys/fs/cgroup. Both cgroup v1 and
+/// v2 are supported. Containers often get only a fraction of the cores
+/// and RAM of the host, and using all cores would only make the threads
+/// wait for their turn.
+static void
+cgroup_limits(uint64_t *cpus, uint64_t *ram)
+{
+	FILE *file = fopen("/proc/self/cgroup", "r");
+	if (file == NULL)
+		return;
+
+	char line[PATH_MAX];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		// Each line is hierarchy-ID:controller-list:cgroup-path.
+		// The controller list is empty for cgroup v2.
+		char *controllers = strchr(line, ':');
+		if (controllers == NULL)
+			continue;
+
+		++controllers;
+		char *path = strchr(controllers, ':');
+		if (path == NULL)
+			continue;
+
+		*path++ = '\0';
+		path[strcspn(path, "\n")] = '\0';
+
+		const bool v2 = controllers[0] == '\0';
+		if (!v2 && strstr(controllers, "cpu") == NULL
+				&& strstr(controllers, "memory") == NULL)
+			continue;
+
+		char dir[PATH_MAX + 32];
+		const int root_len = snprintf(dir, sizeof(dir),
+				"/sys/fs/cgroup%s%s", v2 ? "" : "/",
+				controllers);
+		if (root_len < 0 || (size_t)(root_len) + strlen(path)
+				>= sizeof(dir))
+			continue;
+
+		strcpy(dir + root_len, path);
+		cgroup_walk(dir, (size_t)(root_len), v2, cpus, ram);
+	}
+
+	fclose(file);
+	return;
+}
+#endif
+
+
 extern void
 hardware_threads_set(uint32_t n)
 {
 	if (n == 0) {
 		// Automatic number of threads was requested.
-		// If threading support was enabled at build time,
-		// use the number of available CPU cores. Otherwise
-		// use one thread since disabling threading support
-		// omits lzma_cputhreads() from liblzma.
-#ifdef MYTHREAD_ENABLED
-		threads_max = lzma_cputhreads();
-		if (threads_max == 0)
-			threads_max = 1;
-#else
-		threads_max = 1;
-#endif
+		// Use the number of available CPU cores. It is one
+		// if threading support was disabled at build time
+		// (see hardware_init()).
+		threads_max = cpu_count;
+		threads_are_automatic = true;
 	} else {
 		threads_max = n;
+		threads_are_automatic = false;
 	}
 
 	return;
@@ -58,6 +203,47 @@ hardware_threads_get(void)
 }
 
 
+extern bool
+hardware_threads_are_automatic(void)
+{
+	return threads_are_automatic;
+}
+
+
+extern uint32_t
+hardware_cpu_count(void)
+{
+	return cpu_count;
+}
+
+
+extern void
+hardware_jobs_set(uint32_t n)
+{
+#ifdef TUKLIB_DOSLIKE
+	// Jobs are run in child processes, which need fork().
+	(void)n;
+	jobs_max = 1;
+#else
+	if (n == 0) {
+		// Use one job per CPU core like with --threads=0.
+		jobs_max = cpu_count;
+	} else {
+		jobs_max = n;
+	}
+#endif
+
+	return;
+}
+
+
+extern uint32_t
+hardware_jobs_get(void)
+{
+	return jobs_max;
+}
+
+
 extern void
 hardware_memlimit_set(uint64_t new_memlimit,
 		bool set_compress, bool set_decompress, bool is_percentage)
@@ -122,7 +308,23 @@ hardware_memlimit_get(enum operation_mode mode)
 	// threads.
 	const uint64_t memlimit = mode == MODE_COMPRESS
 			? memlimit_compress : memlimit_decompress;
-	return memlimit != 0 ? memlimit : UINT64_MAX;
+	if (memlimit == 0)
+		return UINT64_MAX;
+
+	// With --jobs, the files being processed at the same time
+	// share the limit.
+	return memlimit / jobs_max;
+}
+
+
+extern uint64_t
+hardware_memlimit_mt_get(enum operation_mode mode)
+{
+	// Don't hog all the RAM by default: use at most a quarter of it
+	// (shared by the files being processed with --jobs) even if
+	// the memory usage limit would allow more.
+	return my_min(hardware_memlimit_get(mode),
+			total_ram / 4 / jobs_max);
 }
 
 
@@ -174,6 +376,20 @@ hardware_init(void)
 	if (total_ram == 0)
 		total_ram = (uint64_t)(ASSUME_RAM) * 1024 * 1024;
 
+	// If threading support was disabled at build time, use one
+	// core since disabling threading support omits lzma_cputhreads()
+	// from liblzma.
+	uint64_t cpus = 1;
+#ifdef MYTHREAD_ENABLED
+	cpus = my_max(lzma_cputhreads(), 1);
+#endif
+
+#ifdef __linux__
+	cgroup_limits(&cpus, &total_ram);
+#endif
+
+	cpu_count = (uint32_t)(cpus);
+
 	// Set the defaults.
 	hardware_memlimit_set(0, true, true, false);
 	return;
@@ -21,6 +21,21 @@ extern void hardware_threads_set(uint32_t threadlimit);
 /// Get the maximum number of worker threads.
 extern uint32_t hardware_threads_get(void);
 
+/// Return true if the number of threads was set with --threads=0.
+extern bool hardware_threads_are_automatic(void);
+
+/// Get the number of processor cores that can be used. On Linux this
+/// is limited by the CPU quota of the control group.
+extern uint32_t hardware_cpu_count(void);
+
+
+/// Set the maximum number of files to process at the same time.
+/// Zero means one per CPU core.
+extern void hardware_jobs_set(uint32_t jobs);
+
+/// Get the maximum number of files to process at the same time.
+extern uint32_t hardware_jobs_get(void);
+
 
 /// Set the memory usage limit. There are separate limits for compression
 /// and decompression (the latter includes also --list), one or both can
@@ -33,5 +48,11 @@ extern void hardware_memlimit_set(uint64_t new_memlimit,
 /// Get the current memory usage limit for compression or decompression.
 extern uint64_t hardware_memlimit_get(enum operation_mode mode);
 
+/// Get the amount of memory that threaded compression or decompression
+/// should use when choosing the number of threads automatically. This is
+/// the memory usage limit but at most a quarter of the RAM (or of the
+/// memory limit of the control group), divided between the --jobs.
+extern uint64_t hardware_memlimit_mt_get(enum operation_mode mode);
+
 /// Display the amount of RAM and memory usage limits and exit.
 extern void hardware_memlimit_show(void) lzma_attribute((__noreturn__));
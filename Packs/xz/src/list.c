@@ -397,6 +397,17 @@ error:
 }
 
 
+extern lzma_index *
+list_read_index(file_pair *pair)
+{
+	xz_file_info xfi = XZ_FILE_INFO_INIT;
+	if (parse_indexes(&xfi, pair))
+		return NULL;
+
+	return xfi.idx;
+}
+
+
 /// \brief      Parse the Block Header
 ///
 /// The result is stored into *bhi. The caller takes care of initializing it.
@@ -14,5 +14,15 @@
 extern void list_file(const char *filename);
 
 
+/// \brief      Read the combined Index of a seekable .xz file
+///
+/// The Indexes of all Streams are decoded backwards from the end of the
+/// file like in list_file(). Errors are reported with message_error().
+///
+/// \return     The combined Index, which the caller must free with
+///             lzma_index_end(), or NULL on error.
+extern lzma_index *list_read_index(file_pair *pair);
+
+
 /// \brief      Show the totals after all files have been listed
 extern void list_totals(void);
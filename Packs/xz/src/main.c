@@ -13,6 +13,10 @@
 #include "private.h"
 #include <ctype.h>
 
+#ifndef TUKLIB_DOSLIKE
+#	include <sys/wait.h>
+#endif
+
 /// Exit status to use. This can be changed with set_exit_status().
 static enum exit_status_type exit_status = E_SUCCESS;
 
@@ -55,6 +59,285 @@ set_exit_no_warn(void)
 }
 
 
+/// Get the exit status to use. A warning is ignored if --no-warn was used.
+static enum exit_status_type
+get_exit_status(void)
+{
+	// Make a local copy of exit_status to keep the Windows code
+	// thread safe. At this point it is fine if we miss the user
+	// pressing C-c and don't set the exit_status to E_ERROR on
+	// Windows.
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	EnterCriticalSection(&exit_status_cs);
+#endif
+
+	enum exit_status_type es = exit_status;
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	LeaveCriticalSection(&exit_status_cs);
+#endif
+
+	// Suppress the exit status indicating a warning if --no-warn
+	// was specified.
+	if (es == E_WARNING && no_warn)
+		es = E_SUCCESS;
+
+	return es;
+}
+
+
+#ifndef TUKLIB_DOSLIKE
+/// A child process started by run_job()
+typedef struct {
+	/// Process ID of the child
+	pid_t pid;
+
+	/// Write end of the pipe from which the child reads filenames
+	int names_fd;
+
+} job_worker;
+
+/// The child processes used for --jobs
+static job_worker *jobs = NULL;
+
+/// Number of elements used in jobs[]
+static uint32_t jobs_started = 0;
+
+/// True if no more child processes can be started
+static bool jobs_full = false;
+
+/// The children write their index in jobs[] into this pipe every time
+/// they have finished a file and are ready to take the next one.
+static int jobs_ready_pipe[2];
+
+
+/// Read exactly size bytes from fd. Return true on end of file, on error,
+/// and if we got a signal.
+static bool
+job_read(int fd, void *buf, size_t size)
+{
+	size_t pos = 0;
+	while (pos < size) {
+		const ssize_t amount = read(fd, (uint8_t *)(buf) + pos,
+				size - pos);
+		if (amount == 0)
+			return true;
+
+		if (amount == -1) {
+			if (errno == EINTR && !user_abort)
+				continue;
+
+			return true;
+		}
+
+		pos += (size_t)(amount);
+	}
+
+	return false;
+}
+
+
+/// The main loop of a child process: read filenames from names_fd and
+/// process them one at a time. The lzma_stream and the other state of
+/// the coder are reused for all the files of the child like they are
+/// when the files are processed without --jobs.
+static void lzma_attribute((__noreturn__))
+job_main(void (*run)(const char *filename), uint32_t index, int names_fd)
+{
+	// Don't keep the other pipes open. Otherwise the other children
+	// wouldn't see the end of file when the parent closes its ends.
+	(void)close(jobs_ready_pipe[0]);
+	for (uint32_t i = 0; i < index; ++i)
+		(void)close(jobs[i].names_fd);
+
+	message_buffer_output();
+
+	char *name = NULL;
+	size_t name_size = 0;
+
+	while (!user_abort) {
+		size_t len;
+		if (job_read(names_fd, &len, sizeof(len)))
+			break;
+
+		if (len >= name_size) {
+			name_size = len + 1;
+			name = xrealloc(name, name_size);
+		}
+
+		if (job_read(names_fd, name, len))
+			break;
+
+		name[len] = '\0';
+		run(name);
+
+		// Print the messages of this file together.
+		fflush(stderr);
+
+		if (write(jobs_ready_pipe[1], &index, sizeof(index))
+				!= sizeof(index))
+			break;
+	}
+
+	signals_exit();
+
+	// _exit() is used so that stdio doesn't touch the streams shared
+	// with the parent, like the one from which --files reads. Nothing
+	// is written to stdout in the child processes.
+	fflush(stderr);
+	_exit((int)get_exit_status());
+}
+
+
+/// Start a new child process. Return true if it couldn't be started.
+static bool
+job_start(void (*run)(const char *filename))
+{
+	if (jobs == NULL) {
+		if (pipe(jobs_ready_pipe))
+			return true;
+
+		jobs = xmalloc(hardware_jobs_get() * sizeof(job_worker));
+	}
+
+	int names_pipe[2];
+	if (pipe(names_pipe))
+		return true;
+
+	// Don't let the child print pending output of the parent again.
+	fflush(stdout);
+	fflush(stderr);
+
+	const uint32_t index = jobs_started;
+	const pid_t pid = fork();
+	if (pid == -1) {
+		(void)close(names_pipe[0]);
+		(void)close(names_pipe[1]);
+		return true;
+	}
+
+	if (pid == 0) {
+		(void)close(names_pipe[1]);
+		job_main(run, index, names_pipe[0]);
+	}
+
+	(void)close(names_pipe[0]);
+	jobs[index].pid = pid;
+	jobs[index].names_fd = names_pipe[1];
+	++jobs_started;
+	return false;
+}
+
+
+/// Give the file to a child process that is ready for it. Up to
+/// hardware_jobs_get() files are processed at the same time, each by
+/// a child process with its own lzma_stream and file_pair.
+static void
+run_job(void (*run)(const char *filename), const char *filename)
+{
+	uint32_t index = UINT32_MAX;
+
+	if (!jobs_full) {
+		if (!job_start(run)) {
+			index = jobs_started - 1;
+			jobs_full = jobs_started == hardware_jobs_get();
+		} else {
+			jobs_full = true;
+
+			// If no child could be started, process
+			// the file in this process.
+			if (jobs_started == 0) {
+				run(filename);
+				return;
+			}
+		}
+
+		// Once all the children have been started, close our
+		// write end of the ready pipe so that reading it gives
+		// end of file instead of hanging if all the children
+		// die unexpectedly.
+		if (jobs_full) {
+			(void)close(jobs_ready_pipe[1]);
+			jobs_ready_pipe[1] = -1;
+		}
+	}
+
+	// Wait until one of the children is ready. This is interrupted
+	// if we get a signal.
+	if (index == UINT32_MAX) {
+		if (job_read(jobs_ready_pipe[0], &index, sizeof(index))) {
+			if (!user_abort)
+				message_error(_("%s: Cannot pass the file "
+						"to a job"), filename);
+
+			return;
+		}
+
+		if (index >= jobs_started)
+			message_bug();
+	}
+
+	const size_t len = strlen(filename);
+	if (write(jobs[index].names_fd, &len, sizeof(len)) != sizeof(len)
+			|| write(jobs[index].names_fd, filename, len)
+				!= (ssize_t)(len))
+		message_error(_("%s: Cannot pass the file to a job"),
+				filename);
+
+	return;
+}
+
+
+/// Wait for the child processes to finish their files and exit, and
+/// combine their exit statuses into ours. If we got a signal, it is
+/// passed on to the children so that they remove their incomplete
+/// output files.
+static void
+jobs_finish(void)
+{
+	for (uint32_t i = 0; i < jobs_started; ++i)
+		(void)close(jobs[i].names_fd);
+
+	bool children_killed = false;
+
+	for (uint32_t i = 0; i < jobs_started; ++i) {
+		int status;
+		while (true) {
+			if (user_abort && !children_killed) {
+				children_killed = true;
+				for (uint32_t j = i; j < jobs_started; ++j)
+					kill(jobs[j].pid, SIGTERM);
+			}
+
+			if (waitpid(jobs[i].pid, &status, 0) != -1)
+				break;
+
+			if (errno != EINTR)
+				message_bug();
+		}
+
+		if (!WIFEXITED(status))
+			set_exit_status(E_ERROR);
+		else if (WEXITSTATUS(status) == E_WARNING)
+			set_exit_status(E_WARNING);
+		else if (WEXITSTATUS(status) != E_SUCCESS)
+			set_exit_status(E_ERROR);
+	}
+
+	if (jobs != NULL) {
+		(void)close(jobs_ready_pipe[0]);
+		if (jobs_ready_pipe[1] != -1)
+			(void)close(jobs_ready_pipe[1]);
+
+		free(jobs);
+		jobs = NULL;
+	}
+
+	return;
+}
+#endif
+
+
 static const char *
 read_name(const args_info *args)
 {
@@ -170,6 +453,19 @@ main(int argc, char **argv)
 	args_info args;
 	args_parse(&args, argc, argv);
 
+	// --benchmark works in memory and doesn't process the files
+	// like the other modes.
+	if (opt_benchmark) {
+		if (args.arg_count == 0)
+			bench_run(NULL);
+
+		for (unsigned i = 0; i < args.arg_count; ++i)
+			bench_run(args.arg_names[i]);
+
+		tuklib_exit((int)get_exit_status(), E_ERROR,
+				message_verbosity_get() != V_SILENT);
+	}
+
 	if (opt_mode != MODE_LIST && opt_robot)
 		message_fatal(_("Compression and decompression with --robot "
 			"are not supported yet."));
@@ -264,8 +560,16 @@ main(int argc, char **argv)
 			args.arg_names[i] = (char *)stdin_filename;
 		}
 
-		// Do the actual compression or decompression.
-		run(args.arg_names[i]);
+		// Do the actual compression or decompression. Data
+		// from stdin goes to stdout so it is never done in
+		// a child process.
+#ifndef TUKLIB_DOSLIKE
+		if (hardware_jobs_get() > 1
+				&& args.arg_names[i] != stdin_filename)
+			run_job(run, args.arg_names[i]);
+		else
+#endif
+			run(args.arg_names[i]);
 	}
 
 	// If --files or --files0 was used, process the filenames from the
@@ -281,13 +585,23 @@ main(int argc, char **argv)
 
 			// read_name() doesn't return empty names.
 			assert(name[0] != '\0');
-			run(name);
+#ifndef TUKLIB_DOSLIKE
+			if (hardware_jobs_get() > 1)
+				run_job(run, name);
+			else
+#endif
+				run(name);
 		}
 
 		if (args.files_name != stdin_filename)
 			(void)fclose(args.files_file);
 	}
 
+#ifndef TUKLIB_DOSLIKE
+	// Wait for the files that are still being processed by --jobs.
+	jobs_finish();
+#endif
+
 #ifdef HAVE_DECODERS
 	// All files have now been handled. If in --list mode, display
 	// the totals before exiting. We don't have signal handlers
@@ -307,24 +621,6 @@ main(int argc, char **argv)
 	// of calling tuklib_exit().
 	signals_exit();
 
-	// Make a local copy of exit_status to keep the Windows code
-	// thread safe. At this point it is fine if we miss the user
-	// pressing C-c and don't set the exit_status to E_ERROR on
-	// Windows.
-#if defined(_WIN32) && !defined(__CYGWIN__)
-	EnterCriticalSection(&exit_status_cs);
-#endif
-
-	enum exit_status_type es = exit_status;
-
-#if defined(_WIN32) && !defined(__CYGWIN__)
-	LeaveCriticalSection(&exit_status_cs);
-#endif
-
-	// Suppress the exit status indicating a warning if --no-warn
-	// was specified.
-	if (es == E_WARNING && no_warn)
-		es = E_SUCCESS;
-
-	tuklib_exit((int)es, E_ERROR, message_verbosity_get() != V_SILENT);
+	tuklib_exit((int)get_exit_status(), E_ERROR,
+			message_verbosity_get() != V_SILENT);
 }
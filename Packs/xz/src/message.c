@@ -65,6 +65,27 @@ static bool progress_is_from_passthru;
 /// and estimate remaining time.
 static uint64_t expected_in_size;
 
+/// Number of threads and memory usage of the coder when they cannot be
+/// read from progress_strm. See message_progress_usage().
+static uint32_t progress_threads = 1;
+static uint64_t progress_memusage = 0;
+
+/// File descriptor given with --stats-fd, or -1 if the statistics records
+/// aren't wanted.
+static int stats_fd = -1;
+
+/// The name of the current file escaped for a JSON string, and a buffer
+/// big enough for a statistics record containing it
+static char *stats_name = NULL;
+static char *stats_buf = NULL;
+static size_t stats_buf_size;
+
+/// Elapsed time and the amount of uncompressed data when the previous
+/// statistics record was written. The current speed is calculated
+/// from the difference.
+static uint64_t stats_prev_elapsed;
+static uint64_t stats_prev_uncompressed;
+
 
 // Use alarm() and SIGALRM when they are supported. This has two minor
 // advantages over the alternative of polling gettimeofday():
@@ -90,10 +111,18 @@ const int message_progress_sigs[] = {
 /// once the progress message has been updated.
 static volatile sig_atomic_t progress_needs_updating = false;
 
+/// With --stats-fd the timer runs even when the progress indicator isn't
+/// shown. Then only SIGINFO and SIGUSR1 print a progress message, and
+/// the signal handler sets this to true when it gets one of them.
+static volatile sig_atomic_t progress_requested = false;
+
 /// Signal handler for SIGALRM
 static void
-progress_signal_handler(int sig lzma_attribute((__unused__)))
+progress_signal_handler(int sig)
 {
+	if (sig != SIGALRM)
+		progress_requested = true;
+
 	progress_needs_updating = true;
 	return;
 }
@@ -157,6 +186,33 @@ message_init(void)
 }
 
 
+extern void
+message_buffer_output(void)
+{
+	// Keep all the messages in the stdio buffer until the process
+	// exits. Nothing should have been printed to stderr without
+	// flushing it first, since stderr is unbuffered by default.
+	setvbuf(stderr, NULL, _IOFBF, 1 << 16);
+
+	// The progress indicator cannot be shown, but the final
+	// statistics are still printed on a line of their own.
+	progress_automatic = false;
+	return;
+}
+
+
+extern void
+message_set_stats_fd(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st))
+		message_fatal("--stats-fd=%d: %s", fd, strerror(errno));
+
+	stats_fd = fd;
+	return;
+}
+
+
 extern void
 message_verbosity_increase(void)
 {
@@ -245,6 +301,46 @@ message_filename(const char *src_name)
 }
 
 
+/// Escape the name of the current file for a JSON string and make
+/// stats_buf big enough for a record containing it.
+static void
+stats_set_name(void)
+{
+	const size_t len = strlen(filename);
+
+	// Control characters take six bytes each.
+	stats_name = xrealloc(stats_name, len * 6 + 1);
+	stats_buf_size = len * 6 + 512;
+	stats_buf = xrealloc(stats_buf, stats_buf_size);
+
+	char *pos = stats_name;
+	for (size_t i = 0; i < len; ++i) {
+		const unsigned char c = (unsigned char)(filename[i]);
+		if (c == '"' || c == '\\') {
+			*pos++ = '\\';
+			*pos++ = (char)(c);
+		} else if (c < 0x20) {
+			snprintf(pos, 7, "\\u%04x", c);
+			pos += 6;
+		} else {
+			*pos++ = (char)(c);
+		}
+	}
+
+	*pos = '\0';
+	return;
+}
+
+
+extern void
+message_progress_usage(uint32_t threads, uint64_t memusage)
+{
+	progress_threads = threads;
+	progress_memusage = memusage;
+	return;
+}
+
+
 extern void
 message_progress_start(lzma_stream *strm, bool is_passthru, uint64_t in_size)
 {
@@ -263,9 +359,16 @@ message_progress_start(lzma_stream *strm, bool is_passthru, uint64_t in_size)
 	// printing error messages.
 	progress_started = true;
 
-	// If progress indicator is wanted, print the filename and possibly
-	// the file count now.
-	if (verbosity >= V_VERBOSE && progress_automatic) {
+	if (stats_fd != -1) {
+		stats_set_name();
+		stats_prev_elapsed = 0;
+		stats_prev_uncompressed = 0;
+	}
+
+	// If progress indicator or statistics records are wanted,
+	// start the timer.
+	if ((verbosity >= V_VERBOSE && progress_automatic)
+			|| stats_fd != -1) {
 		// Start the timer to display the first progress message
 		// after one second. An alternative would be to show the
 		// first message almost immediately, but delaying by one
@@ -275,6 +378,7 @@ message_progress_start(lzma_stream *strm, bool is_passthru, uint64_t in_size)
 		// First disable a possibly existing alarm.
 		alarm(0);
 		progress_needs_updating = false;
+		progress_requested = false;
 		alarm(1);
 #else
 		progress_needs_updating = true;
@@ -541,6 +645,126 @@ progress_pos(uint64_t *in_pos,
 }
 
 
+/// Format thousandths as a decimal number. printf()'s %f isn't used because
+/// JSON needs a dot as the decimal point regardless of the locale.
+static const char *
+stats_decimal(uint64_t thousandths, uint32_t slot)
+{
+	static char buf[3][32];
+	snprintf(buf[slot], sizeof(buf[slot]), "%" PRIu64 ".%03" PRIu64,
+			thousandths / 1000, thousandths % 1000);
+	return buf[slot];
+}
+
+
+#ifdef SIGPIPE
+/// Return true if SIGPIPE is pending.
+static bool
+stats_sigpipe_pending(void)
+{
+	sigset_t pending;
+	return sigpending(&pending) == 0
+			&& sigismember(&pending, SIGPIPE) == 1;
+}
+#endif
+
+
+/// Write a statistics record to stats_fd. The speeds are in megabytes
+/// (10^6 bytes) of uncompressed data per second, which conveniently is
+/// the same as thousandths of bytes per millisecond.
+///
+/// This is called with signals blocked. If the reader has gone away,
+/// the SIGPIPE from write() is taken here so that only the records are
+/// disabled instead of the whole operation being aborted.
+static void
+stats_write(uint64_t in_pos, uint64_t compressed_pos,
+		uint64_t uncompressed_pos, uint64_t elapsed,
+		const char *state)
+{
+	const uint64_t out_pos = opt_mode == MODE_COMPRESS
+			? compressed_pos : uncompressed_pos;
+
+	// The ratio is unknown until there is some uncompressed data.
+	const char *ratio = "null";
+	if (uncompressed_pos > 0)
+		ratio = stats_decimal((uint64_t)((double)(compressed_pos)
+				/ (double)(uncompressed_pos) * 1000.0 + 0.5),
+				0);
+
+	const uint64_t interval = elapsed - stats_prev_elapsed;
+	const uint64_t speed = interval == 0 ? 0
+			: (uncompressed_pos - stats_prev_uncompressed)
+				/ interval;
+	const uint64_t average = elapsed == 0 ? 0
+			: uncompressed_pos / elapsed;
+
+	stats_prev_elapsed = elapsed;
+	stats_prev_uncompressed = uncompressed_pos;
+
+	// The coder uses the stream in a different thread in the
+	// cases where progress info doesn't come from progress_strm.
+	// lzma_memusage() returns zero with the encoders.
+	uint64_t memusage = progress_is_from_passthru
+			? 0 : lzma_memusage(progress_strm);
+	if (memusage == 0)
+		memusage = progress_memusage;
+
+	const int len = snprintf(stats_buf, stats_buf_size,
+			"{\"file\":\"%s\",\"state\":\"%s\","
+			"\"in\":%" PRIu64 ",\"out\":%" PRIu64 ","
+			"\"size\":%" PRIu64 ",\"ratio\":%s,"
+			"\"speed\":%s,\"average_speed\":%s,"
+			"\"elapsed\":%" PRIu64 ",\"threads\":%" PRIu32 ","
+			"\"memory\":%" PRIu64 "}\n",
+			stats_name, state, in_pos, out_pos,
+			expected_in_size, ratio,
+			stats_decimal(speed, 1), stats_decimal(average, 2),
+			elapsed, progress_threads, memusage);
+	assert(len > 0 && (size_t)(len) < stats_buf_size);
+
+	// The record is written with a single write() when possible so
+	// that the records of the --jobs processes don't get mixed.
+#ifdef SIGPIPE
+	const bool sigpipe_was_pending = stats_sigpipe_pending();
+#endif
+
+	size_t pos = 0;
+	while (pos < (size_t)(len)) {
+		const ssize_t amount = write(stats_fd, stats_buf + pos,
+				(size_t)(len) - pos);
+		if (amount == -1) {
+			if (errno == EINTR)
+				continue;
+
+			const int saved_errno = errno;
+
+#ifdef SIGPIPE
+			// A SIGPIPE that was pending already isn't ours.
+			if (saved_errno == EPIPE && !sigpipe_was_pending
+					&& stats_sigpipe_pending()) {
+				sigset_t mask;
+				sigemptyset(&mask);
+				sigaddset(&mask, SIGPIPE);
+				int sig;
+				sigwait(&mask, &sig);
+			}
+#endif
+
+			// Don't try again after an error.
+			const int fd = stats_fd;
+			stats_fd = -1;
+			message_warning("--stats-fd=%d: %s", fd,
+					strerror(saved_errno));
+			break;
+		}
+
+		pos += (size_t)(amount);
+	}
+
+	return;
+}
+
+
 extern void
 message_progress_update(void)
 {
@@ -563,29 +787,49 @@ message_progress_update(void)
 	uint64_t uncompressed_pos;
 	progress_pos(&in_pos, &compressed_pos, &uncompressed_pos);
 
+	const bool automatic = verbosity >= V_VERBOSE && progress_automatic;
+
+	// If the timer was started only for the statistics records,
+	// the progress message is printed only when the user asks for it.
+	// This is decided before stats_write(), which disables the records
+	// if their reader has gone away.
+#ifdef SIGALRM
+	const bool print = automatic || stats_fd == -1 || progress_requested;
+#else
+	const bool print = automatic;
+#endif
+
 	// Block signals so that fprintf() doesn't get interrupted.
 	signals_block();
 
-	// Print the filename if it hasn't been printed yet.
-	if (!current_filename_printed)
-		print_filename();
+	if (stats_fd != -1)
+		stats_write(in_pos, compressed_pos, uncompressed_pos,
+				elapsed, "running");
 
-	// Print the actual progress message. The idea is that there is at
-	// least three spaces between the fields in typical situations, but
-	// even in rare situations there is at least one space.
-	const char *cols[5] = {
-		progress_percentage(in_pos),
-		progress_sizes(compressed_pos, uncompressed_pos, false),
-		progress_speed(uncompressed_pos, elapsed),
-		progress_time(elapsed),
-		progress_remaining(in_pos, elapsed),
-	};
-	fprintf(stderr, "\r %*s %*s   %*s %10s   %10s\r",
-			tuklib_mbstr_fw(cols[0], 6), cols[0],
-			tuklib_mbstr_fw(cols[1], 35), cols[1],
-			tuklib_mbstr_fw(cols[2], 9), cols[2],
-			cols[3],
-			cols[4]);
+	if (print) {
+		// Print the filename if it hasn't been printed yet.
+		if (!current_filename_printed)
+			print_filename();
+
+		// Print the actual progress message. The idea is that there
+		// is at least three spaces between the fields in typical
+		// situations, but even in rare situations there is at least
+		// one space.
+		const char *cols[5] = {
+			progress_percentage(in_pos),
+			progress_sizes(compressed_pos, uncompressed_pos,
+				false),
+			progress_speed(uncompressed_pos, elapsed),
+			progress_time(elapsed),
+			progress_remaining(in_pos, elapsed),
+		};
+		fprintf(stderr, "\r %*s %*s   %*s %10s   %10s\r",
+				tuklib_mbstr_fw(cols[0], 6), cols[0],
+				tuklib_mbstr_fw(cols[1], 35), cols[1],
+				tuklib_mbstr_fw(cols[2], 9), cols[2],
+				cols[3],
+				cols[4]);
+	}
 
 #ifdef SIGALRM
 	// Updating the progress info was finished. Reset
@@ -595,28 +839,29 @@ message_progress_update(void)
 	// luck we could be setting this to false after the alarm has already
 	// been triggered.
 	progress_needs_updating = false;
+	progress_requested = false;
 
-	if (verbosity >= V_VERBOSE && progress_automatic) {
+	if (automatic) {
 		// Mark that the progress indicator is active, so if an error
 		// occurs, the error message gets printed cleanly.
 		progress_active = true;
-
-		// Restart the timer so that progress_needs_updating gets
-		// set to true after about one second.
-		alarm(1);
-	} else {
+	} else if (print) {
 		// The progress message was printed because user had sent us
 		// SIGALRM. In this case, each progress message is printed
 		// on its own line.
 		fputc('\n', stderr);
 	}
+
+	// Restart the timer so that progress_needs_updating gets
+	// set to true after about one second.
+	if (automatic || stats_fd != -1)
+		alarm(1);
 #else
 	// When SIGALRM isn't supported and we get here, it's always due to
 	// automatic progress update. We set progress_active here too like
 	// described above.
-	assert(verbosity >= V_VERBOSE);
-	assert(progress_automatic);
-	progress_active = true;
+	if (automatic)
+		progress_active = true;
 #endif
 
 	signals_unblock();
@@ -707,6 +952,20 @@ extern void
 message_progress_end(bool success)
 {
 	assert(progress_started);
+
+	if (stats_fd != -1) {
+		uint64_t in_pos;
+		uint64_t compressed_pos;
+		uint64_t uncompressed_pos;
+		progress_pos(&in_pos, &compressed_pos, &uncompressed_pos);
+
+		signals_block();
+		stats_write(in_pos, compressed_pos, uncompressed_pos,
+				mytime_get_elapsed(),
+				success ? "finished" : "failed");
+		signals_unblock();
+	}
+
 	progress_flush(success);
 	progress_started = false;
 	return;
@@ -1122,6 +1381,11 @@ message_help(bool long_help)
 "      --single-stream decompress only the first stream, and silently\n"
 "                      ignore possible remaining input data"));
 		puts(_(
+"      --offset=NUM    decompress to standard output starting at the\n"
+"                      uncompressed offset NUM; only the needed Blocks of\n"
+"                      .xz files are decoded\n"
+"      --length=NUM    decompress at most NUM bytes to standard output"));
+		puts(_(
 "      --no-sparse     do not create sparse files when decompressing\n"
 "  -S, --suffix=.SUF   use the suffix `.SUF' on compressed files\n"
 "      --files[=FILE]  read filenames to process from FILE; if FILE is\n"
@@ -1134,7 +1398,7 @@ message_help(bool long_help)
 		puts(_("\n Basic file format and compression options:\n"));
 		puts(_(
 "  -F, --format=FMT    file format to encode or decode; possible values are\n"
-"                      `auto' (default), `xz', `lzma', and `raw'\n"
+"                      `auto' (default), `xz', `lzma', `lzfse', and `raw'\n"
 "  -C, --check=CHECK   integrity check type: `none' (use with caution),\n"
 "                      `crc32', `crc64' (default), or `sha256'"));
 		puts(_(
@@ -1168,6 +1432,10 @@ message_help(bool long_help)
 "                      passed since the previous flush and reading more input\n"
 "                      would block, all pending data is flushed out"
 		));
+		puts(_(
+"      --jobs=NUM      process up to NUM files at the same time; the memory\n"
+"                      usage limit is divided between them; set to 0 to use\n"
+"                      as many jobs as there are processor cores"));
 		puts(_( // xgettext:no-c-format
 "      --memlimit-compress=LIMIT\n"
 "      --memlimit-decompress=LIMIT\n"
@@ -1237,11 +1505,22 @@ message_help(bool long_help)
 "  -Q, --no-warn       make warnings not affect the exit status"));
 		puts(_(
 "      --robot         use machine-parsable messages (useful for scripts)"));
+		puts(_(
+"      --stats-fd=FD   write the progress of each file as JSON objects, one per\n"
+"                      line, to the file descriptor FD about once a second"));
 		puts("");
 		puts(_(
 "      --info-memory   display the total amount of RAM and the currently active\n"
 "                      memory usage limits, and exit"));
 		puts(_(
+"      --benchmark[=LIST]\n"
+"                      compress and decompress the given files (or generated\n"
+"                      sample data) in memory with each preset, or the one\n"
+"                      given; display the speed, ratio, and memory usage, and\n"
+"                      exit; LIST is a comma-separated list of NUM[:SIZE]\n"
+"                      where NUM is the number of threads and SIZE the Block\n"
+"                      size; the default is one and --threads=NUM threads"));
+		puts(_(
 "  -h, --help          display the short help (lists only the basic options)\n"
 "  -H, --long-help     display this long help and exit"));
 	} else {
@@ -31,6 +31,22 @@ extern const int message_progress_sigs[];
 extern void message_init(void);
 
 
+/// \brief      Buffer the messages until exit
+///
+/// This is used in the child processes of --jobs so that the messages
+/// of one file are printed together instead of being mixed with the
+/// messages of other files. This also disables the progress indicator.
+extern void message_buffer_output(void);
+
+
+/// \brief      Write statistics records to the given file descriptor
+///
+/// While a file is being coded, a JSON object is written on a line of its
+/// own about once a second and after the file has been finished. If fd
+/// isn't open, this function doesn't return.
+extern void message_set_stats_fd(int fd);
+
+
 /// Increase verbosity level by one step unless it was at maximum.
 extern void message_verbosity_increase(void);
 
@@ -154,6 +170,18 @@ extern void message_progress_start(lzma_stream *strm,
 		bool is_passthru, uint64_t in_size);
 
 
+/// \brief      Set the resources used for coding the current file
+///
+/// This is shown in the --stats-fd records. When the decoder is used
+/// through the strm given to message_progress_start(), its current
+/// memory usage is shown instead of memusage.
+///
+/// \param      threads   Number of threads doing the coding
+/// \param      memusage  Memory usage of the coder(s) in bytes
+///
+extern void message_progress_usage(uint32_t threads, uint64_t memusage);
+
+
 /// Update the progress info if in verbose mode and enough time has passed
 /// since the previous update. This can be called only when
 /// message_progress_start() has already been used.
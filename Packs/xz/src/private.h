@@ -60,6 +60,7 @@
 #include "signals.h"
 #include "suffix.h"
 #include "util.h"
+#include "bench.h"
 
 #ifdef HAVE_DECODERS
 #	include "list.h"
@@ -122,6 +122,7 @@ uncompressed_name(const char *src_name, const size_t src_len)
 		{ ".tlz",   ".tar" },
 		// { ".gz",    "" },
 		// { ".tgz",   ".tar" },
+		{ ".lzfse", "" },
 	};
 
 	const char *new_suffix = "";
@@ -214,6 +215,9 @@ compressed_name(const char *src_name, size_t src_len)
 			".tgz",
 			NULL
 */
+		}, {
+			".lzfse",
+			NULL
 		}, {
 			// --format=raw requires specifying the suffix
 			// manually or using stdout.
@@ -292,6 +296,7 @@ compressed_name(const char *src_name, size_t src_len)
 				--src_len;
 
 		} else if (custom_suffix == NULL
+				&& opt_format != FORMAT_LZFSE
 				&& strcasecmp(sufsep, ".tar") == 0) {
 			// ".tar" is handled specially.
 			//